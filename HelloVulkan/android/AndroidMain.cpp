@@ -38,6 +38,7 @@
 using namespace mathfu;
 
 #define LOG_ACCELEROMETER false
+#define USE_RENDER_THREAD true
 
 bool init = false;
 
@@ -49,6 +50,10 @@ static int engine_init_display(struct engine* engine) {
     VKRenderer::create();
     VKRenderer::getInstance().init(engine);
 
+    if (USE_RENDER_THREAD) {
+        VKRenderer::getInstance().startRenderThread();
+    }
+
     init = true;
     return 0;
 }
@@ -61,6 +66,10 @@ static void engine_draw_frame(struct engine* engine) {
     if (!init)
         return;
 
+    // the render thread draws on its own
+    if (USE_RENDER_THREAD)
+        return;
+
     VKRenderer::getInstance().draw();
 }
 
@@ -1,4 +1,12 @@
 %VULKAN_SDK%\Bin\glslangValidator.exe -V shader.vert -o shader.vert.spv
 %VULKAN_SDK%\Bin\glslangValidator.exe -V shader.frag -o shader.frag.spv
 %VULKAN_SDK%\Bin\glslangValidator.exe -V debug.vert -o debug.vert.spv
-%VULKAN_SDK%\Bin\glslangValidator.exe -V debug.frag -o debug.frag.spv
\ No newline at end of file
+%VULKAN_SDK%\Bin\glslangValidator.exe -V debug.frag -o debug.frag.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V cull.comp -o cull.comp.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V depthpyramid.comp -o depthpyramid.comp.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V shadow.vert -o shadow.vert.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V drawpush.vert -o drawpush.vert.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V drawuniform.vert -o drawuniform.vert.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V drawstorage.vert -o drawstorage.vert.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V -DBINDLESS shader.frag -o shader_bindless.frag.spv
+%VULKAN_SDK%\Bin\glslangValidator.exe -V clustercull.comp -o clustercull.comp.spv
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// the draw's transforms, pushed before each draw
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    mat4 shadowTransform;
+} pc;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main() {
+    gl_Position = pc.shadowTransform * pc.model * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+struct DrawTransforms {
+    mat4 model;
+    mat4 shadowTransform;
+};
+
+// transforms of every draw, each draw's first instance is its index
+layout(std430, set = 0, binding = 0) readonly buffer DrawBuffer {
+    DrawTransforms transforms[];
+} draws;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main() {
+    DrawTransforms draw = draws.transforms[gl_InstanceIndex];
+    gl_Position = draw.shadowTransform * draw.model * vec4(inPosition, 1.0);
+}
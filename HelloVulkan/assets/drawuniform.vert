@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// the draw's transforms, selected by the dynamic offset of the bind
+layout(set = 0, binding = 0) uniform DrawTransforms {
+    mat4 model;
+    mat4 shadowTransform;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main() {
+    gl_Position = draw.shadowTransform * draw.model * vec4(inPosition, 1.0);
+}
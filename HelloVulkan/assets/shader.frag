@@ -8,8 +8,42 @@ layout(location = 3) in vec4 fragShadowTransform;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
-layout(binding = 2) uniform sampler2D texShadowSampler;
+#ifdef BINDLESS
+// the material table, built with -DBINDLESS into shader_bindless.frag.spv
+const uint MAX_MATERIALS = 1024;
+
+struct Material {
+    uint textureIndex;
+    uint samplerIndex;
+    uvec2 padding;
+};
+
+layout(set = 2, binding = 0) uniform texture2D textures[MAX_MATERIALS];
+layout(set = 2, binding = 1) uniform sampler samplers[MAX_MATERIALS];
+
+layout(std430, set = 2, binding = 2) readonly buffer MaterialBuffer {
+    Material entries[];
+} materials;
+
+layout(set = 2, binding = 3) uniform sampler2D texShadowSampler;
+
+// the same for the whole draw, so indexing the arrays with it is dynamically uniform
+layout(push_constant) uniform PushConstants {
+    uint materialId;
+} pc;
+
+vec4 sampleTexture(vec2 texCoord) {
+    Material material = materials.entries[pc.materialId];
+    return texture(sampler2D(textures[material.textureIndex], samplers[material.samplerIndex]), texCoord);
+}
+#else
+layout(set = 1, binding = 1) uniform sampler2D texSampler;
+layout(set = 1, binding = 2) uniform sampler2D texShadowSampler;
+
+vec4 sampleTexture(vec2 texCoord) {
+    return texture(texSampler, texCoord);
+}
+#endif
 
 void main() {
     float shadowFactor = 1.0f;
@@ -24,5 +58,5 @@ void main() {
     	shadowFactor = 0.2f;
     }
 
-    outColor = shadowFactor * texture(texSampler, fragTexCoord) * max(0.2f, dot(normalize(vec3(2.f, 2.f, -2.f)), worldNormal));
+    outColor = shadowFactor * sampleTexture(fragTexCoord) * max(0.2f, dot(normalize(vec3(2.f, 2.f, -2.f)), worldNormal));
 }
\ No newline at end of file
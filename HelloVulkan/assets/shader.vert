@@ -1,12 +1,26 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+// shared by every draw of the frame
+layout(set = 0, binding = 0) uniform View {
     mat4 view;
     mat4 proj;
+    mat4 viewProj;
+    mat4 lightViewProj;
     mat4 shadowTransform;
-} ubo;
+    vec4 frustumPlanes[6];
+    vec4 shadowFrustumPlanes[6];
+    vec4 lodParams;
+} view;
+
+layout(std430, set = 1, binding = 3) readonly buffer InstanceBuffer {
+    mat4 model[];
+} instances;
+
+// instances that passed culling for this pass
+layout(std430, set = 1, binding = 4) readonly buffer VisibleBuffer {
+    uint index[];
+} visible;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -23,9 +37,10 @@ out gl_PerVertex {
 };
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    mat4 model = instances.model[visible.index[gl_InstanceIndex]];
+    gl_Position = view.viewProj * model * vec4(inPosition, 1.0);
     fragColor = inColor;
 	fragTexCoord = inTexCoord;
-    worldNormal = (ubo.model * vec4(normalize(inNormal), 0.0)).xyz;
-    fragShadowTransform = ubo.shadowTransform * vec4(inPosition, 1.0);
+    worldNormal = (model * vec4(normalize(inNormal), 0.0)).xyz;
+    fragShadowTransform = view.shadowTransform * model * vec4(inPosition, 1.0);
 }
\ No newline at end of file
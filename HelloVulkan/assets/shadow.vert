@@ -0,0 +1,34 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// shared by every draw of the frame
+layout(set = 0, binding = 0) uniform View {
+    mat4 view;
+    mat4 proj;
+    mat4 viewProj;
+    mat4 lightViewProj;
+    mat4 shadowTransform;
+    vec4 frustumPlanes[6];
+    vec4 shadowFrustumPlanes[6];
+    vec4 lodParams;
+} view;
+
+layout(std430, set = 1, binding = 3) readonly buffer InstanceBuffer {
+    mat4 model[];
+} instances;
+
+// instances that passed culling for the shadow pass
+layout(std430, set = 1, binding = 4) readonly buffer VisibleBuffer {
+    uint index[];
+} visible;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main() {
+    mat4 model = instances.model[visible.index[gl_InstanceIndex]];
+    gl_Position = view.lightViewProj * model * vec4(inPosition, 1.0);
+}
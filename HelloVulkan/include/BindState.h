@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include "VKFuncs.h"
+
+class GeometryPool;
+
+// binds issued into command buffers, and those left out since the state was already bound
+struct BindStats
+{
+    uint32_t pipelineBinds{ 0 };
+    uint32_t pipelineBindsSkipped{ 0 };
+    uint32_t descriptorSetBinds{ 0 };
+    uint32_t descriptorSetBindsSkipped{ 0 };
+    uint32_t geometryBinds{ 0 };
+    uint32_t geometryBindsSkipped{ 0 };
+
+    BindStats &operator+=(const BindStats &other);
+};
+
+// What a command buffer has bound so far. Recording goes through here so binds repeating
+// the current state are skipped, which pays off once draws are sorted by state.
+class BindState
+{
+public:
+    explicit BindState(VkCommandBuffer cmdBuffer)
+        : mCmdBuffer(cmdBuffer)
+    {
+
+    }
+
+    VkCommandBuffer getCommandBuffer() const
+    {
+        return mCmdBuffer;
+    }
+
+    const BindStats &getStats() const
+    {
+        return mStats;
+    }
+
+    void bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+    void bindDescriptorSet(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set, VkDescriptorSet descriptorSet);
+    void bindGeometry(const GeometryPool &geometryPool);
+
+    static const uint32_t MAX_DESCRIPTOR_SETS = 3;
+
+private:
+    VkCommandBuffer     mCmdBuffer;
+    VkPipeline          mPipeline{ VK_NULL_HANDLE };
+    VkPipelineLayout    mLayout{ VK_NULL_HANDLE };
+    VkDescriptorSet     mDescriptorSets[MAX_DESCRIPTOR_SETS]{};
+    const GeometryPool* mGeometryPool{ nullptr };
+    BindStats           mStats;
+};
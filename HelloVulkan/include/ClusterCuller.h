@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include "DescriptorAllocator.h"
+#include "InstanceCuller.h"
+#include "VKFuncs.h"
+
+// Culls the meshlets of large meshes one by one on the GPU, for the few instances of a
+// model the instance cull hands over to it. A workgroup per meshlet and instance tests its
+// bounding sphere against the frustum, its normal cone against the camera and, in the late
+// phase, the sphere against the depth pyramid. The indices of the meshlets kept are copied
+// into a range of the geometry pool index buffer reserved for the instance, counted in the
+// indexCount of its indirect draw. The draws keep binding the pool once and need no mesh
+// shaders. Runs after the instance cull of the same phase.
+//
+// set 0 is the view uniform block. Set 1, filled by each model:
+//  0 instance transforms
+//  1 visible instance indices of the main pass
+//  2 indirect draw commands, with the count of instances handed over
+//  3 meshlets
+//  4 geometry pool indices, read from the mesh and written to the reserved range
+//  5 depth pyramid
+class ClusterCuller
+{
+public:
+    // instances of a model drawn by their meshlets, matches CLUSTER_SLOTS of cull.comp. The
+    // first visible in a phase take them, the others are drawn whole.
+    static const uint32_t INSTANCE_SLOTS = 2;
+
+    // filled in through the update template, buffers in the order of bindings 0 to 4
+    struct DescriptorData
+    {
+        std::array<VkDescriptorBufferInfo, 5> buffers;
+        VkDescriptorImageInfo depthPyramid;
+    };
+
+    // where a model's meshlets are and where the indices kept go, all in indices of the
+    // geometry pool except the instance slots
+    struct Dispatch
+    {
+        uint32_t meshletCount;
+        // of the first slot in the visible instance indices
+        uint32_t firstVisible;
+        uint32_t slotCount;
+        // of the mesh the meshlet ranges are relative to
+        uint32_t meshFirstIndex;
+        // of the range of the first slot, each slot owns slotIndexCount from there
+        uint32_t outputFirstIndex;
+        uint32_t slotIndexCount;
+    };
+
+    ClusterCuller();
+    ~ClusterCuller();
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const
+    {
+        return mDescriptorSetLayout;
+    }
+
+    const DescriptorAllocator::UpdateTemplate &getUpdateTemplate() const
+    {
+        return *mUpdateTemplate;
+    }
+
+    // dispatches a workgroup per meshlet and slot, the slots the instance cull left empty
+    // return right away
+    void recordDispatch(VkCommandBuffer cmdBuffer, VkDescriptorSet descriptorSet, const Dispatch &dispatch,
+        InstanceCuller::Phase phase) const;
+
+private:
+    struct PushConstants
+    {
+        Dispatch dispatch;
+        uint32_t phase;
+    };
+
+    VkDescriptorSetLayout   mDescriptorSetLayout;
+    const DescriptorAllocator::UpdateTemplate* mUpdateTemplate;
+    VkPipelineLayout        mPLayout;
+    VkPipeline              mPipeline;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <deque>
+#include <vector>
+#include "BindState.h"
+#include "RenderQueue.h"
+#include "VKFuncs.h"
+
+class Model;
+class JobSystem;
+
+// Records model draws into secondary command buffers on all worker threads and keeps
+// them across frames. Every frame the draws of both passes go through a render queue
+// sorted by state, leaving out models culled from a pass. The sorted draws of a pass are
+// split into fixed size chunks with one secondary each, and a chunk is only recorded again
+// once one of its models changed, was added or removed, or became visible or culled.
+// Within a secondary binds that repeat the bound state are skipped.
+// Every thread owns a command pool, replaced secondaries go back to the pool of the thread
+// that recorded them once the GPU is done with them.
+class CommandRecorder
+{
+public:
+    struct Stats
+    {
+        uint32_t packetCount{ 0 };
+        float sortMilliseconds{ 0.f };
+        // of all cached secondaries, so what a frame executes
+        BindStats binds;
+    };
+
+    CommandRecorder(VkDevice device, uint32_t queueFamilyIndex, JobSystem &jobSystem);
+    ~CommandRecorder();
+
+    // returns the secondaries of the shadow and main pass, in draw order, and true when any
+    // of them differs from the last call. retireValue is the graphics tracker value after
+    // which the secondaries handed out so far are no longer used, completedValue the value
+    // the GPU has reached. The secondaries work with any framebuffer of the render passes.
+    bool recordModels(const std::vector<Model*> &models, VkRenderPass shadowRenderPass, VkRenderPass renderPass,
+        uint64_t retireValue, uint64_t completedValue,
+        std::vector<VkCommandBuffer> &shadowCmdBuffers, std::vector<VkCommandBuffer> &cmdBuffers);
+
+    const Stats &getStats() const
+    {
+        return mStats;
+    }
+
+    static const uint32_t MODELS_PER_CHUNK;
+
+private:
+    struct RetiredCmdBuffer
+    {
+        VkCommandBuffer cmdBuffer;
+        uint64_t value;
+    };
+
+    struct ThreadContext
+    {
+        VkCommandPool commandPool;
+        std::deque<RetiredCmdBuffer> retired;
+    };
+
+    struct Chunk
+    {
+        std::vector<Model*> models;
+        std::vector<uint64_t> versions;
+        VkCommandBuffer cmdBuffer;
+        uint32_t threadIndex;
+        BindStats binds;
+    };
+
+    struct DirtyChunk
+    {
+        RenderQueue::Pass pass;
+        uint32_t chunkIndex;
+    };
+
+    VkCommandBuffer beginSecondary(ThreadContext &context, uint64_t completedValue, VkRenderPass renderPass);
+    void retireChunk(Chunk &chunk, uint64_t retireValue);
+
+    VkDevice        mDevice;
+    JobSystem&      mJobSystem;
+
+    std::vector<ThreadContext>  mContexts;
+    RenderQueue                 mRenderQueue;
+    std::array<std::vector<Chunk>, RenderQueue::PASS_COUNT> mChunks;
+    Stats                       mStats;
+};
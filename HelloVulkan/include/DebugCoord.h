@@ -1,4 +1,5 @@
 #pragma once
+#include "FramePacket.h"
 #include "VKFuncs.h"
 #include "mathfu/glsl_mappings.h"
 
@@ -14,7 +15,8 @@ public:
     ~DebugCoord();
 
     void executeCommandBuffer(VkCommandBuffer primaryCmdBuffer, uint32_t nextIndex);
-    void update();
+    void update(const FramePacket &packet, uint32_t frameIndex);
+    void recordUniformCopies(VkCommandBuffer cmdBuffer, uint32_t frameIndex) const;
 
 private:
     VkDescriptorPool mDescriptorPool;
@@ -24,6 +26,7 @@ private:
     VkBuffer mUniformStagingBuffer;
     VkDeviceMemory mUniformBufferMemory;
     VkDeviceMemory mUniformStagingBufferMemory;
+    uint8_t* mUniformStagingData;
     VkPipelineCache mPCache;
     VkPipeline mPipeline;
     VkPipelineLayout mPLayout;
@@ -0,0 +1,55 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "VKFuncs.h"
+
+// Defers vkDestroy*/vkFree* calls until the GPU has passed the graphics tracker value
+// of the last submission that used the handle. Separate names per handle type since
+// non-dispatchable handles are plain integers on 32-bit targets. Pushing is thread
+// safe, collect and flush run on the render thread.
+class DeletionQueue
+{
+public:
+    explicit DeletionQueue(VkDevice device);
+    ~DeletionQueue();
+
+    void pushBuffer(uint64_t value, VkBuffer buffer);
+    void pushImage(uint64_t value, VkImage image);
+    void pushImageView(uint64_t value, VkImageView imageView);
+    void pushSampler(uint64_t value, VkSampler sampler);
+    void pushSemaphore(uint64_t value, VkSemaphore semaphore);
+    void pushMemory(uint64_t value, VkDeviceMemory memory);
+    void pushPipeline(uint64_t value, VkPipeline pipeline);
+    void pushPipelineLayout(uint64_t value, VkPipelineLayout pipelineLayout);
+    void pushPipelineCache(uint64_t value, VkPipelineCache pipelineCache);
+    void pushDescriptorSetLayout(uint64_t value, VkDescriptorSetLayout descriptorSetLayout);
+    void pushDescriptorPool(uint64_t value, VkDescriptorPool descriptorPool);
+    void pushCommandBuffers(uint64_t value, VkCommandPool commandPool, const std::vector<VkCommandBuffer> &commandBuffers);
+
+    // destroys everything whose value the GPU has reached
+    void collect(uint64_t completedValue);
+
+    // destroys everything, the caller has made sure the device is idle
+    void flush();
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mEntries.size();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t value;
+        std::function<void()> destroy;
+    };
+
+    void push(uint64_t value, std::function<void()> &&destroy);
+
+    VkDevice            mDevice;
+    std::mutex          mMutex;
+    std::deque<Entry>   mEntries;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include "VKFuncs.h"
+
+// Mip chain of the farthest depth of the main depth buffer, for occlusion tests of bounding
+// volumes. Level 0 is the largest power of two not above the depth buffer, every texel holds
+// the farthest depth of the area it covers, so a volume nearer than that can't be hidden.
+// The pyramid stays in the general layout, the cull pass reads it through getImageView().
+// Without a depth view it is a single texel the cull passes bind but never read, on devices
+// culling occlusion on the CPU.
+class DepthPyramid
+{
+public:
+    static const uint32_t GROUP_SIZE;
+
+    // depthView has to stay valid for the lifetime of the pyramid, VK_NULL_HANDLE for the
+    // placeholder that is never built
+    DepthPyramid(VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight);
+    ~DepthPyramid();
+
+    VkImageView getImageView() const
+    {
+        return mImageView;
+    }
+
+    VkSampler getSampler() const
+    {
+        return mSampler;
+    }
+
+    // reduces the depth buffer, readable by compute shaders at this point, into all levels
+    // and makes them visible to compute shaders
+    void recordBuild(VkCommandBuffer cmdBuffer) const;
+
+private:
+    uint32_t                        mWidth;
+    uint32_t                        mHeight;
+    uint32_t                        mLevelCount;
+    VkImage                         mImage;
+    VkDeviceMemory                  mImageMemory;
+    VkImageView                     mImageView;
+    std::vector<VkImageView>        mLevelViews;
+    VkSampler                       mSampler;
+    VkDescriptorSetLayout           mDescriptorSetLayout{ VK_NULL_HANDLE };
+    VkDescriptorPool                mDescriptorPool{ VK_NULL_HANDLE };
+    // one per level, reading the level above or the depth buffer
+    std::vector<VkDescriptorSet>    mDescriptorSets;
+    VkPipelineLayout                mPLayout{ VK_NULL_HANDLE };
+    VkPipeline                      mPipeline{ VK_NULL_HANDLE };
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "VKFuncs.h"
+
+// Hands out descriptor sets from pools shared by everyone, a pool is added whenever the
+// existing ones run out. Long lived sets go back to their pool once the GPU is done with
+// them, transient sets live until their frame slot comes round again and are dropped with
+// one reset of the slot's pools. Layouts are cached by their bindings, so equal layouts
+// are the same handle. Allocation and freeing are thread safe.
+class DescriptorAllocator
+{
+public:
+    struct Allocation
+    {
+        VkDescriptorSet set{ VK_NULL_HANDLE };
+        VkDescriptorPool pool{ VK_NULL_HANDLE };
+    };
+
+    // the writes of a layout described once and applied from a struct holding the buffer
+    // and image infos at the offsets of the entries. Goes through a descriptor update
+    // template when the device has VK_KHR_descriptor_update_template.
+    struct UpdateTemplate
+    {
+        VkDescriptorUpdateTemplateKHR handle{ VK_NULL_HANDLE };
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+    };
+
+    DescriptorAllocator(VkDevice device, uint32_t framesInFlight, bool useUpdateTemplates);
+    ~DescriptorAllocator();
+
+    // owned by the allocator, bindings without immutable samplers only
+    VkDescriptorSetLayout getLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount);
+
+    Allocation allocate(VkDescriptorSetLayout layout);
+    // the set returns to its pool once the GPU has passed value
+    void free(const Allocation &allocation, uint64_t value);
+    void collect(uint64_t completedValue);
+
+    // valid until resetTransient() of the frame slot
+    VkDescriptorSet allocateTransient(VkDescriptorSetLayout layout, uint32_t frameIndex);
+    // the frame that last used the slot has retired
+    void resetTransient(uint32_t frameIndex);
+
+    // owned by the allocator
+    const UpdateTemplate* createUpdateTemplate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorUpdateTemplateEntryKHR> &entries);
+    void update(VkDescriptorSet set, const UpdateTemplate &updateTemplate, const void* data);
+
+private:
+    // sets per pool and descriptors of each type per set, a pool holds the types of every layout
+    static const uint32_t POOL_SET_COUNT;
+    static const std::vector<VkDescriptorPoolSize> POOL_SIZES_PER_SET;
+
+    struct CachedLayout
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        VkDescriptorSetLayout layout;
+    };
+
+    struct PendingFree
+    {
+        uint64_t value;
+        Allocation allocation;
+    };
+
+    struct TransientPools
+    {
+        std::vector<VkDescriptorPool> pools;
+        // the pool sets are taken from, those before it are full
+        uint32_t current{ 0 };
+    };
+
+    VkDescriptorPool createPool(VkDescriptorPoolCreateFlags flags);
+
+    VkDevice            mDevice;
+    std::mutex          mMutex;
+
+    std::unordered_map<uint64_t, std::vector<CachedLayout>> mLayouts;
+
+    std::vector<VkDescriptorPool> mPools;
+    std::vector<PendingFree> mPendingFrees;
+    std::vector<TransientPools> mTransientPools;
+
+    std::deque<UpdateTemplate> mUpdateTemplates;
+    PFN_vkCreateDescriptorUpdateTemplateKHR mCreateDescriptorUpdateTemplate{ nullptr };
+    PFN_vkDestroyDescriptorUpdateTemplateKHR mDestroyDescriptorUpdateTemplate{ nullptr };
+    PFN_vkUpdateDescriptorSetWithTemplateKHR mUpdateDescriptorSetWithTemplate{ nullptr };
+};
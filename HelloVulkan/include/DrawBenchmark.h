@@ -0,0 +1,74 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "VKFuncs.h"
+
+// Compares the ways a draw can receive its transforms, a model matrix and a shadow
+// transform, 128 bytes per draw:
+//  push constants, pushed before every draw, the size the spec guarantees,
+//  a uniform buffer holding all draws, bound with a dynamic offset per draw,
+//  a storage buffer holding all draws, indexed by the first instance of the draw.
+// One triangle is drawn per transform into a small depth target, the CPU time to record
+// and the GPU time to execute are logged for 1k, 10k and 100k draws.
+// The renderer uses the storage buffer path: its command buffers are recorded once and
+// replayed while the transforms change, pushed constants would be frozen at recording.
+class DrawBenchmark
+{
+public:
+    DrawBenchmark();
+    ~DrawBenchmark();
+
+    void run();
+
+private:
+    enum Path
+    {
+        PATH_PUSH_CONSTANTS,
+        PATH_DYNAMIC_UNIFORM,
+        PATH_STORAGE_BUFFER,
+        PATH_COUNT,
+    };
+
+    struct DrawTransforms
+    {
+        std::array<float, 16> model;
+        std::array<float, 16> shadowTransform;
+    };
+
+    static const uint32_t TARGET_SIZE;
+    static const uint32_t MAX_DRAW_COUNT;
+
+    void createPipeline(Path path, const char* shaderName);
+    void uploadTransforms(VkBuffer buffer, VkDeviceSize stride);
+    // returns false when the device has no timestamps, gpuMilliseconds is left alone then
+    bool measure(Path path, uint32_t drawCount, float &recordMilliseconds, float &gpuMilliseconds);
+
+    VkImage             mDepthImage;
+    VkDeviceMemory      mDepthImageMemory;
+    VkImageView         mDepthImageView;
+    VkRenderPass        mRenderPass;
+    VkFramebuffer       mFramebuffer;
+    VkQueryPool         mQueryPool;
+    float               mTimestampPeriod{ 0.f };
+    bool                mHasTimestamps{ false };
+
+    VkBuffer            mVertexBuffer;
+    VkDeviceMemory      mVertexBufferMemory;
+    VkDeviceSize        mUniformStride{ 0 };
+    VkBuffer            mUniformBuffer;
+    VkDeviceMemory      mUniformBufferMemory;
+    VkBuffer            mStorageBuffer;
+    VkDeviceMemory      mStorageBufferMemory;
+
+    VkDescriptorSetLayout mUniformSetLayout;
+    VkDescriptorSetLayout mStorageSetLayout;
+    VkDescriptorPool    mDescriptorPool;
+    VkDescriptorSet     mUniformSet;
+    VkDescriptorSet     mStorageSet;
+
+    std::array<VkPipelineLayout, PATH_COUNT> mPLayouts;
+    std::array<VkPipeline, PATH_COUNT> mPipelines;
+
+    std::vector<DrawTransforms> mTransforms;
+};
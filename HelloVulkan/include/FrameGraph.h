@@ -0,0 +1,155 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include "VKFuncs.h"
+
+// Declarative description of the passes of a frame. Passes declare which images they
+// write as attachments and which they sample, compile() then
+//  - culls passes whose results never reach an imported image, unless they have side effects,
+//  - creates the transient images, aliasing the memory of those whose lifetimes don't overlap,
+//  - creates a render pass and framebuffers per pass, clearing or loading as needed,
+//  - works out the image barriers between the passes, and across frames.
+// Passes have to be added in execution order. The graph is compiled once, render passes,
+// framebuffers and image views stay valid until it is destroyed.
+class FrameGraph
+{
+public:
+    typedef uint32_t Resource;
+    typedef uint32_t Pass;
+    typedef std::function<void(VkCommandBuffer cmdBuffer, uint32_t imageIndex)> ExecuteFunction;
+
+    FrameGraph(VkDevice device, VkPhysicalDevice physicalDevice);
+    ~FrameGraph();
+
+    // image owned by the graph, only valid within a frame
+    Resource createImage(const std::string &name, VkFormat format, uint32_t width, uint32_t height);
+
+    // images owned elsewhere, one per swapchain image when there are several. They enter every
+    // frame in initialLayout, made available by initialStage, and leave it in finalLayout.
+    Resource importImages(const std::string &name, VkFormat format, uint32_t width, uint32_t height,
+        const std::vector<VkImage> &images, const std::vector<VkImageView> &imageViews,
+        VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout);
+
+    // a pass without attachments runs outside of any render pass
+    Pass addPass(const std::string &name, VkSubpassContents contents, const ExecuteFunction &execute);
+    void addColorOutput(Pass pass, Resource resource, VkClearColorValue clearValue);
+    void setDepthOutput(Pass pass, Resource resource, VkClearDepthStencilValue clearValue);
+    void addSampledInput(Pass pass, Resource resource, VkPipelineStageFlags stageMask);
+    // the pass writes something outside of the graph, buffers for instance, and is never culled
+    void setSideEffects(Pass pass);
+
+    void compile();
+    void execute(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+    // records the passes from firstPass up to endPass, frames split over several submissions
+    // of the same queue call it for consecutive ranges in order
+    void execute(VkCommandBuffer cmdBuffer, uint32_t imageIndex, Pass firstPass, Pass endPass);
+
+    Pass getPassCount() const
+    {
+        return static_cast<Pass>(mPasses.size());
+    }
+
+    VkRenderPass getRenderPass(Pass pass) const;
+    VkFramebuffer getFramebuffer(Pass pass, uint32_t imageIndex) const;
+    VkImageView getImageView(Resource resource) const;
+    bool isCulled(Pass pass) const;
+
+private:
+    enum Usage
+    {
+        USAGE_COLOR_ATTACHMENT,
+        USAGE_DEPTH_ATTACHMENT,
+        USAGE_SAMPLED,
+    };
+
+    struct Access
+    {
+        Resource resource;
+        Usage usage;
+        VkPipelineStageFlags stageMask;
+        VkClearValue clearValue;
+    };
+
+    struct ImageResource
+    {
+        std::string name;
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        bool imported;
+        VkImageLayout initialLayout;
+        VkPipelineStageFlags initialStage;
+        VkImageLayout finalLayout;
+
+        std::vector<VkImage> images;
+        std::vector<VkImageView> imageViews;
+
+        // filled in by compile()
+        VkImageUsageFlags usage;
+        Pass firstPass;
+        Pass lastPass;
+        uint32_t memoryBlock;
+    };
+
+    struct Barrier
+    {
+        VkPipelineStageFlags srcStageMask{ 0 };
+        VkPipelineStageFlags dstStageMask{ 0 };
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        std::vector<Resource> resources;
+    };
+
+    struct PassNode
+    {
+        std::string name;
+        VkSubpassContents contents;
+        ExecuteFunction execute;
+        std::vector<Access> accesses;
+        bool sideEffects{ false };
+        bool culled{ true };
+
+        VkRenderPass renderPass{ VK_NULL_HANDLE };
+        std::vector<VkFramebuffer> framebuffers;
+        std::vector<VkClearValue> clearValues;
+        VkExtent2D extent{ 0, 0 };
+        Barrier barrier;
+    };
+
+    struct MemoryBlock
+    {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint32_t memoryTypeBits;
+        std::vector<Resource> resources;
+    };
+
+    struct State
+    {
+        VkImageLayout layout;
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags writeAccess;
+        VkPipelineStageFlags readStages;
+        VkPipelineStageFlags visibleStages;
+    };
+
+    static VkImageLayout getLayout(Usage usage);
+    static VkAccessFlags getAccessMask(Usage usage);
+    static VkImageAspectFlags getAspectMask(VkFormat format);
+
+    void cullPasses();
+    void allocateImages();
+    void createRenderPasses();
+    void computeBarriers();
+    void addBarrier(Barrier &barrier, Resource resource, State &state, VkImageLayout layout, VkPipelineStageFlags stageMask, VkAccessFlags accessMask, bool isWrite);
+    void recordBarrier(VkCommandBuffer cmdBuffer, const Barrier &barrier, uint32_t imageIndex);
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+    VkDevice                    mDevice;
+    VkPhysicalDevice            mPhysicalDevice;
+    std::vector<ImageResource>  mResources;
+    std::vector<PassNode>       mPasses;
+    std::vector<MemoryBlock>    mMemoryBlocks;
+    Barrier                     mFinalBarrier;
+    bool                        mCompiled{ false };
+};
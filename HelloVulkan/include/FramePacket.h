@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+#include "mathfu/utilities.h"
+
+// Snapshot of the scene the simulation hands to the renderer. Everything the renderer
+// needs from the main thread for one frame goes through here.
+struct FramePacket
+{
+    struct ModelInstance
+    {
+        uint32_t id;
+        mathfu::mat4 transform;
+    };
+
+    uint64_t frameNumber{ 0 };
+
+    mathfu::mat4 view;
+    mathfu::mat4 proj;
+    mathfu::mat4 lightView;
+    mathfu::mat4 lightProj;
+
+    std::vector<ModelInstance, mathfu::simd_allocator<ModelInstance>> models;
+};
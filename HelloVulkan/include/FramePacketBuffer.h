@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "FramePacket.h"
+
+// Triple buffered handoff of frame packets from the simulation to the renderer. Both
+// sides own one packet, the third one is swapped in and out with a single atomic
+// exchange. The consumer always picks up the newest packet. The producer blocks only
+// when it would get more than maxLatency frames ahead of the consumer.
+class FramePacketBuffer
+{
+public:
+    explicit FramePacketBuffer(uint32_t maxLatency);
+
+    // producer side
+    FramePacket &getWritePacket()
+    {
+        return mPackets[mWriteIndex];
+    }
+
+    void publish();
+
+    // consumer side, returns false once the buffer was closed. Without wait it
+    // also returns false when nothing new has been published.
+    bool acquire(bool wait);
+
+    const FramePacket &getReadPacket() const
+    {
+        return mPackets[mReadIndex];
+    }
+
+    // wakes up both sides for shutdown
+    void close();
+
+private:
+    void notify();
+
+    static const uint32_t FRESH_BIT = 0x4;
+    static const uint32_t INDEX_MASK = 0x3;
+
+    std::array<FramePacket, 3>  mPackets;
+    uint32_t                    mWriteIndex{ 0 };
+    uint32_t                    mReadIndex{ 1 };
+    std::atomic<uint32_t>       mMiddle{ 2 };
+
+    uint32_t                    mMaxLatency;
+    uint64_t                    mPublished{ 0 };
+    std::atomic<uint64_t>       mConsumed{ 0 };
+
+    // only used to sleep, the handoff itself never takes the lock
+    std::atomic<uint32_t>       mWaiters{ 0 };
+    std::atomic<bool>           mClosed{ false };
+    std::mutex                  mWaitMutex;
+    std::condition_variable     mWaitCondition;
+};
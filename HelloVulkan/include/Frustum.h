@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+
+// World space axis aligned boxes as a structure of arrays, so the plane tests load the
+// same component of several boxes with one instruction.
+class BoundingBoxes
+{
+public:
+    void resize(uint32_t count);
+
+    // the mesh space box, center followed by the half extents, moved by transform
+    void set(uint32_t index, const mathfu::mat4 &transform, const std::array<float, 6> &box);
+
+    uint32_t getCount() const
+    {
+        return static_cast<uint32_t>(mCenterX.size());
+    }
+
+    const float* getCenterX() const { return mCenterX.data(); }
+    const float* getCenterY() const { return mCenterY.data(); }
+    const float* getCenterZ() const { return mCenterZ.data(); }
+    const float* getExtentX() const { return mExtentX.data(); }
+    const float* getExtentY() const { return mExtentY.data(); }
+    const float* getExtentZ() const { return mExtentZ.data(); }
+
+private:
+    std::vector<float> mCenterX;
+    std::vector<float> mCenterY;
+    std::vector<float> mCenterZ;
+    std::vector<float> mExtentX;
+    std::vector<float> mExtentY;
+    std::vector<float> mExtentZ;
+};
+
+// Clip volume of a view projection as six world space planes. Boxes are tested 8 at a
+// time with AVX when the CPU has it, 4 at a time with SSE or NEON, and one at a time otherwise.
+class Frustum
+{
+public:
+    // normalized so the distance test also works for spheres. Uses the -w..w depth range,
+    // which is conservative for 0..w projections.
+    explicit Frustum(const mathfu::mat4 &viewProj);
+
+    mathfu::vec4 getPlane(uint32_t index) const
+    {
+        return mathfu::vec4(mPlanes[index][0], mPlanes[index][1], mPlanes[index][2], mPlanes[index][3]);
+    }
+
+    // number of boxes inside or intersecting the frustum, visibleFlags receives 1 for each of
+    // them and 0 for the others when given
+    uint32_t countVisible(const BoundingBoxes &boxes, uint8_t* visibleFlags = nullptr) const;
+
+    static const uint32_t PLANE_COUNT = 6;
+
+private:
+#if defined(HV_CULL_AVX)
+    // the first count boxes 8 at a time, count a multiple of 8. Only call when the CPU has AVX.
+    uint32_t countVisibleAVX(const BoundingBoxes &boxes, uint8_t* visibleFlags, uint32_t count) const;
+#endif
+
+    float mPlanes[PLANE_COUNT][4];
+};
+
+// visible models and instances of the shadow and main pass, for the last frame drawn
+struct CullStats
+{
+    uint32_t modelCount{ 0 };
+    uint32_t instanceCount{ 0 };
+    uint32_t visibleShadowModels{ 0 };
+    uint32_t visibleShadowInstances{ 0 };
+    uint32_t visibleModels{ 0 };
+    uint32_t visibleInstances{ 0 };
+    // main pass instances the occlusion rasterizer hid from the cull pass, still counted as
+    // visible above, and the models it hid all visible instances of
+    uint32_t occludedModels{ 0 };
+    uint32_t occludedInstances{ 0 };
+    uint32_t occluderTriangles{ 0 };
+    float rasterizeMilliseconds{ 0.f };
+    float testMilliseconds{ 0.f };
+};
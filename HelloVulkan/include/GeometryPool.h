@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "VKFuncs.h"
+
+// One device-local vertex buffer and one index buffer shared by all meshes. Meshes get a
+// range of each, addressed by vertexOffset and firstIndex, so every draw uses the same two
+// buffers and they only need binding once per command buffer. Freed ranges merge with
+// their free neighbours, when the gaps left between live ranges are still too small the
+// render thread compacts the pool. Allocating is thread safe, the loader thread allocates
+// while the render thread frees.
+class GeometryPool
+{
+public:
+    struct Allocation
+    {
+        uint32_t vertexOffset;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    GeometryPool(uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity);
+    ~GeometryPool();
+
+    // uploads the mesh into free ranges, returns false when the pool is full. The upload
+    // value is the graphics tracker value at which the data is usable. The allocation stays
+    // at its address until it is freed, compaction moves its ranges and updates it in place.
+    bool allocate(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+        Allocation &allocation, uint64_t &uploadValue);
+
+    // an index range the GPU fills itself, nothing is uploaded. The allocation has no
+    // vertices and frees like any other.
+    bool reserveIndices(uint32_t indexCount, Allocation &allocation);
+
+    // the ranges return to the pool once the GPU has passed value
+    void free(const Allocation &allocation, uint64_t value);
+
+    // reclaims the ranges freed by submissions that have completed, returns whether there
+    // were any. Render thread only.
+    bool collect(uint64_t completedValue);
+
+    // moves the live ranges whose uploads have completed down over the free space between
+    // them, copying on the graphics queue and waiting for it. Ranges still uploading or
+    // waiting to be freed stay. Returns whether anything moved, draws recorded with the old
+    // offsets must be recorded again. Render thread only.
+    bool compact(uint64_t completedValue);
+
+    void bind(VkCommandBuffer cmdBuffer) const;
+
+    // also a storage buffer, for compute passes reading and writing indices
+    VkBuffer getIndexBuffer() const
+    {
+        return mIndexBuffer;
+    }
+
+private:
+    struct Range
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    // free ranges sorted by offset, first fit
+    class FreeList
+    {
+    public:
+        explicit FreeList(uint32_t capacity);
+
+        bool allocate(uint32_t count, uint32_t &offset);
+        void free(uint32_t offset, uint32_t count);
+        uint32_t getFreeCount() const;
+
+        // the free ranges become the gaps between the used ones, sorted by offset
+        void rebuild(const std::vector<Range> &usedRanges);
+
+    private:
+        uint32_t           mCapacity;
+        std::vector<Range> mRanges;
+    };
+
+    // a range compaction may move, offset points into the allocation
+    struct Block
+    {
+        uint32_t* offset;
+        uint32_t count;
+        bool movable;
+        // GPU written indices are rewritten every frame and only need the new offset
+        bool copy;
+    };
+
+    struct Move
+    {
+        uint32_t* offset;
+        uint32_t count;
+        uint32_t from;
+        uint32_t to;
+        bool copy;
+    };
+
+    // packs the movable blocks down to the lowest free offsets, the others stay
+    static void planMoves(std::vector<Block> &blocks, std::vector<Move> &moves, std::vector<Range> &usedRanges);
+
+    struct PendingFree
+    {
+        uint64_t value;
+        Allocation allocation;
+    };
+
+    uint32_t                    mVertexStride;
+    VkBuffer                    mVertexBuffer;
+    VkDeviceMemory              mVertexBufferMemory;
+    VkBuffer                    mIndexBuffer;
+    VkDeviceMemory              mIndexBufferMemory;
+
+    std::mutex                  mMutex;
+    FreeList                    mVertexRanges;
+    FreeList                    mIndexRanges;
+    std::vector<PendingFree>    mPendingFrees;
+    // live allocations and the tracker value of their upload, pinned while it isn't submitted
+    std::unordered_map<Allocation*, uint64_t> mLiveAllocations;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include "DescriptorAllocator.h"
+#include "VKFuncs.h"
+
+// Frustum and occlusion culls the instances of a model on the GPU. One invocation per
+// instance tests its bounding sphere and appends the visible instance indices to the lists
+// the main and shadow draws read, counting them in the instanceCount of the two indirect
+// draw commands. The main pass is drawn twice, culled in two phases:
+//  early, before the passes, keeps the instances visible at the end of the last frame and
+//   also fills the shadow draw,
+//  late, after the first main pass, tests all instances against the depth pyramid built
+//   from it, keeps those that turned visible and records who is visible for the next frame.
+// Devices culling occlusion on the CPU draw the main pass once, culled in a single phase
+// that keeps every instance in the frustum the CPU occluders don't hide.
+//
+// set 0 is the view uniform block with the frustum planes of both passes. Set 1, filled by
+// each model:
+//  0 uniform block with the instance count
+//  1 instances the CPU occlusion cull hid this frame, left out of the main pass
+//  2 instance transforms
+//  3 visible instance indices of the main pass
+//  4 visible instance indices of the shadow pass
+//  5 indirect draw commands, main pass first, then those of the cluster slots
+//  6 visibility of every instance at the end of the last frame
+//  7 depth pyramid
+class InstanceCuller
+{
+public:
+    // matches the constants of cull.comp
+    enum Phase
+    {
+        PHASE_EARLY,
+        PHASE_LATE,
+        PHASE_SINGLE,
+    };
+
+    // filled in through the update template, buffers in the order of bindings 0 to 6
+    struct DescriptorData
+    {
+        std::array<VkDescriptorBufferInfo, 7> buffers;
+        VkDescriptorImageInfo depthPyramid;
+    };
+
+    static const uint32_t GROUP_SIZE;
+
+    InstanceCuller();
+    ~InstanceCuller();
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const
+    {
+        return mDescriptorSetLayout;
+    }
+
+    const DescriptorAllocator::UpdateTemplate &getUpdateTemplate() const
+    {
+        return *mUpdateTemplate;
+    }
+
+    // dispatches enough invocations for maxInstanceCount, the count in the model's
+    // uniform block decides how many of them do work
+    void recordDispatch(VkCommandBuffer cmdBuffer, VkDescriptorSet descriptorSet,
+        const std::array<float, 4> &boundingSphere, uint32_t maxInstanceCount, Phase phase) const;
+
+private:
+    struct PushConstants
+    {
+        std::array<float, 4> boundingSphere;
+        uint32_t phase;
+    };
+
+    VkDescriptorSetLayout   mDescriptorSetLayout;
+    const DescriptorAllocator::UpdateTemplate* mUpdateTemplate;
+    VkPipelineLayout        mPLayout;
+    VkPipeline              mPipeline;
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobDeque;
+struct Job;
+
+// Counts the unfinished jobs of a batch. Jobs started with it signal it when they
+// finish, wait() on it to join the batch or hand it to run() as a dependency.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const
+    {
+        return mPending.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t>   mPending{ 0 };
+    std::mutex              mMutex;
+    std::vector<Job*>       mDependents;
+};
+
+// Work-stealing job system. Every worker owns a lock-free deque, pushes and pops its
+// own jobs at the bottom and steals from the top of the others when it runs dry.
+// The thread that creates the job system takes part as worker 0 whenever it waits,
+// the slot can be handed to another thread with detach/attachCurrentThread().
+// Other threads may start jobs too, those go through a shared queue, but they only
+// block in wait() instead of helping.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Function;
+    typedef std::function<void(uint32_t begin, uint32_t end)> RangeFunction;
+
+    // threadCount includes the creating thread, 0 picks one per hardware thread. There
+    // is always at least one worker thread so jobs started elsewhere make progress.
+    JobSystem(uint32_t threadCount = 0, bool pinThreads = false);
+    ~JobSystem();
+
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(mDeques.size());
+    }
+
+    // worker index of the calling thread, jobs always run with a valid one
+    static uint32_t getThreadIndex();
+    static const uint32_t INVALID_THREAD_INDEX;
+
+    // worker 0 moves to another thread, the current one detaches before the new one attaches
+    void attachCurrentThread();
+    void detachCurrentThread();
+
+    // counter is signaled once the job finished, it is held back until
+    // dependency is done when one is given
+    void run(const Function &function, JobCounter *counter = nullptr, JobCounter *dependency = nullptr);
+
+    // returns once counter reached zero, workers execute other jobs meanwhile
+    void wait(JobCounter &counter);
+
+    // calls function on batches of at most batchSize indices out of [0, count) and waits for them
+    void parallelFor(uint32_t count, uint32_t batchSize, const RangeFunction &function);
+
+#ifdef HV_JOBSYSTEM_BENCHMARK
+    // logs the scheduling overhead of empty jobs and of parallelFor
+    void benchmark();
+#endif
+
+private:
+    void workerMain(uint32_t threadIndex, bool pinThread);
+    void schedule(Job *job);
+    Job* findJob(uint32_t threadIndex);
+    void execute(Job *job);
+    void pinCurrentThread(uint32_t threadIndex);
+
+    std::vector<JobDeque*>      mDeques;
+    std::vector<std::thread>    mWorkers;
+
+    // jobs started from threads that are not workers
+    std::mutex                  mSharedMutex;
+    std::deque<Job*>            mSharedJobs;
+
+    // idle workers sleep until something is queued
+    std::atomic<uint32_t>       mQueuedJobs{ 0 };
+    std::atomic<uint32_t>       mSleepingWorkers{ 0 };
+    std::mutex                  mSleepMutex;
+    std::condition_variable     mWakeCondition;
+    std::atomic<bool>           mQuit{ false };
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "VKFuncs.h"
+
+// Bindless textures, one descriptor set holding the textures and samplers of every model
+// in partially bound arrays, a buffer of materials indexing into them and the shadow map.
+// Bound at set 2 by the main pipeline, the draw picks its material with a push constant,
+// so models need no descriptor set of their own for textures. Only created when the device
+// supports VK_EXT_descriptor_indexing, otherwise models bind their texture themselves.
+class MaterialTable
+{
+public:
+    // matches the Material struct of shader.frag
+    struct Material
+    {
+        uint32_t textureIndex;
+        uint32_t samplerIndex;
+        uint32_t padding[2];
+    };
+
+    static const uint32_t MAX_MATERIALS;
+
+    MaterialTable();
+    ~MaterialTable();
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const
+    {
+        return mDescriptorSetLayout;
+    }
+
+    VkDescriptorSet getDescriptorSet() const
+    {
+        return mDescriptorSet;
+    }
+
+    // callable from any thread. The texture and sampler are written into slots no frame in
+    // flight reads, so recorded command buffers stay valid. uploadValue is the graphics
+    // tracker value at which the material can be drawn.
+    uint32_t add(VkImageView textureView, VkSampler sampler, uint64_t &uploadValue);
+    // the slot is handed out again once the GPU has passed value
+    void remove(uint32_t materialId, uint64_t value);
+
+private:
+    struct PendingSlot
+    {
+        uint64_t value;
+        uint32_t materialId;
+    };
+
+    VkDescriptorPool    mDescriptorPool;
+    VkDescriptorSetLayout mDescriptorSetLayout;
+    VkDescriptorSet     mDescriptorSet;
+    VkBuffer            mMaterialBuffer;
+    VkDeviceMemory      mMaterialBufferMemory;
+
+    std::mutex          mMutex;
+    uint32_t            mMaterialCount{ 0 };
+    std::vector<uint32_t> mFreeSlots;
+    std::deque<PendingSlot> mPendingSlots;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds the LOD chain of a mesh at import with quadric error edge collapses. Vertices
+// collapse onto a neighbour, so every level indexes the vertices of the full mesh and only
+// adds indices of its own. The quadrics measure the texture coordinates and normals along
+// with the position. Vertices sharing their position with another one, on UV seams and
+// normal creases, and those on open borders never move, so charts keep their outline.
+class MeshSimplifier
+{
+public:
+    struct Lod
+    {
+        // into the indices of all levels, the full mesh first
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        // how far the surface moved from the full mesh, in mesh units
+        float error;
+    };
+
+    // matches MAX_LODS of cull.comp
+    static const uint32_t MAX_LODS = 4;
+
+    // positions, texture coordinates and normals are 3, 2 and 3 floats at their offsets
+    // into each vertex of stride bytes
+    MeshSimplifier(const uint8_t* vertices, size_t stride, size_t positionOffset, size_t texCoordOffset,
+        size_t normalOffset, uint32_t vertexCount);
+
+    // each level keeps about half the triangles of the one before, the chain ends early once
+    // the mesh stops simplifying. indices holds the full mesh and receives the levels after
+    // it, lods their ranges.
+    void build(std::vector<uint32_t> &indices, std::vector<Lod> &lods);
+
+private:
+    // position, texture coordinates and normal, scaled so the mesh fits a unit cube
+    static const uint32_t ATTRIBUTE_COUNT = 8;
+
+    // squared distance to the planes of the triangles added, weighted by their area
+    template<uint32_t N>
+    struct Quadric
+    {
+        void addTriangle(const float* p0, const float* p1, const float* p2, float area);
+        void add(const Quadric &other);
+        // divide by weight for the mean
+        float evaluate(const float* v) const;
+
+        // upper triangle of the symmetric matrix, row by row
+        float a[N * (N + 1) / 2];
+        float b[N];
+        float c;
+        float weight;
+    };
+
+    struct Collapse
+    {
+        float cost;
+        uint32_t from;
+        uint32_t to;
+    };
+
+    void lockBorders(const std::vector<uint32_t> &indices);
+    // one round of collapses over independent edges, returns how many were made
+    uint32_t collapseEdges(std::vector<uint32_t> &indices, uint32_t targetTriangleCount, float &maxError);
+
+    uint32_t mVertexCount;
+    float mScale;
+    std::vector<float> mAttributes;
+    std::vector<uint8_t> mLocked;
+    std::vector<Quadric<ATTRIBUTE_COUNT>> mQuadrics;
+    // geometric part alone, it decides the error of a level
+    std::vector<Quadric<3>> mPositionQuadrics;
+};
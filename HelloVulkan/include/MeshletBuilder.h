@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits a mesh into meshlets, small clusters of neighbouring triangles the cluster cull
+// pass tests one by one. Each grows from a seed triangle by the neighbours adding the fewest
+// vertices, closest to its center first, so clusters come out compact with tight bounds.
+class MeshletBuilder
+{
+public:
+    // matches the Meshlet struct of clustercull.comp
+    struct Meshlet
+    {
+        // mesh space bounding sphere, center and radius
+        float boundingSphere[4];
+        // axis of the normal cone and the cutoff, the meshlet faces away from viewers whose
+        // direction to it is within the cone. A cutoff of 1 never culls.
+        float cone[4];
+        // into the indices of the mesh
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t padding[2];
+    };
+
+    static const uint32_t MAX_VERTICES = 64;
+    static const uint32_t MAX_TRIANGLES = 124;
+
+    // reorders the triangles so those of a meshlet are contiguous. Positions are 3 floats at
+    // positionOffset into each vertex of stride bytes.
+    static void build(const uint8_t* vertices, size_t stride, size_t positionOffset, uint32_t vertexCount,
+        uint32_t* indices, uint32_t indexCount, std::vector<Meshlet> &meshlets);
+};
@@ -1,12 +1,26 @@
 #pragma once
 #include <array>
 #include <cstdint>
+#include <string>
+#include <unordered_map>
 #include <vector>
+#include "BindState.h"
+#include "ClusterCuller.h"
+#include "DescriptorAllocator.h"
+#include "Frustum.h"
+#include "GeometryPool.h"
+#include "InstanceCuller.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "OcclusionRasterizer.h"
+#include "RenderQueue.h"
 #include "VKFuncs.h"
 #include "ext/mathfu/glsl_mappings.h"
 
 class Model
 {
+    friend class ModelPipeline;
+
     struct Vertex
     {
         mathfu::vec3 pos;
@@ -50,50 +64,195 @@ class Model
     };
 
 public:
-    Model(std::string name, float offsetZ);
+    // the mesh, texture and pipelines are shared by all instances, drawn with one instanced
+    // draw per LOD and pass. The cull pass picks the LOD of each instance.
+    Model(std::string name);
     ~Model();
-    void executeCommandBuffer(VkCommandBuffer primaryCmdBuffer, uint32_t nextIndex);
-    void executeShadowCommandBuffer(VkCommandBuffer primaryCmdBuffer, uint32_t nextIndex);
-    void update();
+
+    const std::string &getName() const
+    {
+        return mName;
+    }
+
+    // instances are identified by the id the renderer gave out when spawning them
+    void addInstance(uint32_t id, const mathfu::mat4 &transform);
+    void removeInstance(uint32_t id);
+    void setInstanceTransform(uint32_t id, const mathfu::mat4 &transform);
+
+    uint32_t getInstanceCount() const
+    {
+        return static_cast<uint32_t>(mInstanceIds.size());
+    }
+
+    // stages the instance count and transforms into the slot of the frame and culls the
+    // instance bounds against the frustum of each pass, models may update in parallel
+    void update(const std::array<Frustum, RenderQueue::PASS_COUNT> &frusta, uint32_t frameIndex);
+
+    // instances whose bounds touched the frustum of the pass at the last update(), a model
+    // without any is left out of the pass
+    uint32_t getVisibleInstanceCount(RenderQueue::Pass pass) const
+    {
+        return mVisibleInstanceCounts[pass];
+    }
+
+    // small meshes double as occluders for the CPU occlusion cull
+    bool isOccluder() const
+    {
+        return !mOccluderIndices.empty();
+    }
+
+    // queues the instances inside the main frustum at the last update() as occluders
+    void addOccluders(OcclusionRasterizer &rasterizer) const;
+
+    // flags the instances hidden behind the rasterized occluders in the staging slot of the
+    // frame, after update(), and returns how many there were. The cull pass leaves them out
+    // of the main pass, the model is still recorded.
+    uint32_t cullOccluded(const OcclusionRasterizer &rasterizer, uint32_t frameIndex);
+    // copies the staging slot of the frame to the uniform and instance buffers and resets
+    // the indirect draws, outside of a render pass
+    void recordUniformCopies(VkCommandBuffer cmdBuffer, uint32_t frameIndex) const;
+    // culls the instances into the indirect draws, the early phase after the copies are
+    // visible, the late phase after resetMainDraw() and once the depth pyramid is built
+    void recordCull(VkCommandBuffer cmdBuffer, InstanceCuller::Phase phase) const;
+    // culls the meshlets of the instances the cull pass of the phase handed over, right
+    // after it. Does nothing for meshes without meshlets.
+    void recordClusterCull(VkCommandBuffer cmdBuffer, InstanceCuller::Phase phase) const;
+    // zeroes the instance count of the main draw between the two main passes
+    void recordMainDrawReset(VkCommandBuffer cmdBuffer) const;
+
+    static uint32_t getVertexStride()
+    {
+        return sizeof(Vertex);
+    }
+
+    // record the indirect draw into a secondary inside the main or shadow render pass,
+    // safe to call from several recording threads at once. The instance count comes from
+    // the cull pass, so adding and removing instances needs no new recording.
+    void recordDraw(BindState &state) const;
+    void recordShadowDraw(BindState &state) const;
+
+    // orders the draws of a pass by the state they bind
+    uint32_t getSortKey(RenderQueue::Pass pass) const;
+
+    // identifies the pipelines, buffers and descriptor sets recordDraw() binds, unique across
+    // all models. Anything changing those after construction has to assign a new version
+    // so recorded draws are recorded again.
+    uint64_t getRecordVersion() const
+    {
+        return mRecordVersion;
+    }
+
+    // the geometry pool moved the ranges the draws and the cluster cull dispatch address
+    void onGeometryMoved();
+
+    // uploads the mesh into the geometry pool, false while the pool has no range large
+    // enough. The render thread retries once it compacted the pool.
+    bool allocateGeometry();
+
+    bool hasGeometry() const
+    {
+        return mHasGeometry;
+    }
+
+    // graphics tracker value at which the vertex, index and texture uploads are complete
+    uint64_t getUploadValue() const
+    {
+        return mUploadValue;
+    }
+
+    // graphics tracker value of the last submission that read this model
+    void setLastUsedValue(uint64_t value)
+    {
+        mLastUsedValue = value;
+    }
+
+    uint64_t getLastUsedValue() const
+    {
+        return mLastUsedValue;
+    }
 
 private:
-    std::vector<VkCommandBuffer>    mCmdBuffer;
-    std::vector<VkCommandBuffer>    mShadowCmdBuffer;
-    VkBuffer            mVertexBuffer;
-    VkDeviceMemory      mVertexBufferMemory;
-    VkBuffer            mIndexBuffer;
-    VkDeviceMemory      mIndexBufferMemory;
+    static const uint32_t INITIAL_INSTANCE_CAPACITY;
+    // meshes up to this many triangles are occluders
+    static const uint32_t OCCLUDER_TRIANGLE_LIMIT;
+    // meshes from this many triangles are split into meshlets
+    static const uint32_t MESHLET_TRIANGLE_THRESHOLD;
+
+    uint32_t getStagingSlotSize() const;
+    void createInstanceResources(uint32_t capacity);
+    void releaseInstanceResources();
+
+    std::string         mName;
+    // the indices of all LODs, each addressed by its range
+    GeometryPool::Allocation mGeometry;
+    bool                mHasGeometry{ false };
+    std::vector<MeshSimplifier::Lod> mLods;
+    // LODs drawn, only the full mesh when the device can't offset the draws into the
+    // visible instances
+    uint32_t            mLodCount{ 1 };
+    // of the full mesh, their ranges are relative to its first index
+    std::vector<MeshletBuilder::Meshlet> mMeshlets;
+    // instances drawn by their meshlets, none without meshlets or when the device can't
+    // offset the draws into the visible instances
+    uint32_t            mClusterSlotCount{ 0 };
+    VkBuffer            mMeshletBuffer;
+    VkDeviceMemory      mMeshletBufferMemory;
+    // a full mesh of indices per slot, written by the cluster cull pass
+    GeometryPool::Allocation mClusterIndices;
+    // the uniform block followed by the instance transforms per frame in flight,
+    // persistently mapped
     VkBuffer            mUniformStagingBuffer;
     VkDeviceMemory      mUniformStagingBufferMemory;
+    uint8_t*            mUniformStagingData;
     VkBuffer            mUniformBuffer;
     VkDeviceMemory      mUniformBufferMemory;
-    VkBuffer            mShadowUniformStagingBuffer;
-    VkDeviceMemory      mShadowUniformStagingBufferMemory;
-    VkBuffer            mShadowUniformBuffer;
-    VkDeviceMemory      mShadowUniformBufferMemory;
-    VkDescriptorPool    mDescriptorPool;
-    VkDescriptorSet     mDescriptorSet;
-    VkDescriptorPool    mShadowDescriptorPool;
-    VkDescriptorSet     mShadowDescriptorSet;
-    VkImage             mStagingImage;
-    VkDeviceMemory      mStagingImageMemory;
+    VkBuffer            mInstanceBuffer;
+    VkDeviceMemory      mInstanceBufferMemory;
+    // a range of capacity indices per LOD, then one per cluster slot
+    VkBuffer            mVisibleBuffer;
+    VkDeviceMemory      mVisibleBufferMemory;
+    VkBuffer            mShadowVisibleBuffer;
+    VkDeviceMemory      mShadowVisibleBufferMemory;
+    VkBuffer            mIndirectBuffer;
+    VkDeviceMemory      mIndirectBufferMemory;
+    VkBuffer            mHistoryBuffer;
+    VkDeviceMemory      mHistoryBufferMemory;
+    // a flag per instance from the CPU occlusion cull, staged after the transforms
+    VkBuffer            mOccludedBuffer;
+    VkDeviceMemory      mOccludedBufferMemory;
+    uint32_t            mInstanceCapacity{ 0 };
+    DescriptorAllocator::Allocation mDescriptorSet;
+    DescriptorAllocator::Allocation mShadowDescriptorSet;
+    DescriptorAllocator::Allocation mCullDescriptorSet;
+    DescriptorAllocator::Allocation mClusterCullDescriptorSet;
     VkImage             mTextureImage;
     VkDeviceMemory      mTextureImageMemory;
     VkImageView         mTextureImageView;
     VkSampler           mTextureSampler;
-    uint32_t            mCmdBufferLen;
-    VkDescriptorSetLayout mDescriptorSetLayout;
-    VkDescriptorSetLayout mShadowDescriptorSetLayout;
-
-    VkPipelineLayout    mPLayout;
-    VkPipelineCache     mPCache;
-    VkPipeline          mPipeline;
-
-    VkPipelineLayout    mShadowPLayout;
-    VkPipelineCache     mShadowPCache;
-    VkPipeline          mShadowPipeline;
 
-    float mOffsetZ{ 0.f };
+    std::vector<uint32_t> mInstanceIds;
+    std::vector<mathfu::mat4, mathfu::simd_allocator<mathfu::mat4>> mInstanceTransforms;
+    // instance id to its index in the arrays above
+    std::unordered_map<uint32_t, uint32_t> mInstanceIndices;
+    // mesh space center and radius
+    std::array<float, 4> mBoundingSphere;
+    // mesh space center and half extents
+    std::array<float, 6> mBoundingBox;
+    // of the instances, in the order of the arrays above
+    BoundingBoxes mInstanceBounds;
+    std::array<uint32_t, RenderQueue::PASS_COUNT> mVisibleInstanceCounts{};
+    // 1 for the instances inside the main frustum
+    std::vector<uint8_t> mVisibleFlags;
+    // distance of the nearest visible instance center to the near plane of each pass
+    std::array<float, RenderQueue::PASS_COUNT> mSortDepths{};
+    // packed positions of the mesh when it is an occluder
+    std::vector<float> mOccluderPositions;
+    std::vector<uint32_t> mOccluderIndices;
+    // slot in the material table, without one only orders the draws
+    uint32_t mMaterialId;
+    uint64_t mRecordVersion;
+    uint64_t mLastUsedValue{ 0 };
+    uint64_t mUploadValue{ 0 };
     std::vector<Model::Vertex>  mVertices;
     std::vector<uint32_t> mIndices;
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Model;
+
+// Builds models on a background thread. Finished models are handed back to the
+// render thread through poll(), which decides when they join the frame. Models are
+// meshes shared by their instances, so each name only needs loading once.
+class ModelLoader
+{
+public:
+    struct Result
+    {
+        std::string name;
+        Model* model;
+    };
+
+    ModelLoader();
+    ~ModelLoader();
+
+    void request(const std::string &name);
+    void poll(std::vector<Result> &loaded);
+
+private:
+    void run();
+
+    std::thread                 mThread;
+    std::mutex                  mMutex;
+    std::condition_variable     mCondition;
+    std::deque<std::string>     mRequests;
+    std::vector<Result>         mLoaded;
+    bool                        mQuit{ false };
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include "DescriptorAllocator.h"
+#include "VKFuncs.h"
+
+// Pipelines of the main and the shadow pass and their layouts, shared by all models.
+// Models only differ in their descriptor sets, so draws of different models can keep
+// the pipeline bound. Set 0 of both layouts is the view uniform block, set 1 the model's
+// own. With the material table, set 2 of the main layout is its set and the material of
+// the draw is pushed to the fragment shader. Created once the frame graph has been compiled.
+// The set layouts come from the descriptor allocator's cache, models fill their sets through
+// the update templates from a DescriptorData.
+class ModelPipeline
+{
+public:
+    // the shadow set only reads the two buffers, the textures are ignored with the material table
+    struct DescriptorData
+    {
+        VkDescriptorBufferInfo instanceBuffer;
+        VkDescriptorBufferInfo visibleBuffer;
+        VkDescriptorImageInfo texture;
+        VkDescriptorImageInfo shadowMap;
+    };
+
+    ModelPipeline();
+    ~ModelPipeline();
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const
+    {
+        return mDescriptorSetLayout;
+    }
+
+    VkDescriptorSetLayout getShadowDescriptorSetLayout() const
+    {
+        return mShadowDescriptorSetLayout;
+    }
+
+    const DescriptorAllocator::UpdateTemplate &getUpdateTemplate() const
+    {
+        return *mUpdateTemplate;
+    }
+
+    const DescriptorAllocator::UpdateTemplate &getShadowUpdateTemplate() const
+    {
+        return *mShadowUpdateTemplate;
+    }
+
+    VkPipelineLayout getPipelineLayout() const
+    {
+        return mPLayout;
+    }
+
+    VkPipeline getPipeline() const
+    {
+        return mPipeline;
+    }
+
+    VkPipelineLayout getShadowPipelineLayout() const
+    {
+        return mShadowPLayout;
+    }
+
+    VkPipeline getShadowPipeline() const
+    {
+        return mShadowPipeline;
+    }
+
+    // small ids of the two pipelines for the render queue keys, unique across all pipelines
+    // created so far
+    uint32_t getPipelineId() const
+    {
+        return mPipelineId;
+    }
+
+    uint32_t getShadowPipelineId() const
+    {
+        return mShadowPipelineId;
+    }
+
+private:
+    VkDescriptorSetLayout mDescriptorSetLayout;
+    VkDescriptorSetLayout mShadowDescriptorSetLayout;
+    const DescriptorAllocator::UpdateTemplate* mUpdateTemplate;
+    const DescriptorAllocator::UpdateTemplate* mShadowUpdateTemplate;
+
+    VkPipelineLayout    mPLayout;
+    VkPipelineCache     mPCache;
+    VkPipeline          mPipeline;
+
+    VkPipelineLayout    mShadowPLayout;
+    VkPipelineCache     mShadowPCache;
+    VkPipeline          mShadowPipeline;
+
+    uint32_t            mPipelineId;
+    uint32_t            mShadowPipelineId;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+
+class BoundingBoxes;
+class JobSystem;
+
+// Masked occlusion buffer on the CPU for devices that don't cull occlusion on the GPU. The
+// screen is split into tiles of 8x4 pixels that keep no per pixel depth, only a coverage
+// mask and two depths: the reference depth every pixel of the tile is known to be in front
+// of, and the farthest depth of the triangles partially covering the mask so far. Once the
+// mask is full that depth becomes the reference. A triangle much nearer than the working
+// layer discards it instead of pushing its depth back.
+//
+// Occluder triangles are binned into screen regions of whole tiles, the regions are
+// rasterized in parallel on the job system, coverage 4 pixels at a time with SSE or NEON.
+// A bounding box is occluded when its nearest point lies behind the reference depth of every
+// tile its screen rectangle touches.
+class OcclusionRasterizer
+{
+public:
+    static const uint32_t WIDTH;
+    static const uint32_t HEIGHT;
+    static const uint32_t TILE_WIDTH;
+    static const uint32_t TILE_HEIGHT;
+    // in tiles
+    static const uint32_t BIN_WIDTH;
+    static const uint32_t BIN_HEIGHT;
+    // occluder triangles kept per frame, the rest are dropped
+    static const uint32_t TRIANGLE_BUDGET;
+
+    explicit OcclusionRasterizer(JobSystem &jobSystem);
+
+    // starts a frame with empty tiles, seen through viewProj
+    void begin(const mathfu::mat4 &viewProj);
+
+    // bins an occluder mesh placed by transform, positions are packed xyz triples. Not
+    // thread safe, occluders are added before rasterize().
+    void addOccluder(const std::vector<float> &positions, const std::vector<uint32_t> &indices, const mathfu::mat4 &transform);
+
+    void rasterize();
+
+    // whether the box at index can't be seen past the occluders, callable from several
+    // threads once rasterize() returned
+    bool isOccluded(const BoundingBoxes &boxes, uint32_t index) const;
+
+    uint32_t getTriangleCount() const
+    {
+        return static_cast<uint32_t>(mTriangles.size());
+    }
+
+private:
+    // in pixels, z is the normalized device depth
+    struct Triangle
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+        // tile bounds, the end exclusive
+        uint16_t tileX0;
+        uint16_t tileY0;
+        uint16_t tileX1;
+        uint16_t tileY1;
+    };
+
+    struct Tile
+    {
+        float referenceDepth;
+        float workingDepth;
+        // bit x + 8 * y for the pixel at x, y of the tile
+        uint32_t mask;
+    };
+
+    void rasterizeBin(uint32_t bin);
+
+    JobSystem&          mJobSystem;
+    // row by row
+    float               mViewProj[16];
+    uint32_t            mTilesX;
+    uint32_t            mTilesY;
+    uint32_t            mBinsX;
+    uint32_t            mBinsY;
+    std::vector<Tile>   mTiles;
+    std::vector<Triangle> mTriangles;
+    // the triangles overlapping each bin, in the order they were added
+    std::vector<std::vector<uint32_t>> mBins;
+};
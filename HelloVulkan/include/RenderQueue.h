@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Draw packets of a frame, ordered by a 32-bit sort key. From the most significant bit down
+// the key holds
+//  pass       2 bits, in execution order
+//  pipeline   6 bits
+//  material  14 bits, the descriptor sets of a model
+//  depth     10 bits, front to back
+// so that after sorting draws sharing state are next to each other and recording them
+// only has to bind when something changes. Fields are masked to their width, ids past it
+// only group less well.
+class RenderQueue
+{
+public:
+    enum Pass
+    {
+        PASS_SHADOW,
+        PASS_MAIN,
+        PASS_COUNT,
+    };
+
+    struct Packet
+    {
+        uint32_t key;
+        // of the drawn item in the caller's list
+        uint32_t index;
+    };
+
+    static uint32_t makeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depth);
+
+    // a logarithmic bucket of a distance in front of the camera, 64 per octave from 1/16 to
+    // 4096 units, clamped outside of those
+    static uint32_t makeDepthBucket(float distance);
+
+    static uint32_t getPass(uint32_t key)
+    {
+        return key >> 30;
+    }
+
+    void clear()
+    {
+        mPackets.clear();
+    }
+
+    void push(uint32_t key, uint32_t index)
+    {
+        mPackets.push_back({ key, index });
+    }
+
+    // stable LSD radix sort on 11-bit digits of the key, moving the 8 byte packets. Digits
+    // that are the same in all keys are skipped.
+    void sort();
+
+    const std::vector<Packet> &getPackets() const
+    {
+        return mPackets;
+    }
+
+#ifdef HV_SORT_BENCHMARK
+    // logs the sort time of 50k packets with random keys, the frame budget is 0.1 ms
+    static void benchmark();
+#endif
+
+private:
+    static const uint32_t DIGIT_BITS = 11;
+    static const uint32_t DIGIT_COUNT = (32 + DIGIT_BITS - 1) / DIGIT_BITS;
+    static const uint32_t BUCKET_COUNT = 1 << DIGIT_BITS;
+
+    std::vector<Packet> mPackets;
+    std::vector<Packet> mScratch;
+};
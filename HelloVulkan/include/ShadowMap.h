@@ -1,16 +1,19 @@
 #pragma once
 #include <VKFuncs.h>
+#include "FrameGraph.h"
 #include "ext/mathfu/glsl_mappings.h"
 
+// Adds the shadow pass and its depth target to the frame graph, the
+// graph owns both. Only the getters of the sampler work before compile().
 class ShadowMap
 {
 public:
-    ShadowMap();
+    ShadowMap(FrameGraph &frameGraph, const FrameGraph::ExecuteFunction &execute);
     ~ShadowMap();
 
     VkImageView getShadowMapView()
     {
-        return mShadowDepthImageView;
+        return mFrameGraph.getImageView(mDepthResource);
     }
 
     VkSampler getShadowMapSampler()
@@ -20,21 +23,24 @@ public:
 
     VkRenderPass getRenderPass()
     {
-        return mShadowRenderPass;
+        return mFrameGraph.getRenderPass(mPass);
     }
 
     VkFramebuffer getFramebuffer()
     {
-        return mShadowDepthFramebuffer;
+        return mFrameGraph.getFramebuffer(mPass, 0);
+    }
+
+    FrameGraph::Resource getDepthResource()
+    {
+        return mDepthResource;
     }
 
     static const uint32_t SHADOWMAP_DIM;
 
 private:
-    VkRenderPass    mShadowRenderPass;
-    VkImage         mShadowDepthImage;
-    VkImageView     mShadowDepthImageView;
-    VkDeviceMemory  mShadowDepthImageMemory;
-    VkSampler       mShadowDepthImageSampler;
-    VkFramebuffer   mShadowDepthFramebuffer;
-};
\ No newline at end of file
+    FrameGraph&             mFrameGraph;
+    FrameGraph::Resource    mDepthResource;
+    FrameGraph::Pass        mPass;
+    VkSampler               mShadowDepthImageSampler;
+};
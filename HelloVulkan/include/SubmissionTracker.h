@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "VKFuncs.h"
+
+// Tags every submission to a queue with a monotonically increasing value so the host
+// can wait for, or poll, a specific point instead of draining the whole queue.
+// Backed by a VK_KHR_timeline_semaphore when the device supports it, otherwise by
+// one fence per submission. Safe to use from several threads, queueMutex guards
+// the VkQueue itself and may be shared by trackers of different queues.
+class SubmissionTracker
+{
+public:
+    SubmissionTracker(VkDevice device, VkQueue queue, std::mutex &queueMutex, bool useTimelineSemaphore);
+    ~SubmissionTracker();
+
+    // submits a single batch, returns the value reached once it has completed
+    uint64_t submit(const VkSubmitInfo &submitInfo);
+
+    uint64_t getCompletedValue();
+    uint64_t getLastSubmittedValue() const
+    {
+        return mLastSubmittedValue;
+    }
+
+    bool isComplete(uint64_t value);
+    void wait(uint64_t value);
+    void waitIdle();
+
+    VkQueue getQueue() const
+    {
+        return mQueue;
+    }
+
+private:
+    struct PendingFence
+    {
+        uint64_t value;
+        VkFence fence;
+    };
+
+    void retireFences(bool block, uint64_t value);
+    // resets the retired fences for reuse once no thread waits on any, mFenceMutex held
+    void recycleFences();
+    void updateCompletedValue(uint64_t value);
+
+    VkDevice                mDevice;
+    VkQueue                 mQueue;
+    std::mutex&             mQueueMutex;
+    std::atomic<uint64_t>   mLastSubmittedValue{ 0 };
+    std::atomic<uint64_t>   mCompletedValue{ 0 };
+
+    VkSemaphore         mTimelineSemaphore{ VK_NULL_HANDLE };
+#ifdef VK_KHR_timeline_semaphore
+    PFN_vkWaitSemaphoresKHR             mWaitSemaphores{ nullptr };
+    PFN_vkGetSemaphoreCounterValueKHR   mGetSemaphoreCounterValue{ nullptr };
+#endif
+
+    std::mutex                  mFenceMutex;
+    std::deque<PendingFence>    mPendingFences;
+    std::vector<VkFence>        mFreeFences;
+    // signaled fences kept from reuse while blocking waits are in progress, they may be
+    // among the fences waited on
+    std::vector<VkFence>        mRetiredFences;
+    uint32_t                    mBlockingWaits{ 0 };
+};
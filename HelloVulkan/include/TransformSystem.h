@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+
+class JobSystem;
+
+// Transform hierarchy of the simulation. Every transform holds a local translation, rotation
+// and scale, each in an array of its own, and a parent set at creation. World matrices are
+// kept between updates and only recomputed below transforms whose local part changed.
+// Transforms are grouped by depth, update() walks the levels from the roots down and
+// computes each level in parallel on the job system, a level only reads the one above.
+// Not thread safe, the simulation thread owns it.
+class TransformSystem
+{
+public:
+    typedef uint32_t Handle;
+    static const Handle INVALID_HANDLE;
+
+    struct Stats
+    {
+        uint32_t transformCount{ 0 };
+        // world matrices recomputed by the last update()
+        uint32_t updatedCount{ 0 };
+        float milliseconds{ 0.f };
+    };
+
+    explicit TransformSystem(JobSystem &jobSystem);
+
+    // identity local transform under parent, a root when there is none. The parent can't be
+    // changed later.
+    Handle create(Handle parent = INVALID_HANDLE);
+    // children have to be destroyed first, the handle is reused afterwards
+    void destroy(Handle handle);
+
+    void setTranslation(Handle handle, const mathfu::vec3 &translation);
+    void setRotation(Handle handle, const mathfu::quat &rotation);
+    void setScale(Handle handle, const mathfu::vec3 &scale);
+
+    void update();
+
+    // as of the last update()
+    const mathfu::mat4 &getWorld(Handle handle) const
+    {
+        return mWorlds[handle];
+    }
+
+    const Stats &getStats() const
+    {
+        return mStats;
+    }
+
+#ifdef HV_TRANSFORM_BENCHMARK
+    // logs the update time of a 100k transform hierarchy, fully and partially dirty
+    static void benchmark(JobSystem &jobSystem);
+#endif
+
+private:
+    static const uint32_t UPDATE_BATCH_SIZE;
+
+    mathfu::mat4 getLocal(Handle handle) const;
+
+    JobSystem&          mJobSystem;
+
+    std::vector<std::array<float, 3>> mTranslations;
+    // quaternion, vector part followed by the scalar
+    std::vector<std::array<float, 4>> mRotations;
+    std::vector<std::array<float, 3>> mScales;
+    std::vector<Handle>     mParents;
+    std::vector<uint32_t>   mChildCounts;
+    std::vector<uint32_t>   mDepths;
+    // position in the level of its depth
+    std::vector<uint32_t>   mLevelSlots;
+    // local part changed since the last update()
+    std::vector<uint8_t>    mLocalDirty;
+    // world matrix recomputed by the running update(), read by the level below
+    std::vector<uint8_t>    mWorldChanged;
+    std::vector<mathfu::mat4, mathfu::simd_allocator<mathfu::mat4>> mWorlds;
+
+    // handles by depth, roots first
+    std::vector<std::vector<Handle>> mLevels;
+    std::vector<Handle>     mFreeHandles;
+    uint32_t                mTransformCount{ 0 };
+    Stats                   mStats;
+};
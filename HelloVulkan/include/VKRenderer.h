@@ -1,10 +1,23 @@
 #pragma once
 #include <memory>
+#include <string>
 #include "VKFuncs.h"
 
 struct engine;
 
 class ShadowMap;
+class InstanceCuller;
+class ClusterCuller;
+class DepthPyramid;
+class GeometryPool;
+class ModelPipeline;
+class ViewUniforms;
+class MaterialTable;
+struct CullStats;
+class SubmissionTracker;
+class DeletionQueue;
+class DescriptorAllocator;
+class JobSystem;
 
 class VKRenderer
 {
@@ -16,26 +29,72 @@ public:
 
     virtual VkDevice &getDevice() = 0;
     virtual VkPhysicalDevice &getPhysicalDevice() = 0;
+    // the optional core features the device was created with
+    virtual const VkPhysicalDeviceFeatures &getEnabledFeatures() = 0;
     virtual VkExtent2D &getDisplaySize() = 0;
-    virtual VkFramebuffer &getFramebuffer(uint32_t index) = 0;
-    virtual VkRenderPass &getRenderPass() = 0;
+    // main pass of the frame graph, valid once init() compiled it
+    virtual VkFramebuffer getFramebuffer(uint32_t index) = 0;
+    virtual VkRenderPass getRenderPass() = 0;
     virtual VkCommandPool &getCommandPool() = 0;
 
     virtual uint32_t getSwapChainLength() = 0;
+    // per-frame resources written by the CPU need this many copies
+    virtual uint32_t getFramesInFlight() = 0;
+    // values of the graphics queue tracker are the lifetime clock for GPU resources
+    virtual SubmissionTracker &getGraphicsTracker() = 0;
+    virtual DeletionQueue &getDeletionQueue() = 0;
+    // shared descriptor pools and the set layout cache
+    virtual DescriptorAllocator &getDescriptorAllocator() = 0;
+    virtual JobSystem &getJobSystem() = 0;
+    virtual uint32_t getGraphicsQueueFamilyIndex() = 0;
     
     virtual void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiliting, VkImageUsageFlags usage,
         VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory & imageMemory) = 0;
 
     virtual void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) = 0;
-    virtual void copyImage(VkImage srcImage, VkImage dstImage, uint32_t width, uint32_t height) = 0;
     virtual void createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageView &imageView) = 0;
     virtual void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) = 0;
+    // a one-off command buffer on the graphics queue, submitting it waits for it to finish
+    virtual VkCommandBuffer beginSingleTimeCommands() = 0;
+    virtual void endSingleTimeCommands(VkCommandBuffer commandBuffer) = 0;
     virtual void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) = 0;
+    // buffer usable from the graphics, async compute and transfer queues at once without
+    // ownership transfers, for what the cluster cull touches
+    virtual void createSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) = 0;
 
+    // the cluster cull of the first phase runs on the async compute queue while the graphics
+    // queue draws the shadow pass, the other compute passes are recorded on the graphics queue
+    virtual void createComputePipeline(const std::string &shaderName, VkPipelineLayout layout, VkPipeline &pipeline) = 0;
+
+    // staged uploads, executed on the transfer queue when the device has one. Callable from
+    // any thread, they don't block and return the graphics tracker value at which the data
+    // is usable by the graphics queue
+    virtual uint64_t uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) = 0;
+    // same for buffers from createSharedBuffer, which take no ownership transfer
+    virtual uint64_t uploadSharedBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) = 0;
+    virtual uint64_t uploadImage(const void* pixels, VkDeviceSize size, uint32_t width, uint32_t height, VkImage dstImage) = 0;
+
+    // scene, models load in the background and are drawn once resident. Same thread as update().
+    virtual uint32_t spawnModel(const std::string &name, float offsetZ) = 0;
+    virtual void despawnModel(uint32_t id) = 0;
+
+    // update() snapshots the scene into a frame packet, draw() renders the newest one. Once
+    // the render thread is started it draws on its own and draw() must not be called anymore.
     virtual void draw() = 0;
     virtual void update() = 0;
+    virtual void startRenderThread() = 0;
 
     virtual ShadowMap* getShadowMap() = 0;
+    virtual InstanceCuller* getInstanceCuller() = 0;
+    virtual ClusterCuller* getClusterCuller() = 0;
+    virtual DepthPyramid* getDepthPyramid() = 0;
+    virtual GeometryPool* getGeometryPool() = 0;
+    virtual ModelPipeline* getModelPipeline() = 0;
+    virtual ViewUniforms* getViewUniforms() = 0;
+    // nullptr without descriptor indexing, models then bind their texture with their own set
+    virtual MaterialTable* getMaterialTable() = 0;
+    // written by the render thread every frame
+    virtual const CullStats &getCullStats() = 0;
 
     virtual void release() = 0;
     
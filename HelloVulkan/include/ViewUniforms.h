@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include "FramePacket.h"
+#include "Frustum.h"
+#include "RenderQueue.h"
+#include "VKFuncs.h"
+#include "mathfu/glsl_mappings.h"
+
+// Camera and light of the frame in one uniform block, written once per frame and bound at
+// set 0 by the model pipelines and the cull pass. Models only supply their instance
+// transforms.
+class ViewUniforms
+{
+public:
+    // matches the View block of shader.vert, shadow.vert and cull.comp
+    struct UniformBufferObject
+    {
+        mathfu::mat4 view;
+        mathfu::mat4 proj;
+        mathfu::mat4 viewProj;
+        mathfu::mat4 lightViewProj;
+        // world to shadow map texture coordinates
+        mathfu::mat4 shadowTransform;
+        mathfu::vec4 frustumPlanes[Frustum::PLANE_COUNT];
+        mathfu::vec4 shadowFrustumPlanes[Frustum::PLANE_COUNT];
+        // pixels per unit at distance 1, the LOD error allowed in pixels and the share of it
+        // allowed when going to a coarser LOD than last frame
+        mathfu::vec4 lodParams;
+    };
+
+    ViewUniforms();
+    ~ViewUniforms();
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const
+    {
+        return mDescriptorSetLayout;
+    }
+
+    VkDescriptorSet getDescriptorSet() const
+    {
+        return mDescriptorSet;
+    }
+
+    void update(const FramePacket &packet, const std::array<Frustum, RenderQueue::PASS_COUNT> &frusta, uint32_t frameIndex);
+    void recordUniformCopies(VkCommandBuffer cmdBuffer, uint32_t frameIndex) const;
+
+private:
+    VkDescriptorPool mDescriptorPool;
+    VkDescriptorSetLayout mDescriptorSetLayout;
+    VkDescriptorSet mDescriptorSet;
+    VkBuffer mUniformBuffer;
+    VkBuffer mUniformStagingBuffer;
+    VkDeviceMemory mUniformBufferMemory;
+    VkDeviceMemory mUniformStagingBufferMemory;
+    uint8_t* mUniformStagingData;
+};
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cassert>
+#include "BindState.h"
+#include "GeometryPool.h"
+
+BindStats &BindStats::operator+=(const BindStats &other)
+{
+    pipelineBinds += other.pipelineBinds;
+    pipelineBindsSkipped += other.pipelineBindsSkipped;
+    descriptorSetBinds += other.descriptorSetBinds;
+    descriptorSetBindsSkipped += other.descriptorSetBindsSkipped;
+    geometryBinds += other.geometryBinds;
+    geometryBindsSkipped += other.geometryBindsSkipped;
+    return *this;
+}
+
+void BindState::bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+{
+    if (pipeline == mPipeline)
+    {
+        mStats.pipelineBindsSkipped++;
+        return;
+    }
+
+    vkCmdBindPipeline(mCmdBuffer, bindPoint, pipeline);
+    mPipeline = pipeline;
+    mStats.pipelineBinds++;
+}
+
+void BindState::bindDescriptorSet(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set, VkDescriptorSet descriptorSet)
+{
+    assert(set < MAX_DESCRIPTOR_SETS);
+
+    // sets bound with a different layout aren't guaranteed to stay compatible
+    if (layout != mLayout)
+    {
+        std::fill(mDescriptorSets, mDescriptorSets + MAX_DESCRIPTOR_SETS, VK_NULL_HANDLE);
+        mLayout = layout;
+    }
+
+    if (descriptorSet == mDescriptorSets[set])
+    {
+        mStats.descriptorSetBindsSkipped++;
+        return;
+    }
+
+    vkCmdBindDescriptorSets(mCmdBuffer, bindPoint, layout, set, 1, &descriptorSet, 0, nullptr);
+    mDescriptorSets[set] = descriptorSet;
+    mStats.descriptorSetBinds++;
+}
+
+void BindState::bindGeometry(const GeometryPool &geometryPool)
+{
+    if (&geometryPool == mGeometryPool)
+    {
+        mStats.geometryBindsSkipped++;
+        return;
+    }
+
+    geometryPool.bind(mCmdBuffer);
+    mGeometryPool = &geometryPool;
+    mStats.geometryBinds++;
+}
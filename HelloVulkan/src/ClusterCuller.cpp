@@ -0,0 +1,84 @@
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "ClusterCuller.h"
+#include "VKRenderer.h"
+#include "ViewUniforms.h"
+
+ClusterCuller::ClusterCuller()
+{
+    // create descriptor set layout
+    {
+        std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = i < 5 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            bindings[i].pImmutableSamplers = nullptr;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+        mDescriptorSetLayout = descriptorAllocator.getLayout(bindings.data(), static_cast<uint32_t>(bindings.size()));
+
+        // create update template, the buffers in binding order followed by the depth pyramid
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(bindings.size());
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            entries[i].dstBinding = bindings[i].binding;
+            entries[i].dstArrayElement = 0;
+            entries[i].descriptorCount = 1;
+            entries[i].descriptorType = bindings[i].descriptorType;
+            entries[i].offset = offsetof(DescriptorData, buffers) + i * sizeof(VkDescriptorBufferInfo);
+            entries[i].stride = sizeof(VkDescriptorBufferInfo);
+        }
+        entries[5].offset = offsetof(DescriptorData, depthPyramid);
+        entries[5].stride = sizeof(VkDescriptorImageInfo);
+
+        mUpdateTemplate = descriptorAllocator.createUpdateTemplate(mDescriptorSetLayout, entries);
+    }
+
+    // create compute pipeline, the ranges and the phase are push constants
+    {
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkDescriptorSetLayout setLayouts[] = { VKRenderer::getInstance().getViewUniforms()->getDescriptorSetLayout(), mDescriptorSetLayout };
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.pNext = nullptr;
+        pipelineLayoutCreateInfo.setLayoutCount = 2;
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        auto result = vkCreatePipelineLayout(VKRenderer::getInstance().getDevice(), &pipelineLayoutCreateInfo, nullptr, &mPLayout);
+        assert(result == VK_SUCCESS);
+
+        VKRenderer::getInstance().createComputePipeline("clustercull.comp.spv", mPLayout, mPipeline);
+    }
+}
+
+ClusterCuller::~ClusterCuller()
+{
+    vkDestroyPipeline(VKRenderer::getInstance().getDevice(), mPipeline, nullptr);
+    vkDestroyPipelineLayout(VKRenderer::getInstance().getDevice(), mPLayout, nullptr);
+}
+
+void ClusterCuller::recordDispatch(VkCommandBuffer cmdBuffer, VkDescriptorSet descriptorSet, const Dispatch &dispatch,
+    InstanceCuller::Phase phase) const
+{
+    PushConstants pushConstants = { dispatch, static_cast<uint32_t>(phase) };
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+    VkDescriptorSet descriptorSets[] = { VKRenderer::getInstance().getViewUniforms()->getDescriptorSet(), descriptorSet };
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPLayout, 0, 2, descriptorSets, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, mPLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    vkCmdDispatch(cmdBuffer, dispatch.meshletCount, dispatch.slotCount, 1);
+}
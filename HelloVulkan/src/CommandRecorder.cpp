@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+#include "Model.h"
+
+const uint32_t CommandRecorder::MODELS_PER_CHUNK = 32;
+
+CommandRecorder::CommandRecorder(VkDevice device, uint32_t queueFamilyIndex, JobSystem &jobSystem)
+    : mDevice(device)
+    , mJobSystem(jobSystem)
+{
+    mContexts.resize(mJobSystem.getThreadCount());
+    for (auto &context : mContexts)
+    {
+        VkCommandPoolCreateInfo cmdPoolCreateInfo{};
+        cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmdPoolCreateInfo.pNext = nullptr;
+        cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        cmdPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+        auto result = vkCreateCommandPool(mDevice, &cmdPoolCreateInfo, nullptr, &context.commandPool);
+        assert(result == VK_SUCCESS);
+    }
+}
+
+CommandRecorder::~CommandRecorder()
+{
+    // destroying the pools frees the cached and retired secondaries with them
+    for (auto &context : mContexts)
+    {
+        vkDestroyCommandPool(mDevice, context.commandPool, nullptr);
+    }
+}
+
+VkCommandBuffer CommandRecorder::beginSecondary(ThreadContext &context, uint64_t completedValue, VkRenderPass renderPass)
+{
+    VkCommandBuffer cmdBuffer;
+    if (!context.retired.empty() && context.retired.front().value <= completedValue)
+    {
+        // begin resets it
+        cmdBuffer = context.retired.front().cmdBuffer;
+        context.retired.pop_front();
+    }
+    else
+    {
+        VkCommandBufferAllocateInfo cmdBufferAllocationInfo{};
+        cmdBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdBufferAllocationInfo.pNext = nullptr;
+        cmdBufferAllocationInfo.commandPool = context.commandPool;
+        cmdBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        cmdBufferAllocationInfo.commandBufferCount = 1;
+
+        auto result = vkAllocateCommandBuffers(mDevice, &cmdBufferAllocationInfo, &cmdBuffer);
+        assert(result == VK_SUCCESS);
+    }
+
+    VkCommandBufferInheritanceInfo cmdBufferInheritanceInfo = {};
+    cmdBufferInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    cmdBufferInheritanceInfo.renderPass = renderPass;
+    cmdBufferInheritanceInfo.subpass = 0;
+    cmdBufferInheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+    // executed by the primaries of several swapchain images, which may be pending at once
+    VkCommandBufferBeginInfo cmdBufferBeginInfo{};
+    cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufferBeginInfo.pNext = nullptr;
+    cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmdBufferBeginInfo.pInheritanceInfo = &cmdBufferInheritanceInfo;
+
+    auto result = vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo);
+    assert(result == VK_SUCCESS);
+
+    return cmdBuffer;
+}
+
+void CommandRecorder::retireChunk(Chunk &chunk, uint64_t retireValue)
+{
+    if (chunk.cmdBuffer == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    mContexts[chunk.threadIndex].retired.push_back({ chunk.cmdBuffer, retireValue });
+    chunk.cmdBuffer = VK_NULL_HANDLE;
+}
+
+bool CommandRecorder::recordModels(const std::vector<Model*> &models, VkRenderPass shadowRenderPass, VkRenderPass renderPass,
+    uint64_t retireValue, uint64_t completedValue,
+    std::vector<VkCommandBuffer> &shadowCmdBuffers, std::vector<VkCommandBuffer> &cmdBuffers)
+{
+    // one packet per model and pass it is visible in, the pass is the top of the key so
+    // passes stay apart
+    auto sortStart = std::chrono::high_resolution_clock::now();
+
+    mRenderQueue.clear();
+    for (uint32_t i = 0; i < models.size(); i++)
+    {
+        for (uint32_t pass = 0; pass < RenderQueue::PASS_COUNT; pass++)
+        {
+            if (models[i]->getVisibleInstanceCount(static_cast<RenderQueue::Pass>(pass)) > 0)
+            {
+                mRenderQueue.push(models[i]->getSortKey(static_cast<RenderQueue::Pass>(pass)), i);
+            }
+        }
+    }
+    mRenderQueue.sort();
+
+    mStats.packetCount = static_cast<uint32_t>(mRenderQueue.getPackets().size());
+    mStats.sortMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - sortStart).count();
+
+    std::array<std::vector<Model*>, RenderQueue::PASS_COUNT> sortedModels;
+    for (auto &packet : mRenderQueue.getPackets())
+    {
+        sortedModels[RenderQueue::getPass(packet.key)].push_back(models[packet.index]);
+    }
+
+    // find the chunks whose models changed, retiring is done here since the
+    // pools of the recording threads must not be touched while they record
+    bool changed = false;
+    std::vector<DirtyChunk> dirtyChunks;
+    for (uint32_t pass = 0; pass < RenderQueue::PASS_COUNT; pass++)
+    {
+        auto &passModels = sortedModels[pass];
+        auto &chunks = mChunks[pass];
+
+        uint32_t modelCount = static_cast<uint32_t>(passModels.size());
+        uint32_t chunkCount = (modelCount + MODELS_PER_CHUNK - 1) / MODELS_PER_CHUNK;
+
+        changed = changed || chunkCount != chunks.size();
+
+        for (uint32_t chunkIndex = chunkCount; chunkIndex < chunks.size(); chunkIndex++)
+        {
+            retireChunk(chunks[chunkIndex], retireValue);
+        }
+        chunks.resize(chunkCount, Chunk{ {}, {}, VK_NULL_HANDLE, 0, {} });
+
+        for (uint32_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+        {
+            auto &chunk = chunks[chunkIndex];
+
+            uint32_t begin = chunkIndex * MODELS_PER_CHUNK;
+            uint32_t end = std::min(begin + MODELS_PER_CHUNK, modelCount);
+
+            bool dirty = chunk.cmdBuffer == VK_NULL_HANDLE || chunk.models.size() != end - begin;
+            for (uint32_t i = begin; i < end && !dirty; i++)
+            {
+                dirty = chunk.models[i - begin] != passModels[i] || chunk.versions[i - begin] != passModels[i]->getRecordVersion();
+            }
+
+            if (dirty)
+            {
+                retireChunk(chunk, retireValue);
+
+                chunk.models.assign(passModels.begin() + begin, passModels.begin() + end);
+                chunk.versions.clear();
+                for (auto &model : chunk.models)
+                {
+                    chunk.versions.push_back(model->getRecordVersion());
+                }
+                dirtyChunks.push_back({ static_cast<RenderQueue::Pass>(pass), chunkIndex });
+            }
+        }
+    }
+
+    mJobSystem.parallelFor(static_cast<uint32_t>(dirtyChunks.size()), 1, [&](uint32_t begin, uint32_t end) {
+        uint32_t threadIndex = JobSystem::getThreadIndex();
+        auto &context = mContexts[threadIndex];
+
+        for (uint32_t dirtyIndex = begin; dirtyIndex < end; dirtyIndex++)
+        {
+            auto pass = dirtyChunks[dirtyIndex].pass;
+            auto &chunk = mChunks[pass][dirtyChunks[dirtyIndex].chunkIndex];
+
+            chunk.cmdBuffer = beginSecondary(context, completedValue, pass == RenderQueue::PASS_SHADOW ? shadowRenderPass : renderPass);
+
+            BindState state(chunk.cmdBuffer);
+            for (auto &model : chunk.models)
+            {
+                if (pass == RenderQueue::PASS_SHADOW)
+                {
+                    model->recordShadowDraw(state);
+                }
+                else
+                {
+                    model->recordDraw(state);
+                }
+            }
+            auto result = vkEndCommandBuffer(chunk.cmdBuffer);
+            assert(result == VK_SUCCESS);
+
+            chunk.threadIndex = threadIndex;
+            chunk.binds = state.getStats();
+        }
+    });
+
+    mStats.binds = BindStats();
+    for (auto &chunks : mChunks)
+    {
+        for (auto &chunk : chunks)
+        {
+            mStats.binds += chunk.binds;
+        }
+    }
+
+    shadowCmdBuffers.clear();
+    for (auto &chunk : mChunks[RenderQueue::PASS_SHADOW])
+    {
+        shadowCmdBuffers.push_back(chunk.cmdBuffer);
+    }
+
+    cmdBuffers.clear();
+    for (auto &chunk : mChunks[RenderQueue::PASS_MAIN])
+    {
+        cmdBuffers.push_back(chunk.cmdBuffer);
+    }
+
+    return changed || !dirtyChunks.empty();
+}
@@ -10,12 +10,18 @@ using namespace mathfu;
 
 DebugCoord::DebugCoord()
 {
-    // create uniform buffer
+    // create uniform buffer, one staging slot per frame in flight
     {
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+        VkDeviceSize stagingSize = bufferSize * VKRenderer::getInstance().getFramesInFlight();
 
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformStagingBuffer, mUniformStagingBufferMemory);
+        VKRenderer::getInstance().createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformStagingBuffer, mUniformStagingBufferMemory);
         VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mUniformBuffer, mUniformBufferMemory);
+
+        void* data = nullptr;
+        auto result = vkMapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, 0, stagingSize, 0, &data);
+        ASSERT_VK_SUCCESS(result);
+        mUniformStagingData = static_cast<uint8_t*>(data);
     }
 
     // create descriptor set layout
@@ -326,6 +332,7 @@ DebugCoord::~DebugCoord()
     vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mUniformBuffer, nullptr);
     vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mUniformStagingBuffer, nullptr);
     vkFreeMemory(VKRenderer::getInstance().getDevice(), mUniformBufferMemory, nullptr);
+    vkUnmapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory);
     vkFreeMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, nullptr);
     vkDestroyDescriptorSetLayout(VKRenderer::getInstance().getDevice(), mDescriptorSetLayout, nullptr);
     vkFreeDescriptorSets(VKRenderer::getInstance().getDevice(), mDescriptorPool, 1, &mDescriptorSet);
@@ -337,22 +344,18 @@ void DebugCoord::executeCommandBuffer(VkCommandBuffer primaryCmdBuffer, uint32_t
     vkCmdExecuteCommands(primaryCmdBuffer, 1, &mCmdBuffer[nextIndex]);
 }
 
-void DebugCoord::update()
+void DebugCoord::update(const FramePacket &packet, uint32_t frameIndex)
 {
-    auto displaySize = VKRenderer::getInstance().getDisplaySize();
     UniformBufferObject ubo = {};
-    
-    mat4 view = mat4::LookAt(vec3(0.0f, 0.0f, 0.0f), vec3(4.0f, 4.0f, 4.0f), vec3(0.0f, 1.0f, 0.0f), 1.0f);
-    mat4 proj = mat4::Perspective((45.0f) / 180.f * 3.1415926f, (float)displaySize.width / (float)displaySize.height, 0.1f, 10.0f);
-    proj(1, 1) *= -1;
-
-    ubo.ProjView = proj * view;
+    ubo.ProjView = packet.proj * packet.view;
 
-    void* data = nullptr;
-    vkMapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-    assert(data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory);
+    memcpy(mUniformStagingData + frameIndex * sizeof(ubo), &ubo, sizeof(ubo));
+}
 
-    VKRenderer::getInstance().copyBuffer(mUniformStagingBuffer, mUniformBuffer, sizeof(ubo));
+void DebugCoord::recordUniformCopies(VkCommandBuffer cmdBuffer, uint32_t frameIndex) const
+{
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = frameIndex * sizeof(UniformBufferObject);
+    copyRegion.size = sizeof(UniformBufferObject);
+    vkCmdCopyBuffer(cmdBuffer, mUniformStagingBuffer, mUniformBuffer, 1, &copyRegion);
 }
\ No newline at end of file
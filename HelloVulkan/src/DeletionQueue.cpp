@@ -0,0 +1,141 @@
+#include "DeletionQueue.h"
+
+DeletionQueue::DeletionQueue(VkDevice device)
+    : mDevice(device)
+{
+
+}
+
+DeletionQueue::~DeletionQueue()
+{
+    flush();
+}
+
+void DeletionQueue::push(uint64_t value, std::function<void()> &&destroy)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.push_back({ value, std::move(destroy) });
+}
+
+void DeletionQueue::pushBuffer(uint64_t value, VkBuffer buffer)
+{
+    VkDevice device = mDevice;
+    push(value, [device, buffer]() { vkDestroyBuffer(device, buffer, nullptr); });
+}
+
+void DeletionQueue::pushImage(uint64_t value, VkImage image)
+{
+    VkDevice device = mDevice;
+    push(value, [device, image]() { vkDestroyImage(device, image, nullptr); });
+}
+
+void DeletionQueue::pushImageView(uint64_t value, VkImageView imageView)
+{
+    VkDevice device = mDevice;
+    push(value, [device, imageView]() { vkDestroyImageView(device, imageView, nullptr); });
+}
+
+void DeletionQueue::pushSampler(uint64_t value, VkSampler sampler)
+{
+    VkDevice device = mDevice;
+    push(value, [device, sampler]() { vkDestroySampler(device, sampler, nullptr); });
+}
+
+void DeletionQueue::pushSemaphore(uint64_t value, VkSemaphore semaphore)
+{
+    VkDevice device = mDevice;
+    push(value, [device, semaphore]() { vkDestroySemaphore(device, semaphore, nullptr); });
+}
+
+void DeletionQueue::pushMemory(uint64_t value, VkDeviceMemory memory)
+{
+    VkDevice device = mDevice;
+    push(value, [device, memory]() { vkFreeMemory(device, memory, nullptr); });
+}
+
+void DeletionQueue::pushPipeline(uint64_t value, VkPipeline pipeline)
+{
+    VkDevice device = mDevice;
+    push(value, [device, pipeline]() { vkDestroyPipeline(device, pipeline, nullptr); });
+}
+
+void DeletionQueue::pushPipelineLayout(uint64_t value, VkPipelineLayout pipelineLayout)
+{
+    VkDevice device = mDevice;
+    push(value, [device, pipelineLayout]() { vkDestroyPipelineLayout(device, pipelineLayout, nullptr); });
+}
+
+void DeletionQueue::pushPipelineCache(uint64_t value, VkPipelineCache pipelineCache)
+{
+    VkDevice device = mDevice;
+    push(value, [device, pipelineCache]() { vkDestroyPipelineCache(device, pipelineCache, nullptr); });
+}
+
+void DeletionQueue::pushDescriptorSetLayout(uint64_t value, VkDescriptorSetLayout descriptorSetLayout)
+{
+    VkDevice device = mDevice;
+    push(value, [device, descriptorSetLayout]() { vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr); });
+}
+
+void DeletionQueue::pushDescriptorPool(uint64_t value, VkDescriptorPool descriptorPool)
+{
+    // destroying the pool frees the sets allocated from it
+    VkDevice device = mDevice;
+    push(value, [device, descriptorPool]() { vkDestroyDescriptorPool(device, descriptorPool, nullptr); });
+}
+
+void DeletionQueue::pushCommandBuffers(uint64_t value, VkCommandPool commandPool, const std::vector<VkCommandBuffer> &commandBuffers)
+{
+    if (commandBuffers.empty())
+    {
+        return;
+    }
+
+    VkDevice device = mDevice;
+    push(value, [device, commandPool, commandBuffers]() {
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    });
+}
+
+void DeletionQueue::collect(uint64_t completedValue)
+{
+    // values are pushed roughly in order, but a resource can retire with an older
+    // value than one pushed before it, so scan the whole queue
+    std::vector<Entry> retired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto it = mEntries.begin();
+        while (it != mEntries.end())
+        {
+            if (it->value <= completedValue)
+            {
+                retired.push_back(std::move(*it));
+                it = mEntries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (auto &entry : retired)
+    {
+        entry.destroy();
+    }
+}
+
+void DeletionQueue::flush()
+{
+    std::deque<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        entries.swap(mEntries);
+    }
+
+    for (auto &entry : entries)
+    {
+        entry.destroy();
+    }
+}
@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+#include "DepthPyramid.h"
+#include "VKRenderer.h"
+
+// matches local_size_x and local_size_y of depthpyramid.comp
+const uint32_t DepthPyramid::GROUP_SIZE = 8;
+
+static uint32_t previousPowerOfTwo(uint32_t value)
+{
+    uint32_t result = 1;
+    while (result * 2 <= value)
+    {
+        result *= 2;
+    }
+    return result;
+}
+
+DepthPyramid::DepthPyramid(VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight)
+    : mWidth(previousPowerOfTwo(depthWidth))
+    , mHeight(previousPowerOfTwo(depthHeight))
+    , mLevelCount(1)
+{
+    auto device = VKRenderer::getInstance().getDevice();
+
+    while ((std::max(mWidth, mHeight) >> mLevelCount) > 0)
+    {
+        mLevelCount++;
+    }
+
+    // create pyramid image
+    {
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = mWidth;
+        imageInfo.extent.height = mHeight;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mLevelCount;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = depthView != VK_NULL_HANDLE ? VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.flags = 0;
+
+        auto result = vkCreateImage(device, &imageInfo, nullptr, &mImage);
+        ASSERT_VK_SUCCESS(result);
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, mImage, &memRequirements);
+
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(VKRenderer::getInstance().getPhysicalDevice(), &memProperties);
+
+        uint32_t memoryTypeIndex;
+        for (memoryTypeIndex = 0; memoryTypeIndex < memProperties.memoryTypeCount; memoryTypeIndex++) {
+            if ((memRequirements.memoryTypeBits & (1 << memoryTypeIndex)) && (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+            {
+                break;
+            }
+        }
+        assert(memoryTypeIndex != memProperties.memoryTypeCount);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        result = vkAllocateMemory(device, &allocInfo, nullptr, &mImageMemory);
+        ASSERT_VK_SUCCESS(result);
+
+        result = vkBindImageMemory(device, mImage, mImageMemory, 0);
+        ASSERT_VK_SUCCESS(result);
+    }
+
+    // create image views, all levels for the cull pass and one per level for the reduction
+    {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = mImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = mLevelCount;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        auto result = vkCreateImageView(device, &viewInfo, nullptr, &mImageView);
+        ASSERT_VK_SUCCESS(result);
+
+        mLevelViews.resize(mLevelCount);
+        for (uint32_t level = 0; level < mLevelCount; level++)
+        {
+            viewInfo.subresourceRange.baseMipLevel = level;
+            viewInfo.subresourceRange.levelCount = 1;
+
+            result = vkCreateImageView(device, &viewInfo, nullptr, &mLevelViews[level]);
+            ASSERT_VK_SUCCESS(result);
+        }
+    }
+
+    // create sampler, the shaders only fetch texels
+    {
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = samplerInfo.addressModeV = samplerInfo.addressModeU;
+        samplerInfo.mipLodBias = 0.f;
+        samplerInfo.maxAnisotropy = 1.f;
+        samplerInfo.minLod = 0.f;
+        samplerInfo.maxLod = static_cast<float>(mLevelCount);
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+        auto result = vkCreateSampler(device, &samplerInfo, nullptr, &mSampler);
+        ASSERT_VK_SUCCESS(result);
+    }
+
+    // the placeholder only needs the layout the cull passes expect
+    if (depthView == VK_NULL_HANDLE)
+    {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = mImage;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mLevelCount;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkCommandBuffer cmdBuffer = VKRenderer::getInstance().beginSingleTimeCommands();
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+        VKRenderer::getInstance().endSingleTimeCommands(cmdBuffer);
+        return;
+    }
+
+    // create descriptor set layout, the source level and the destination level
+    {
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+        bindings[0].binding = 0;
+        bindings[0].descriptorCount = 1;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].pImmutableSamplers = nullptr;
+        bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        bindings[1].binding = 1;
+        bindings[1].descriptorCount = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].pImmutableSamplers = nullptr;
+        bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        auto result = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &mDescriptorSetLayout);
+        assert(result == VK_SUCCESS);
+    }
+
+    // create descriptor pool and a set per level
+    {
+        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = mLevelCount;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[1].descriptorCount = mLevelCount;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = mLevelCount;
+
+        auto result = vkCreateDescriptorPool(device, &poolInfo, nullptr, &mDescriptorPool);
+        assert(result == VK_SUCCESS);
+
+        std::vector<VkDescriptorSetLayout> layouts(mLevelCount, mDescriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = mDescriptorPool;
+        allocInfo.descriptorSetCount = mLevelCount;
+        allocInfo.pSetLayouts = layouts.data();
+
+        mDescriptorSets.resize(mLevelCount);
+        result = vkAllocateDescriptorSets(device, &allocInfo, mDescriptorSets.data());
+        assert(result == VK_SUCCESS);
+
+        for (uint32_t level = 0; level < mLevelCount; level++)
+        {
+            VkDescriptorImageInfo srcInfo = {};
+            srcInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+            srcInfo.imageView = level == 0 ? depthView : mLevelViews[level - 1];
+            srcInfo.sampler = mSampler;
+
+            VkDescriptorImageInfo dstInfo = {};
+            dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            dstInfo.imageView = mLevelViews[level];
+            dstInfo.sampler = VK_NULL_HANDLE;
+
+            std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[0].dstSet = mDescriptorSets[level];
+            descriptorWrites[0].dstBinding = 0;
+            descriptorWrites[0].dstArrayElement = 0;
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[0].descriptorCount = 1;
+            descriptorWrites[0].pImageInfo = &srcInfo;
+
+            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[1].dstSet = mDescriptorSets[level];
+            descriptorWrites[1].dstBinding = 1;
+            descriptorWrites[1].dstArrayElement = 0;
+            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[1].descriptorCount = 1;
+            descriptorWrites[1].pImageInfo = &dstInfo;
+
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+    }
+
+    // create compute pipeline
+    {
+        VkDescriptorSetLayout setLayouts[] = { mDescriptorSetLayout };
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.pNext = nullptr;
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+
+        auto result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &mPLayout);
+        assert(result == VK_SUCCESS);
+
+        VKRenderer::getInstance().createComputePipeline("depthpyramid.comp.spv", mPLayout, mPipeline);
+    }
+}
+
+DepthPyramid::~DepthPyramid()
+{
+    auto device = VKRenderer::getInstance().getDevice();
+
+    vkDestroyPipeline(device, mPipeline, nullptr);
+    vkDestroyPipelineLayout(device, mPLayout, nullptr);
+    vkDestroyDescriptorPool(device, mDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, mDescriptorSetLayout, nullptr);
+    vkDestroySampler(device, mSampler, nullptr);
+    for (auto &levelView : mLevelViews)
+    {
+        vkDestroyImageView(device, levelView, nullptr);
+    }
+    vkDestroyImageView(device, mImageView, nullptr);
+    vkDestroyImage(device, mImage, nullptr);
+    vkFreeMemory(device, mImageMemory, nullptr);
+}
+
+void DepthPyramid::recordBuild(VkCommandBuffer cmdBuffer) const
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = mImage;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mLevelCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    // the cull pass of the previous frame may still read the old content, which is discarded
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.subresourceRange.levelCount = 1;
+
+    for (uint32_t level = 0; level < mLevelCount; level++)
+    {
+        uint32_t width = std::max(mWidth >> level, 1u);
+        uint32_t height = std::max(mHeight >> level, 1u);
+
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPLayout, 0, 1, &mDescriptorSets[level], 0, nullptr);
+        vkCmdDispatch(cmdBuffer, (width + GROUP_SIZE - 1) / GROUP_SIZE, (height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+        // read by the next level, and by the cull pass after the last one
+        barrier.subresourceRange.baseMipLevel = level;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+}
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cassert>
+
+#include "DescriptorAllocator.h"
+
+const uint32_t DescriptorAllocator::POOL_SET_COUNT = 64;
+const std::vector<VkDescriptorPoolSize> DescriptorAllocator::POOL_SIZES_PER_SET = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+};
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, uint32_t framesInFlight, bool useUpdateTemplates)
+    : mDevice(device)
+    , mTransientPools(framesInFlight)
+{
+    if (useUpdateTemplates)
+    {
+        mCreateDescriptorUpdateTemplate = (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(mDevice, "vkCreateDescriptorUpdateTemplateKHR");
+        mDestroyDescriptorUpdateTemplate = (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(mDevice, "vkDestroyDescriptorUpdateTemplateKHR");
+        mUpdateDescriptorSetWithTemplate = (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(mDevice, "vkUpdateDescriptorSetWithTemplateKHR");
+    }
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    // the renderer waited for the device, pending frees don't matter anymore
+    for (auto &updateTemplate : mUpdateTemplates)
+    {
+        if (updateTemplate.handle != VK_NULL_HANDLE)
+        {
+            mDestroyDescriptorUpdateTemplate(mDevice, updateTemplate.handle, nullptr);
+        }
+    }
+
+    for (auto &transientPools : mTransientPools)
+    {
+        for (auto pool : transientPools.pools)
+        {
+            vkDestroyDescriptorPool(mDevice, pool, nullptr);
+        }
+    }
+
+    for (auto pool : mPools)
+    {
+        vkDestroyDescriptorPool(mDevice, pool, nullptr);
+    }
+
+    for (auto &bucket : mLayouts)
+    {
+        for (auto &cached : bucket.second)
+        {
+            vkDestroyDescriptorSetLayout(mDevice, cached.layout, nullptr);
+        }
+    }
+}
+
+static bool operator==(const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+{
+    return a.binding == b.binding && a.descriptorType == b.descriptorType &&
+        a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags;
+}
+
+VkDescriptorSetLayout DescriptorAllocator::getLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount)
+{
+    // the signature is independent of the order the bindings are listed in
+    std::vector<VkDescriptorSetLayoutBinding> sorted(bindings, bindings + bindingCount);
+    std::sort(sorted.begin(), sorted.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+        return a.binding < b.binding;
+    });
+
+    // FNV-1a over the fields that make layouts compatible
+    uint64_t hash = 14695981039346656037ull;
+    auto combine = [&hash](uint32_t value) {
+        hash = (hash ^ value) * 1099511628211ull;
+    };
+    for (const auto &binding : sorted)
+    {
+        assert(binding.pImmutableSamplers == nullptr);
+        combine(binding.binding);
+        combine(static_cast<uint32_t>(binding.descriptorType));
+        combine(binding.descriptorCount);
+        combine(binding.stageFlags);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto &bucket = mLayouts[hash];
+    for (const auto &cached : bucket)
+    {
+        if (cached.bindings == sorted)
+        {
+            return cached.layout;
+        }
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(sorted.size());
+    layoutInfo.pBindings = sorted.data();
+
+    VkDescriptorSetLayout layout;
+    auto result = vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &layout);
+    assert(result == VK_SUCCESS);
+
+    bucket.push_back({ sorted, layout });
+    return layout;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(VkDescriptorPoolCreateFlags flags)
+{
+    std::vector<VkDescriptorPoolSize> poolSizes = POOL_SIZES_PER_SET;
+    for (auto &poolSize : poolSizes)
+    {
+        poolSize.descriptorCount *= POOL_SET_COUNT;
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = POOL_SET_COUNT;
+    poolInfo.flags = flags;
+
+    VkDescriptorPool pool;
+    auto result = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &pool);
+    assert(result == VK_SUCCESS);
+
+    return pool;
+}
+
+DescriptorAllocator::Allocation DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    // the newest pool has the most room, freed sets leave gaps in the older ones
+    Allocation allocation;
+    for (auto it = mPools.rbegin(); it != mPools.rend(); ++it)
+    {
+        allocInfo.descriptorPool = *it;
+        if (vkAllocateDescriptorSets(mDevice, &allocInfo, &allocation.set) == VK_SUCCESS)
+        {
+            allocation.pool = *it;
+            return allocation;
+        }
+    }
+
+    // out of pool memory or fragmented everywhere, Vulkan 1.0 drivers without
+    // VK_KHR_maintenance1 may report any error, a fresh pool has room either way
+    mPools.push_back(createPool(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT));
+    allocInfo.descriptorPool = mPools.back();
+
+    auto result = vkAllocateDescriptorSets(mDevice, &allocInfo, &allocation.set);
+    assert(result == VK_SUCCESS);
+
+    allocation.pool = mPools.back();
+    return allocation;
+}
+
+void DescriptorAllocator::free(const Allocation &allocation, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingFrees.push_back({ value, allocation });
+}
+
+void DescriptorAllocator::collect(uint64_t completedValue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mPendingFrees.begin();
+    while (it != mPendingFrees.end())
+    {
+        if (it->value <= completedValue)
+        {
+            vkFreeDescriptorSets(mDevice, it->allocation.pool, 1, &it->allocation.set);
+            it = mPendingFrees.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+VkDescriptorSet DescriptorAllocator::allocateTransient(VkDescriptorSetLayout layout, uint32_t frameIndex)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &transientPools = mTransientPools[frameIndex];
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    while (transientPools.current < transientPools.pools.size())
+    {
+        allocInfo.descriptorPool = transientPools.pools[transientPools.current];
+        if (vkAllocateDescriptorSets(mDevice, &allocInfo, &set) == VK_SUCCESS)
+        {
+            return set;
+        }
+        transientPools.current++;
+    }
+
+    // the slot keeps the pools it grew, later frames usually need as many
+    transientPools.pools.push_back(createPool(0));
+    allocInfo.descriptorPool = transientPools.pools.back();
+
+    auto result = vkAllocateDescriptorSets(mDevice, &allocInfo, &set);
+    assert(result == VK_SUCCESS);
+
+    return set;
+}
+
+void DescriptorAllocator::resetTransient(uint32_t frameIndex)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &transientPools = mTransientPools[frameIndex];
+
+    for (auto pool : transientPools.pools)
+    {
+        vkResetDescriptorPool(mDevice, pool, 0);
+    }
+    transientPools.current = 0;
+}
+
+const DescriptorAllocator::UpdateTemplate* DescriptorAllocator::createUpdateTemplate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorUpdateTemplateEntryKHR> &entries)
+{
+    UpdateTemplate updateTemplate;
+    updateTemplate.entries = entries;
+
+    if (mCreateDescriptorUpdateTemplate)
+    {
+        VkDescriptorUpdateTemplateCreateInfoKHR createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+        createInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        createInfo.pDescriptorUpdateEntries = entries.data();
+        createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+        createInfo.descriptorSetLayout = layout;
+
+        auto result = mCreateDescriptorUpdateTemplate(mDevice, &createInfo, nullptr, &updateTemplate.handle);
+        assert(result == VK_SUCCESS);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mUpdateTemplates.push_back(std::move(updateTemplate));
+    return &mUpdateTemplates.back();
+}
+
+void DescriptorAllocator::update(VkDescriptorSet set, const UpdateTemplate &updateTemplate, const void* data)
+{
+    if (updateTemplate.handle != VK_NULL_HANDLE)
+    {
+        mUpdateDescriptorSetWithTemplate(mDevice, set, updateTemplate.handle, data);
+        return;
+    }
+
+    // the same writes spelled out, one per descriptor since the infos may be strided
+    std::vector<VkWriteDescriptorSet> descriptorWrites;
+    for (const auto &entry : updateTemplate.entries)
+    {
+        for (uint32_t i = 0; i < entry.descriptorCount; i++)
+        {
+            const uint8_t* info = static_cast<const uint8_t*>(data) + entry.offset + i * entry.stride;
+
+            VkWriteDescriptorSet write = {};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = entry.dstBinding;
+            write.dstArrayElement = entry.dstArrayElement + i;
+            write.descriptorType = entry.descriptorType;
+            write.descriptorCount = 1;
+
+            switch (entry.descriptorType)
+            {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                write.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo*>(info);
+                break;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                write.pTexelBufferView = reinterpret_cast<const VkBufferView*>(info);
+                break;
+            default:
+                write.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo*>(info);
+                break;
+            }
+
+            descriptorWrites.push_back(write);
+        }
+    }
+
+    vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
@@ -0,0 +1,575 @@
+#ifdef HV_DRAW_BENCHMARK
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "Asset.h"
+#include "DrawBenchmark.h"
+#include "Logging.h"
+#include "SubmissionTracker.h"
+#include "VKRenderer.h"
+
+const uint32_t DrawBenchmark::TARGET_SIZE = 256;
+const uint32_t DrawBenchmark::MAX_DRAW_COUNT = 100000;
+
+DrawBenchmark::DrawBenchmark()
+{
+    auto &renderer = VKRenderer::getInstance();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(renderer.getPhysicalDevice(), &properties);
+
+    // 128 bytes are guaranteed, the transforms of a draw fit exactly
+    assert(properties.limits.maxPushConstantsSize >= sizeof(DrawTransforms));
+
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    mUniformStride = (sizeof(DrawTransforms) + alignment - 1) / alignment * alignment;
+    mTimestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer.getPhysicalDevice(), &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer.getPhysicalDevice(), &queueFamilyCount, queueFamilies.data());
+    mHasTimestamps = queueFamilies[renderer.getGraphicsQueueFamilyIndex()].timestampValidBits > 0;
+
+    // the triangles are spread over the target, the matrices differ so no driver can fold
+    // the draws together
+    mTransforms.resize(MAX_DRAW_COUNT);
+    for (uint32_t i = 0; i < MAX_DRAW_COUNT; i++)
+    {
+        auto &transforms = mTransforms[i];
+        transforms.model.fill(0.f);
+        transforms.model[0] = transforms.model[5] = transforms.model[10] = transforms.model[15] = 1.f;
+        transforms.model[12] = static_cast<float>(i % 317) / 317.f * 2.f - 1.f;
+        transforms.model[13] = static_cast<float>(i % 293) / 293.f * 2.f - 1.f;
+        transforms.model[14] = static_cast<float>(i) / static_cast<float>(MAX_DRAW_COUNT);
+
+        transforms.shadowTransform.fill(0.f);
+        transforms.shadowTransform[0] = transforms.shadowTransform[5] = transforms.shadowTransform[10] = transforms.shadowTransform[15] = 1.f;
+    }
+
+    // create depth target
+    {
+        renderer.createImage(TARGET_SIZE, TARGET_SIZE, VK_FORMAT_D16_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mDepthImage, mDepthImageMemory);
+        renderer.createImageView(mDepthImage, VK_FORMAT_D16_UNORM, VK_IMAGE_ASPECT_DEPTH_BIT, mDepthImageView);
+
+        VkAttachmentDescription depthAttachment = {};
+        depthAttachment.format = VK_FORMAT_D16_UNORM;
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef = {};
+        depthAttachmentRef.attachment = 0;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 0;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &depthAttachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+
+        auto result = vkCreateRenderPass(renderer.getDevice(), &renderPassInfo, nullptr, &mRenderPass);
+        assert(result == VK_SUCCESS);
+
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = mRenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &mDepthImageView;
+        framebufferInfo.width = TARGET_SIZE;
+        framebufferInfo.height = TARGET_SIZE;
+        framebufferInfo.layers = 1;
+
+        result = vkCreateFramebuffer(renderer.getDevice(), &framebufferInfo, nullptr, &mFramebuffer);
+        assert(result == VK_SUCCESS);
+
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2;
+
+        result = vkCreateQueryPool(renderer.getDevice(), &queryPoolInfo, nullptr, &mQueryPool);
+        assert(result == VK_SUCCESS);
+    }
+
+    // create buffers
+    {
+        const float vertices[] = {
+            0.f, 0.f, 0.f,
+            0.02f, 0.f, 0.f,
+            0.f, 0.02f, 0.f,
+        };
+
+        renderer.createBuffer(sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mVertexBuffer, mVertexBufferMemory);
+
+        void* data;
+        vkMapMemory(renderer.getDevice(), mVertexBufferMemory, 0, sizeof(vertices), 0, &data);
+        memcpy(data, vertices, sizeof(vertices));
+        vkUnmapMemory(renderer.getDevice(), mVertexBufferMemory);
+
+        renderer.createBuffer(mUniformStride * MAX_DRAW_COUNT, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mUniformBuffer, mUniformBufferMemory);
+        uploadTransforms(mUniformBuffer, mUniformStride);
+
+        renderer.createBuffer(sizeof(DrawTransforms) * MAX_DRAW_COUNT, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mStorageBuffer, mStorageBufferMemory);
+        uploadTransforms(mStorageBuffer, sizeof(DrawTransforms));
+    }
+
+    // create descriptor set layouts
+    {
+        VkDescriptorSetLayoutBinding uniformLayoutBinding = {};
+        uniformLayoutBinding.binding = 0;
+        uniformLayoutBinding.descriptorCount = 1;
+        uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        uniformLayoutBinding.pImmutableSamplers = nullptr;
+        uniformLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &uniformLayoutBinding;
+
+        auto result = vkCreateDescriptorSetLayout(renderer.getDevice(), &layoutInfo, nullptr, &mUniformSetLayout);
+        assert(result == VK_SUCCESS);
+
+        VkDescriptorSetLayoutBinding storageLayoutBinding = uniformLayoutBinding;
+        storageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutInfo.pBindings = &storageLayoutBinding;
+
+        result = vkCreateDescriptorSetLayout(renderer.getDevice(), &layoutInfo, nullptr, &mStorageSetLayout);
+        assert(result == VK_SUCCESS);
+    }
+
+    // create descriptor sets
+    {
+        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSizes[0].descriptorCount = 1;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 2;
+
+        auto result = vkCreateDescriptorPool(renderer.getDevice(), &poolInfo, nullptr, &mDescriptorPool);
+        assert(result == VK_SUCCESS);
+
+        VkDescriptorSetLayout layouts[] = { mUniformSetLayout, mStorageSetLayout };
+        VkDescriptorSet sets[2];
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = mDescriptorPool;
+        allocInfo.descriptorSetCount = 2;
+        allocInfo.pSetLayouts = layouts;
+
+        result = vkAllocateDescriptorSets(renderer.getDevice(), &allocInfo, sets);
+        assert(result == VK_SUCCESS);
+        mUniformSet = sets[0];
+        mStorageSet = sets[1];
+
+        // the dynamic offset picks the draw, the range covers one
+        VkDescriptorBufferInfo uniformInfo = {};
+        uniformInfo.buffer = mUniformBuffer;
+        uniformInfo.offset = 0;
+        uniformInfo.range = sizeof(DrawTransforms);
+
+        VkDescriptorBufferInfo storageInfo = {};
+        storageInfo.buffer = mStorageBuffer;
+        storageInfo.offset = 0;
+        storageInfo.range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = mUniformSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &uniformInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = mStorageSet;
+        descriptorWrites[1].dstBinding = 0;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &storageInfo;
+
+        vkUpdateDescriptorSets(renderer.getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    createPipeline(PATH_PUSH_CONSTANTS, "drawpush.vert.spv");
+    createPipeline(PATH_DYNAMIC_UNIFORM, "drawuniform.vert.spv");
+    createPipeline(PATH_STORAGE_BUFFER, "drawstorage.vert.spv");
+}
+
+DrawBenchmark::~DrawBenchmark()
+{
+    auto device = VKRenderer::getInstance().getDevice();
+
+    for (uint32_t i = 0; i < PATH_COUNT; i++)
+    {
+        vkDestroyPipeline(device, mPipelines[i], nullptr);
+        vkDestroyPipelineLayout(device, mPLayouts[i], nullptr);
+    }
+
+    vkDestroyDescriptorPool(device, mDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, mUniformSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, mStorageSetLayout, nullptr);
+
+    vkDestroyBuffer(device, mStorageBuffer, nullptr);
+    vkFreeMemory(device, mStorageBufferMemory, nullptr);
+    vkDestroyBuffer(device, mUniformBuffer, nullptr);
+    vkFreeMemory(device, mUniformBufferMemory, nullptr);
+    vkDestroyBuffer(device, mVertexBuffer, nullptr);
+    vkFreeMemory(device, mVertexBufferMemory, nullptr);
+
+    vkDestroyQueryPool(device, mQueryPool, nullptr);
+    vkDestroyFramebuffer(device, mFramebuffer, nullptr);
+    vkDestroyRenderPass(device, mRenderPass, nullptr);
+    vkDestroyImageView(device, mDepthImageView, nullptr);
+    vkDestroyImage(device, mDepthImage, nullptr);
+    vkFreeMemory(device, mDepthImageMemory, nullptr);
+}
+
+void DrawBenchmark::run()
+{
+    const char* pathNames[PATH_COUNT] = { "push constants", "dynamic uniform", "storage buffer" };
+    const uint32_t drawCounts[] = { 1000, 10000, 100000 };
+
+    for (uint32_t drawCount : drawCounts)
+    {
+        for (uint32_t path = 0; path < PATH_COUNT; path++)
+        {
+            float recordMilliseconds = 0.f;
+            float gpuMilliseconds = 0.f;
+
+            // the first round warms up the pipeline and the driver's command memory
+            measure(static_cast<Path>(path), drawCount, recordMilliseconds, gpuMilliseconds);
+            if (measure(static_cast<Path>(path), drawCount, recordMilliseconds, gpuMilliseconds))
+            {
+                LOGI("draw benchmark: %u draws, %s record %.3f ms, gpu %.3f ms\n", drawCount, pathNames[path], recordMilliseconds, gpuMilliseconds);
+            }
+            else
+            {
+                LOGI("draw benchmark: %u draws, %s record %.3f ms\n", drawCount, pathNames[path], recordMilliseconds);
+            }
+        }
+    }
+}
+
+void DrawBenchmark::createPipeline(Path path, const char* shaderName)
+{
+    auto device = VKRenderer::getInstance().getDevice();
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawTransforms);
+
+    // the transforms come through push constants or through set 0, depending on the path
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.pNext = nullptr;
+    if (path == PATH_PUSH_CONSTANTS)
+    {
+        pipelineLayoutCreateInfo.setLayoutCount = 0;
+        pipelineLayoutCreateInfo.pSetLayouts = nullptr;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    }
+    else
+    {
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = path == PATH_DYNAMIC_UNIFORM ? &mUniformSetLayout : &mStorageSetLayout;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+    }
+
+    auto result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &mPLayouts[path]);
+    assert(result == VK_SUCCESS);
+
+    Asset vs(shaderName, 0);
+    auto size = vs.getLength();
+    std::vector<uint8_t> vsData(size);
+    vs.read(vsData.data(), size);
+    vs.close();
+
+    VkShaderModule vertexShader;
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.pNext = nullptr;
+    shaderModuleCreateInfo.codeSize = vsData.size();
+    shaderModuleCreateInfo.pCode = (const uint32_t*)(vsData.data());
+    shaderModuleCreateInfo.flags = 0;
+
+    result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &vertexShader);
+    assert(result == VK_SUCCESS);
+
+    VkPipelineShaderStageCreateInfo shaderStage = {};
+    shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStage.pNext = nullptr;
+    shaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStage.module = vertexShader;
+    shaderStage.pSpecializationInfo = nullptr;
+    shaderStage.flags = 0;
+    shaderStage.pName = "main";
+
+    VkViewport viewports;
+    viewports.minDepth = 0.0f;
+    viewports.maxDepth = 1.0f;
+    viewports.x = 0;
+    viewports.y = 0;
+    viewports.width = static_cast<float>(TARGET_SIZE);
+    viewports.height = static_cast<float>(TARGET_SIZE);
+
+    VkRect2D scissor;
+    scissor.extent.width = TARGET_SIZE;
+    scissor.extent.height = TARGET_SIZE;
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+
+    VkPipelineViewportStateCreateInfo viewportInfo{};
+    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportInfo.pNext = nullptr;
+    viewportInfo.viewportCount = 1;
+    viewportInfo.pViewports = &viewports;
+    viewportInfo.scissorCount = 1;
+    viewportInfo.pScissors = &scissor;
+
+    VkSampleMask sampleMask = ~0u;
+    VkPipelineMultisampleStateCreateInfo multisampleInfo{};
+    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleInfo.pNext = nullptr;
+    multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampleInfo.sampleShadingEnable = VK_FALSE;
+    multisampleInfo.minSampleShading = 0;
+    multisampleInfo.pSampleMask = &sampleMask;
+    multisampleInfo.alphaToCoverageEnable = VK_FALSE;
+    multisampleInfo.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineRasterizationStateCreateInfo rasterInfo{};
+    rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterInfo.pNext = nullptr;
+    rasterInfo.depthClampEnable = VK_FALSE;
+    rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+    rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterInfo.cullMode = VK_CULL_MODE_NONE;
+    rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterInfo.depthBiasEnable = VK_FALSE;
+    rasterInfo.lineWidth = 1;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyInfo.pNext = nullptr;
+    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    VkVertexInputBindingDescription bindingDescription = {};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = 3 * sizeof(float);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription attributeDescription = {};
+    attributeDescription.binding = 0;
+    attributeDescription.location = 0;
+    attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescription.offset = 0;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.pNext = nullptr;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexAttributeDescriptions = &attributeDescription;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.minDepthBounds = 0.f;
+    depthStencil.maxDepthBounds = 0.f;
+    depthStencil.stencilTestEnable = VK_FALSE;
+    depthStencil.front = {};
+    depthStencil.back = {};
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.pNext = nullptr;
+    pipelineCreateInfo.flags = 0;
+    pipelineCreateInfo.stageCount = 1;
+    pipelineCreateInfo.pStages = &shaderStage;
+    pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyInfo;
+    pipelineCreateInfo.pTessellationState = nullptr;
+    pipelineCreateInfo.pViewportState = &viewportInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencil;
+    pipelineCreateInfo.pColorBlendState = nullptr;
+    pipelineCreateInfo.pDynamicState = nullptr;
+    pipelineCreateInfo.layout = mPLayouts[path];
+    pipelineCreateInfo.renderPass = mRenderPass;
+    pipelineCreateInfo.subpass = 0;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCreateInfo.basePipelineIndex = 0;
+
+    result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &mPipelines[path]);
+    assert(result == VK_SUCCESS);
+
+    vkDestroyShaderModule(device, vertexShader, nullptr);
+}
+
+void DrawBenchmark::uploadTransforms(VkBuffer buffer, VkDeviceSize stride)
+{
+    auto &renderer = VKRenderer::getInstance();
+    VkDeviceSize size = stride * MAX_DRAW_COUNT;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    renderer.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(renderer.getDevice(), stagingBufferMemory, 0, size, 0, &data);
+    for (uint32_t i = 0; i < MAX_DRAW_COUNT; i++)
+    {
+        memcpy(static_cast<uint8_t*>(data) + stride * i, &mTransforms[i], sizeof(DrawTransforms));
+    }
+    vkUnmapMemory(renderer.getDevice(), stagingBufferMemory);
+
+    renderer.copyBuffer(stagingBuffer, buffer, size);
+
+    vkDestroyBuffer(renderer.getDevice(), stagingBuffer, nullptr);
+    vkFreeMemory(renderer.getDevice(), stagingBufferMemory, nullptr);
+}
+
+bool DrawBenchmark::measure(Path path, uint32_t drawCount, float &recordMilliseconds, float &gpuMilliseconds)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto &renderer = VKRenderer::getInstance();
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = renderer.getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer cmdBuffer;
+    auto result = vkAllocateCommandBuffers(renderer.getDevice(), &allocInfo, &cmdBuffer);
+    assert(result == VK_SUCCESS);
+
+    auto start = Clock::now();
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmdBuffer, &beginInfo);
+
+    if (mHasTimestamps)
+    {
+        vkCmdResetQueryPool(cmdBuffer, mQueryPool, 0, 2);
+        vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool, 0);
+    }
+
+    VkClearValue clearValue = {};
+    clearValue.depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = mRenderPass;
+    renderPassBeginInfo.framebuffer = mFramebuffer;
+    renderPassBeginInfo.renderArea.offset = { 0, 0 };
+    renderPassBeginInfo.renderArea.extent = { TARGET_SIZE, TARGET_SIZE };
+    renderPassBeginInfo.clearValueCount = 1;
+    renderPassBeginInfo.pClearValues = &clearValue;
+    vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelines[path]);
+
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &mVertexBuffer, &offset);
+
+    switch (path)
+    {
+    case PATH_PUSH_CONSTANTS:
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            vkCmdPushConstants(cmdBuffer, mPLayouts[path], VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawTransforms), &mTransforms[i]);
+            vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+        }
+        break;
+    case PATH_DYNAMIC_UNIFORM:
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            uint32_t dynamicOffset = static_cast<uint32_t>(mUniformStride * i);
+            vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPLayouts[path], 0, 1, &mUniformSet, 1, &dynamicOffset);
+            vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+        }
+        break;
+    default:
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPLayouts[path], 0, 1, &mStorageSet, 0, nullptr);
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            vkCmdDraw(cmdBuffer, 3, 1, 0, i);
+        }
+        break;
+    }
+
+    vkCmdEndRenderPass(cmdBuffer);
+
+    if (mHasTimestamps)
+    {
+        vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, 1);
+    }
+
+    result = vkEndCommandBuffer(cmdBuffer);
+    assert(result == VK_SUCCESS);
+
+    recordMilliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuffer;
+
+    auto &tracker = renderer.getGraphicsTracker();
+    tracker.wait(tracker.submit(submitInfo));
+
+    vkFreeCommandBuffers(renderer.getDevice(), renderer.getCommandPool(), 1, &cmdBuffer);
+
+    if (!mHasTimestamps)
+    {
+        return false;
+    }
+
+    uint64_t timestamps[2];
+    result = vkGetQueryPoolResults(renderer.getDevice(), mQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    assert(result == VK_SUCCESS);
+
+    gpuMilliseconds = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * mTimestampPeriod / 1e6);
+    return true;
+}
+#endif
@@ -0,0 +1,769 @@
+#include <algorithm>
+#include <cassert>
+#include "FrameGraph.h"
+#include "Logging.h"
+
+static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+FrameGraph::FrameGraph(VkDevice device, VkPhysicalDevice physicalDevice)
+    : mDevice(device)
+    , mPhysicalDevice(physicalDevice)
+{
+
+}
+
+FrameGraph::~FrameGraph()
+{
+    for (auto &pass : mPasses)
+    {
+        for (auto &framebuffer : pass.framebuffers)
+        {
+            vkDestroyFramebuffer(mDevice, framebuffer, nullptr);
+        }
+
+        if (pass.renderPass != VK_NULL_HANDLE)
+        {
+            vkDestroyRenderPass(mDevice, pass.renderPass, nullptr);
+        }
+    }
+
+    for (auto &resource : mResources)
+    {
+        if (resource.imported)
+        {
+            continue;
+        }
+
+        for (auto &imageView : resource.imageViews)
+        {
+            vkDestroyImageView(mDevice, imageView, nullptr);
+        }
+
+        for (auto &image : resource.images)
+        {
+            vkDestroyImage(mDevice, image, nullptr);
+        }
+    }
+
+    for (auto &block : mMemoryBlocks)
+    {
+        vkFreeMemory(mDevice, block.memory, nullptr);
+    }
+}
+
+FrameGraph::Resource FrameGraph::createImage(const std::string &name, VkFormat format, uint32_t width, uint32_t height)
+{
+    assert(!mCompiled);
+
+    ImageResource resource{};
+    resource.name = name;
+    resource.format = format;
+    resource.width = width;
+    resource.height = height;
+    resource.imported = false;
+    resource.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.initialStage = 0;
+    resource.finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    mResources.push_back(resource);
+    return static_cast<Resource>(mResources.size() - 1);
+}
+
+FrameGraph::Resource FrameGraph::importImages(const std::string &name, VkFormat format, uint32_t width, uint32_t height,
+    const std::vector<VkImage> &images, const std::vector<VkImageView> &imageViews,
+    VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout)
+{
+    assert(!mCompiled);
+    assert(!images.empty() && images.size() == imageViews.size());
+
+    ImageResource resource{};
+    resource.name = name;
+    resource.format = format;
+    resource.width = width;
+    resource.height = height;
+    resource.imported = true;
+    resource.initialLayout = initialLayout;
+    resource.initialStage = initialStage;
+    resource.finalLayout = finalLayout;
+    resource.images = images;
+    resource.imageViews = imageViews;
+
+    mResources.push_back(resource);
+    return static_cast<Resource>(mResources.size() - 1);
+}
+
+FrameGraph::Pass FrameGraph::addPass(const std::string &name, VkSubpassContents contents, const ExecuteFunction &execute)
+{
+    assert(!mCompiled);
+
+    PassNode pass;
+    pass.name = name;
+    pass.contents = contents;
+    pass.execute = execute;
+
+    mPasses.push_back(pass);
+    return static_cast<Pass>(mPasses.size() - 1);
+}
+
+void FrameGraph::addColorOutput(Pass pass, Resource resource, VkClearColorValue clearValue)
+{
+    Access access{};
+    access.resource = resource;
+    access.usage = USAGE_COLOR_ATTACHMENT;
+    access.stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    access.clearValue.color = clearValue;
+
+    mPasses[pass].accesses.push_back(access);
+}
+
+void FrameGraph::setDepthOutput(Pass pass, Resource resource, VkClearDepthStencilValue clearValue)
+{
+    for (auto &access : mPasses[pass].accesses)
+    {
+        assert(access.usage != USAGE_DEPTH_ATTACHMENT);
+    }
+
+    Access access{};
+    access.resource = resource;
+    access.usage = USAGE_DEPTH_ATTACHMENT;
+    access.stageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    access.clearValue.depthStencil = clearValue;
+
+    mPasses[pass].accesses.push_back(access);
+}
+
+void FrameGraph::addSampledInput(Pass pass, Resource resource, VkPipelineStageFlags stageMask)
+{
+    Access access{};
+    access.resource = resource;
+    access.usage = USAGE_SAMPLED;
+    access.stageMask = stageMask;
+
+    mPasses[pass].accesses.push_back(access);
+}
+
+void FrameGraph::setSideEffects(Pass pass)
+{
+    mPasses[pass].sideEffects = true;
+}
+
+void FrameGraph::compile()
+{
+    assert(!mCompiled);
+
+    cullPasses();
+    allocateImages();
+    createRenderPasses();
+    computeBarriers();
+
+    mCompiled = true;
+}
+
+void FrameGraph::execute(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
+{
+    execute(cmdBuffer, imageIndex, 0, getPassCount());
+}
+
+void FrameGraph::execute(VkCommandBuffer cmdBuffer, uint32_t imageIndex, Pass firstPass, Pass endPass)
+{
+    assert(mCompiled && firstPass <= endPass && endPass <= getPassCount());
+
+    for (Pass passIndex = firstPass; passIndex < endPass; passIndex++)
+    {
+        auto &pass = mPasses[passIndex];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        recordBarrier(cmdBuffer, pass.barrier, imageIndex);
+
+        if (pass.renderPass == VK_NULL_HANDLE)
+        {
+            pass.execute(cmdBuffer, imageIndex);
+            continue;
+        }
+
+        VkRenderPassBeginInfo renderPassBeginInfo{};
+        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBeginInfo.pNext = nullptr;
+        renderPassBeginInfo.renderPass = pass.renderPass;
+        renderPassBeginInfo.framebuffer = pass.framebuffers[imageIndex % pass.framebuffers.size()];
+        renderPassBeginInfo.renderArea.offset.x = 0;
+        renderPassBeginInfo.renderArea.offset.y = 0;
+        renderPassBeginInfo.renderArea.extent = pass.extent;
+        renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+        renderPassBeginInfo.pClearValues = pass.clearValues.data();
+
+        vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, pass.contents);
+        pass.execute(cmdBuffer, imageIndex);
+        vkCmdEndRenderPass(cmdBuffer);
+    }
+
+    if (endPass == getPassCount())
+    {
+        recordBarrier(cmdBuffer, mFinalBarrier, imageIndex);
+    }
+}
+
+VkRenderPass FrameGraph::getRenderPass(Pass pass) const
+{
+    assert(mCompiled && !mPasses[pass].culled);
+    return mPasses[pass].renderPass;
+}
+
+VkFramebuffer FrameGraph::getFramebuffer(Pass pass, uint32_t imageIndex) const
+{
+    assert(mCompiled && !mPasses[pass].culled);
+    auto &framebuffers = mPasses[pass].framebuffers;
+    return framebuffers[imageIndex % framebuffers.size()];
+}
+
+VkImageView FrameGraph::getImageView(Resource resource) const
+{
+    assert(mCompiled && !mResources[resource].imageViews.empty());
+    return mResources[resource].imageViews[0];
+}
+
+bool FrameGraph::isCulled(Pass pass) const
+{
+    assert(mCompiled);
+    return mPasses[pass].culled;
+}
+
+VkImageLayout FrameGraph::getLayout(Usage usage)
+{
+    switch (usage)
+    {
+    case USAGE_COLOR_ATTACHMENT:
+        return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    case USAGE_DEPTH_ATTACHMENT:
+        return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    default:
+        return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+}
+
+VkAccessFlags FrameGraph::getAccessMask(Usage usage)
+{
+    switch (usage)
+    {
+    case USAGE_COLOR_ATTACHMENT:
+        return VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    case USAGE_DEPTH_ATTACHMENT:
+        return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    default:
+        return VK_ACCESS_SHADER_READ_BIT;
+    }
+}
+
+VkImageAspectFlags FrameGraph::getAspectMask(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+// Walks the passes backwards from the ones writing imported images or having side effects. A
+// pass survives when it writes something a surviving pass reads, either by sampling it or by
+// loading the attachment.
+void FrameGraph::cullPasses()
+{
+    std::vector<bool> needed(mResources.size(), false);
+
+    for (uint32_t passIndex = static_cast<uint32_t>(mPasses.size()); passIndex-- > 0; )
+    {
+        auto &pass = mPasses[passIndex];
+
+        pass.culled = !pass.sideEffects;
+        for (auto &access : pass.accesses)
+        {
+            if (access.usage != USAGE_SAMPLED && (mResources[access.resource].imported || needed[access.resource]))
+            {
+                pass.culled = false;
+            }
+        }
+
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        for (auto &access : pass.accesses)
+        {
+            if (access.usage == USAGE_SAMPLED)
+            {
+                needed[access.resource] = true;
+                continue;
+            }
+
+            // attachments written before are loaded, otherwise cleared
+            bool loads = false;
+            for (uint32_t earlier = 0; earlier < passIndex; earlier++)
+            {
+                for (auto &earlierAccess : mPasses[earlier].accesses)
+                {
+                    loads |= earlierAccess.resource == access.resource && earlierAccess.usage != USAGE_SAMPLED;
+                }
+            }
+            needed[access.resource] = loads;
+        }
+    }
+
+    for (auto &pass : mPasses)
+    {
+        if (pass.culled)
+        {
+            LOGI("frame graph: culled pass %s\n", pass.name.c_str());
+        }
+    }
+}
+
+// Transient images are placed into memory blocks in order of first use. An image joins a
+// block when everything already in it is dead by the time the image is first used.
+void FrameGraph::allocateImages()
+{
+    for (auto &resource : mResources)
+    {
+        resource.usage = 0;
+        resource.firstPass = INVALID_INDEX;
+        resource.lastPass = INVALID_INDEX;
+        resource.memoryBlock = INVALID_INDEX;
+    }
+
+    for (uint32_t passIndex = 0; passIndex < mPasses.size(); passIndex++)
+    {
+        if (mPasses[passIndex].culled)
+        {
+            continue;
+        }
+
+        for (auto &access : mPasses[passIndex].accesses)
+        {
+            auto &resource = mResources[access.resource];
+            if (resource.firstPass == INVALID_INDEX)
+            {
+                resource.firstPass = passIndex;
+            }
+            resource.lastPass = passIndex;
+
+            switch (access.usage)
+            {
+            case USAGE_COLOR_ATTACHMENT:
+                resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                break;
+            case USAGE_DEPTH_ATTACHMENT:
+                resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                break;
+            default:
+                resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+                break;
+            }
+        }
+    }
+
+    std::vector<Resource> transients;
+    for (Resource resourceIndex = 0; resourceIndex < mResources.size(); resourceIndex++)
+    {
+        auto &resource = mResources[resourceIndex];
+        if (!resource.imported && resource.firstPass != INVALID_INDEX)
+        {
+            transients.push_back(resourceIndex);
+        }
+    }
+
+    std::stable_sort(transients.begin(), transients.end(), [this](Resource a, Resource b) {
+        return mResources[a].firstPass < mResources[b].firstPass;
+    });
+
+    for (auto &resourceIndex : transients)
+    {
+        auto &resource = mResources[resourceIndex];
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = resource.width;
+        imageInfo.extent.height = resource.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = resource.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = resource.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.flags = 0;
+
+        VkImage image;
+        auto result = vkCreateImage(mDevice, &imageInfo, nullptr, &image);
+        assert(result == VK_SUCCESS);
+        resource.images.push_back(image);
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(mDevice, image, &memRequirements);
+
+        for (uint32_t blockIndex = 0; blockIndex < mMemoryBlocks.size(); blockIndex++)
+        {
+            auto &block = mMemoryBlocks[blockIndex];
+            if (mResources[block.resources.back()].lastPass < resource.firstPass && (block.memoryTypeBits & memRequirements.memoryTypeBits))
+            {
+                block.size = std::max(block.size, memRequirements.size);
+                block.memoryTypeBits &= memRequirements.memoryTypeBits;
+                block.resources.push_back(resourceIndex);
+                resource.memoryBlock = blockIndex;
+                break;
+            }
+        }
+
+        if (resource.memoryBlock == INVALID_INDEX)
+        {
+            MemoryBlock block;
+            block.memory = VK_NULL_HANDLE;
+            block.size = memRequirements.size;
+            block.memoryTypeBits = memRequirements.memoryTypeBits;
+            block.resources.push_back(resourceIndex);
+
+            resource.memoryBlock = static_cast<uint32_t>(mMemoryBlocks.size());
+            mMemoryBlocks.push_back(block);
+        }
+    }
+
+    for (auto &block : mMemoryBlocks)
+    {
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = block.size;
+        allocInfo.memoryTypeIndex = findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        auto result = vkAllocateMemory(mDevice, &allocInfo, nullptr, &block.memory);
+        ASSERT_VK_SUCCESS(result);
+
+        for (auto &resourceIndex : block.resources)
+        {
+            auto &resource = mResources[resourceIndex];
+
+            result = vkBindImageMemory(mDevice, resource.images[0], block.memory, 0);
+            ASSERT_VK_SUCCESS(result);
+
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.images[0];
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.format;
+            viewInfo.subresourceRange.aspectMask = getAspectMask(resource.format) & ~VK_IMAGE_ASPECT_STENCIL_BIT;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            VkImageView imageView;
+            result = vkCreateImageView(mDevice, &viewInfo, nullptr, &imageView);
+            ASSERT_VK_SUCCESS(result);
+            resource.imageViews.push_back(imageView);
+        }
+    }
+
+    LOGI("frame graph: %u transient images in %u memory blocks\n", static_cast<uint32_t>(transients.size()), static_cast<uint32_t>(mMemoryBlocks.size()));
+}
+
+void FrameGraph::createRenderPasses()
+{
+    for (uint32_t passIndex = 0; passIndex < mPasses.size(); passIndex++)
+    {
+        auto &pass = mPasses[passIndex];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<VkAttachmentReference> colorReferences;
+        VkAttachmentReference depthReference{};
+        bool hasDepth = false;
+        std::vector<Resource> attachedResources;
+        uint32_t framebufferCount = 1;
+
+        for (auto &access : pass.accesses)
+        {
+            if (access.usage == USAGE_SAMPLED)
+            {
+                continue;
+            }
+
+            auto &resource = mResources[access.resource];
+
+            bool loads = false;
+            for (uint32_t earlier = 0; earlier < passIndex; earlier++)
+            {
+                for (auto &earlierAccess : mPasses[earlier].accesses)
+                {
+                    loads |= !mPasses[earlier].culled && earlierAccess.resource == access.resource && earlierAccess.usage != USAGE_SAMPLED;
+                }
+            }
+            bool stores = resource.imported || resource.lastPass > passIndex;
+
+            // layouts are handled by the barriers around the render pass
+            VkAttachmentDescription attachment{};
+            attachment.format = resource.format;
+            attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            attachment.loadOp = loads ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachment.storeOp = stores ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.initialLayout = getLayout(access.usage);
+            attachment.finalLayout = getLayout(access.usage);
+
+            VkAttachmentReference reference{};
+            reference.attachment = static_cast<uint32_t>(attachments.size());
+            reference.layout = getLayout(access.usage);
+
+            if (access.usage == USAGE_DEPTH_ATTACHMENT)
+            {
+                depthReference = reference;
+                hasDepth = true;
+            }
+            else
+            {
+                colorReferences.push_back(reference);
+            }
+
+            attachments.push_back(attachment);
+            attachedResources.push_back(access.resource);
+            pass.clearValues.push_back(access.clearValue);
+
+            assert(pass.extent.width == 0 || (pass.extent.width == resource.width && pass.extent.height == resource.height));
+            pass.extent.width = resource.width;
+            pass.extent.height = resource.height;
+
+            framebufferCount = std::max(framebufferCount, static_cast<uint32_t>(resource.imageViews.size()));
+        }
+
+        if (attachments.empty())
+        {
+            continue;
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+        subpass.pColorAttachments = colorReferences.data();
+        subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+        VkRenderPassCreateInfo renderPassCreateInfo{};
+        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassCreateInfo.pNext = nullptr;
+        renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassCreateInfo.pAttachments = attachments.data();
+        renderPassCreateInfo.subpassCount = 1;
+        renderPassCreateInfo.pSubpasses = &subpass;
+        renderPassCreateInfo.dependencyCount = 0;
+        renderPassCreateInfo.pDependencies = nullptr;
+
+        auto result = vkCreateRenderPass(mDevice, &renderPassCreateInfo, nullptr, &pass.renderPass);
+        assert(result == VK_SUCCESS);
+
+        pass.framebuffers.resize(framebufferCount);
+        for (uint32_t framebufferIndex = 0; framebufferIndex < framebufferCount; framebufferIndex++)
+        {
+            std::vector<VkImageView> imageViews;
+            for (auto &resourceIndex : attachedResources)
+            {
+                auto &views = mResources[resourceIndex].imageViews;
+                imageViews.push_back(views[framebufferIndex % views.size()]);
+            }
+
+            VkFramebufferCreateInfo fbCreateInfo = {};
+            fbCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            fbCreateInfo.renderPass = pass.renderPass;
+            fbCreateInfo.layers = 1;
+            fbCreateInfo.attachmentCount = static_cast<uint32_t>(imageViews.size());
+            fbCreateInfo.pAttachments = imageViews.data();
+            fbCreateInfo.width = pass.extent.width;
+            fbCreateInfo.height = pass.extent.height;
+
+            result = vkCreateFramebuffer(mDevice, &fbCreateInfo, nullptr, &pass.framebuffers[framebufferIndex]);
+            assert(result == VK_SUCCESS);
+        }
+    }
+}
+
+// Every frame starts from where the previous one left off. Imported images enter in their
+// declared state, transient images inherit the last use of whatever image shared their memory.
+void FrameGraph::computeBarriers()
+{
+    std::vector<State> endStates(mResources.size(), State{ VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0 });
+    for (auto &pass : mPasses)
+    {
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        for (auto &access : pass.accesses)
+        {
+            auto &state = endStates[access.resource];
+            if (access.usage == USAGE_SAMPLED)
+            {
+                state.readStages |= access.stageMask;
+            }
+            else
+            {
+                state.writeStages = access.stageMask;
+                state.writeAccess = getAccessMask(access.usage);
+                state.readStages = 0;
+            }
+        }
+    }
+
+    std::vector<State> states(mResources.size());
+    for (Resource resourceIndex = 0; resourceIndex < mResources.size(); resourceIndex++)
+    {
+        auto &resource = mResources[resourceIndex];
+        if (resource.imported)
+        {
+            states[resourceIndex] = State{ resource.initialLayout, resource.initialStage, 0, 0, 0 };
+        }
+        else if (resource.memoryBlock != INVALID_INDEX)
+        {
+            auto &blockResources = mMemoryBlocks[resource.memoryBlock].resources;
+            auto it = std::find(blockResources.begin(), blockResources.end(), resourceIndex);
+            Resource previous = it == blockResources.begin() ? blockResources.back() : *(it - 1);
+
+            states[resourceIndex] = endStates[previous];
+            states[resourceIndex].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            states[resourceIndex].visibleStages = 0;
+        }
+    }
+
+    for (auto &pass : mPasses)
+    {
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        for (auto &access : pass.accesses)
+        {
+            assert(access.usage != USAGE_SAMPLED || states[access.resource].layout != VK_IMAGE_LAYOUT_UNDEFINED);
+
+            addBarrier(pass.barrier, access.resource, states[access.resource], getLayout(access.usage),
+                access.stageMask, getAccessMask(access.usage), access.usage != USAGE_SAMPLED);
+        }
+    }
+
+    for (Resource resourceIndex = 0; resourceIndex < mResources.size(); resourceIndex++)
+    {
+        auto &resource = mResources[resourceIndex];
+        if (resource.imported && resource.finalLayout != states[resourceIndex].layout)
+        {
+            addBarrier(mFinalBarrier, resourceIndex, states[resourceIndex], resource.finalLayout,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, false);
+        }
+    }
+}
+
+void FrameGraph::addBarrier(Barrier &barrier, Resource resource, State &state, VkImageLayout layout, VkPipelineStageFlags stageMask, VkAccessFlags accessMask, bool isWrite)
+{
+    bool layoutChange = state.layout != layout;
+
+    // reads after reads in the same layout and reads of already visible writes need nothing
+    bool needed;
+    VkPipelineStageFlags srcStageMask;
+    if (isWrite)
+    {
+        needed = layoutChange || state.writeStages != 0 || state.readStages != 0;
+        srcStageMask = state.writeStages | state.readStages;
+    }
+    else
+    {
+        needed = layoutChange || (state.writeAccess != 0 && (stageMask & ~state.visibleStages) != 0);
+        srcStageMask = state.writeStages | (layoutChange ? state.readStages : 0);
+    }
+
+    if (needed)
+    {
+        VkImageMemoryBarrier imageBarrier = {};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.oldLayout = state.layout;
+        imageBarrier.newLayout = layout;
+        imageBarrier.srcAccessMask = state.writeAccess & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+        imageBarrier.dstAccessMask = accessMask;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = VK_NULL_HANDLE;
+        imageBarrier.subresourceRange.aspectMask = getAspectMask(mResources[resource].format);
+        imageBarrier.subresourceRange.baseMipLevel = 0;
+        imageBarrier.subresourceRange.levelCount = 1;
+        imageBarrier.subresourceRange.baseArrayLayer = 0;
+        imageBarrier.subresourceRange.layerCount = 1;
+
+        barrier.srcStageMask |= srcStageMask != 0 ? srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        barrier.dstStageMask |= stageMask;
+        barrier.imageBarriers.push_back(imageBarrier);
+        barrier.resources.push_back(resource);
+    }
+
+    if (isWrite)
+    {
+        state.writeStages = stageMask;
+        state.writeAccess = accessMask;
+        state.readStages = 0;
+        state.visibleStages = 0;
+    }
+    else
+    {
+        state.readStages |= stageMask;
+        if (needed)
+        {
+            state.visibleStages |= stageMask;
+        }
+    }
+    state.layout = layout;
+}
+
+void FrameGraph::recordBarrier(VkCommandBuffer cmdBuffer, const Barrier &barrier, uint32_t imageIndex)
+{
+    if (barrier.imageBarriers.empty())
+    {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> imageBarriers = barrier.imageBarriers;
+    for (uint32_t i = 0; i < imageBarriers.size(); i++)
+    {
+        auto &images = mResources[barrier.resources[i]].images;
+        imageBarriers[i].image = images[imageIndex % images.size()];
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer, barrier.srcStageMask, barrier.dstStageMask, 0,
+        0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+uint32_t FrameGraph::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &memProperties);
+
+    uint32_t memoryTypeIndex;
+    for (memoryTypeIndex = 0; memoryTypeIndex < memProperties.memoryTypeCount; memoryTypeIndex++) {
+        if ((typeFilter & (1 << memoryTypeIndex)) && (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & properties) == properties)
+        {
+            break;
+        }
+    }
+    assert(memoryTypeIndex != memProperties.memoryTypeCount);
+
+    return memoryTypeIndex;
+}
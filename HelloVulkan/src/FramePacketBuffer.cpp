@@ -0,0 +1,69 @@
+#include <cassert>
+#include "FramePacketBuffer.h"
+
+FramePacketBuffer::FramePacketBuffer(uint32_t maxLatency)
+    : mMaxLatency(maxLatency)
+{
+    assert(mMaxLatency > 0);
+}
+
+void FramePacketBuffer::publish()
+{
+    mPackets[mWriteIndex].frameNumber = ++mPublished;
+
+    uint32_t previous = mMiddle.exchange(mWriteIndex | FRESH_BIT);
+    mWriteIndex = previous & INDEX_MASK;
+
+    notify();
+
+    // latency bound, don't simulate further ahead than the renderer allows
+    if (mPublished - mConsumed.load() > mMaxLatency)
+    {
+        std::unique_lock<std::mutex> lock(mWaitMutex);
+        mWaiters++;
+        mWaitCondition.wait(lock, [this]() { return mClosed || mPublished - mConsumed.load() <= mMaxLatency; });
+        mWaiters--;
+    }
+}
+
+bool FramePacketBuffer::acquire(bool wait)
+{
+    if (wait && !(mMiddle.load() & FRESH_BIT))
+    {
+        std::unique_lock<std::mutex> lock(mWaitMutex);
+        mWaiters++;
+        mWaitCondition.wait(lock, [this]() { return mClosed || (mMiddle.load() & FRESH_BIT); });
+        mWaiters--;
+    }
+
+    if (mClosed || !(mMiddle.load() & FRESH_BIT))
+    {
+        return false;
+    }
+
+    // only the consumer clears the fresh bit, so the exchange always hands back a fresh packet
+    uint32_t previous = mMiddle.exchange(mReadIndex);
+    mReadIndex = previous & INDEX_MASK;
+
+    mConsumed = mPackets[mReadIndex].frameNumber;
+
+    notify();
+    return true;
+}
+
+void FramePacketBuffer::close()
+{
+    mClosed = true;
+
+    std::lock_guard<std::mutex> lock(mWaitMutex);
+    mWaitCondition.notify_all();
+}
+
+void FramePacketBuffer::notify()
+{
+    if (mWaiters.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mWaitMutex);
+        mWaitCondition.notify_all();
+    }
+}
@@ -0,0 +1,208 @@
+#include <cmath>
+#include "Frustum.h"
+
+// defined for x64 builds, which compile the 8 wide test of FrustumAVX.cpp with AVX
+#if defined(HV_CULL_AVX)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define HV_CULL_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HV_CULL_NEON
+#endif
+
+using namespace mathfu;
+
+#if defined(HV_CULL_AVX)
+// the CPU has to support AVX and the OS has to save the 256-bit registers
+static bool isAvxSupported()
+{
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+}
+
+static const bool sAvxSupported = isAvxSupported();
+#endif
+
+static uint32_t countBits(uint32_t bits)
+{
+    uint32_t count = 0;
+    while (bits)
+    {
+        bits &= bits - 1;
+        count++;
+    }
+    return count;
+}
+
+static void writeFlags(uint8_t* flags, uint32_t bits, uint32_t count)
+{
+    if (flags)
+    {
+        for (uint32_t lane = 0; lane < count; lane++)
+        {
+            flags[lane] = static_cast<uint8_t>((bits >> lane) & 1);
+        }
+    }
+}
+
+void BoundingBoxes::resize(uint32_t count)
+{
+    mCenterX.resize(count);
+    mCenterY.resize(count);
+    mCenterZ.resize(count);
+    mExtentX.resize(count);
+    mExtentY.resize(count);
+    mExtentZ.resize(count);
+}
+
+void BoundingBoxes::set(uint32_t index, const mat4 &transform, const std::array<float, 6> &box)
+{
+    // the center moves as a point, the extents grow by the absolute rotation and scale
+    float center[3];
+    float extent[3];
+    for (int row = 0; row < 3; row++)
+    {
+        center[row] = transform(row, 3);
+        extent[row] = 0.f;
+        for (int column = 0; column < 3; column++)
+        {
+            center[row] += transform(row, column) * box[column];
+            extent[row] += std::fabs(transform(row, column)) * box[3 + column];
+        }
+    }
+
+    mCenterX[index] = center[0];
+    mCenterY[index] = center[1];
+    mCenterZ[index] = center[2];
+    mExtentX[index] = extent[0];
+    mExtentY[index] = extent[1];
+    mExtentZ[index] = extent[2];
+}
+
+Frustum::Frustum(const mat4 &viewProj)
+{
+    vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+    {
+        rows[i] = vec4(viewProj(i, 0), viewProj(i, 1), viewProj(i, 2), viewProj(i, 3));
+    }
+
+    vec4 planes[PLANE_COUNT];
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+
+    for (uint32_t i = 0; i < PLANE_COUNT; i++)
+    {
+        planes[i] /= planes[i].xyz().Length();
+        for (int component = 0; component < 4; component++)
+        {
+            mPlanes[i][component] = planes[i][component];
+        }
+    }
+}
+
+uint32_t Frustum::countVisible(const BoundingBoxes &boxes, uint8_t* visibleFlags) const
+{
+    // a box is outside once it is fully behind one plane, its distance pushed towards the
+    // plane by the extents along the plane normal
+    const uint32_t count = boxes.getCount();
+    const float* cx = boxes.getCenterX();
+    const float* cy = boxes.getCenterY();
+    const float* cz = boxes.getCenterZ();
+    const float* ex = boxes.getExtentX();
+    const float* ey = boxes.getExtentY();
+    const float* ez = boxes.getExtentZ();
+
+    uint32_t visible = 0;
+    uint32_t i = 0;
+
+#if defined(HV_CULL_AVX)
+    if (sAvxSupported)
+    {
+        i = count & ~7u;
+        visible = countVisibleAVX(boxes, visibleFlags, i);
+    }
+#endif
+
+#if defined(HV_CULL_SSE)
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 centerX = _mm_loadu_ps(cx + i);
+        __m128 centerY = _mm_loadu_ps(cy + i);
+        __m128 centerZ = _mm_loadu_ps(cz + i);
+        __m128 extentX = _mm_loadu_ps(ex + i);
+        __m128 extentY = _mm_loadu_ps(ey + i);
+        __m128 extentZ = _mm_loadu_ps(ez + i);
+
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+        for (uint32_t p = 0; p < PLANE_COUNT; p++)
+        {
+            __m128 distance = _mm_set1_ps(mPlanes[p][3]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(mPlanes[p][0]), centerX));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(mPlanes[p][1]), centerY));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(mPlanes[p][2]), centerZ));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::fabs(mPlanes[p][0])), extentX));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::fabs(mPlanes[p][1])), extentY));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::fabs(mPlanes[p][2])), extentZ));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+        uint32_t bits = static_cast<uint32_t>(_mm_movemask_ps(inside));
+        writeFlags(visibleFlags ? visibleFlags + i : nullptr, bits, 4);
+        visible += countBits(bits);
+    }
+#elif defined(HV_CULL_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t centerX = vld1q_f32(cx + i);
+        float32x4_t centerY = vld1q_f32(cy + i);
+        float32x4_t centerZ = vld1q_f32(cz + i);
+        float32x4_t extentX = vld1q_f32(ex + i);
+        float32x4_t extentY = vld1q_f32(ey + i);
+        float32x4_t extentZ = vld1q_f32(ez + i);
+
+        uint32x4_t inside = vdupq_n_u32(0xffffffff);
+        for (uint32_t p = 0; p < PLANE_COUNT; p++)
+        {
+            float32x4_t distance = vdupq_n_f32(mPlanes[p][3]);
+            distance = vmlaq_n_f32(distance, centerX, mPlanes[p][0]);
+            distance = vmlaq_n_f32(distance, centerY, mPlanes[p][1]);
+            distance = vmlaq_n_f32(distance, centerZ, mPlanes[p][2]);
+            distance = vmlaq_n_f32(distance, extentX, std::fabs(mPlanes[p][0]));
+            distance = vmlaq_n_f32(distance, extentY, std::fabs(mPlanes[p][1]));
+            distance = vmlaq_n_f32(distance, extentZ, std::fabs(mPlanes[p][2]));
+            inside = vandq_u32(inside, vcgeq_f32(distance, vdupq_n_f32(0.f)));
+        }
+        static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+        uint32_t bits = vaddvq_u32(vandq_u32(inside, vld1q_u32(laneBits)));
+        writeFlags(visibleFlags ? visibleFlags + i : nullptr, bits, 4);
+        visible += countBits(bits);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        bool inside = true;
+        for (uint32_t p = 0; p < PLANE_COUNT && inside; p++)
+        {
+            float distance = mPlanes[p][3] +
+                mPlanes[p][0] * cx[i] + mPlanes[p][1] * cy[i] + mPlanes[p][2] * cz[i] +
+                std::fabs(mPlanes[p][0]) * ex[i] + std::fabs(mPlanes[p][1]) * ey[i] + std::fabs(mPlanes[p][2]) * ez[i];
+            inside = distance >= 0.f;
+        }
+        writeFlags(visibleFlags ? visibleFlags + i : nullptr, inside ? 1 : 0, 1);
+        visible += inside ? 1 : 0;
+    }
+
+    return visible;
+}
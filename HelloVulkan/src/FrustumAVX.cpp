@@ -0,0 +1,65 @@
+#if defined(HV_CULL_AVX)
+#include <cmath>
+#include <immintrin.h>
+#include "Frustum.h"
+
+// the only file built with AVX, Frustum::countVisible() calls it once the CPU has been
+// checked for it
+
+static uint32_t countBits(uint32_t bits)
+{
+    uint32_t count = 0;
+    while (bits)
+    {
+        bits &= bits - 1;
+        count++;
+    }
+    return count;
+}
+
+uint32_t Frustum::countVisibleAVX(const BoundingBoxes &boxes, uint8_t* visibleFlags, uint32_t count) const
+{
+    const float* cx = boxes.getCenterX();
+    const float* cy = boxes.getCenterY();
+    const float* cz = boxes.getCenterZ();
+    const float* ex = boxes.getExtentX();
+    const float* ey = boxes.getExtentY();
+    const float* ez = boxes.getExtentZ();
+
+    uint32_t visible = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 centerX = _mm256_loadu_ps(cx + i);
+        __m256 centerY = _mm256_loadu_ps(cy + i);
+        __m256 centerZ = _mm256_loadu_ps(cz + i);
+        __m256 extentX = _mm256_loadu_ps(ex + i);
+        __m256 extentY = _mm256_loadu_ps(ey + i);
+        __m256 extentZ = _mm256_loadu_ps(ez + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t p = 0; p < PLANE_COUNT; p++)
+        {
+            __m256 distance = _mm256_set1_ps(mPlanes[p][3]);
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(mPlanes[p][0]), centerX));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(mPlanes[p][1]), centerY));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(mPlanes[p][2]), centerZ));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(std::fabs(mPlanes[p][0])), extentX));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(std::fabs(mPlanes[p][1])), extentY));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(std::fabs(mPlanes[p][2])), extentZ));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        uint32_t bits = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+        if (visibleFlags)
+        {
+            for (uint32_t lane = 0; lane < 8; lane++)
+            {
+                visibleFlags[i + lane] = static_cast<uint8_t>((bits >> lane) & 1);
+            }
+        }
+        visible += countBits(bits);
+    }
+
+    return visible;
+}
+#endif
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cassert>
+
+#include "GeometryPool.h"
+#include "Logging.h"
+#include "VKRenderer.h"
+
+GeometryPool::FreeList::FreeList(uint32_t capacity)
+    : mCapacity(capacity)
+{
+    mRanges.push_back({ 0, capacity });
+}
+
+bool GeometryPool::FreeList::allocate(uint32_t count, uint32_t &offset)
+{
+    for (auto it = mRanges.begin(); it != mRanges.end(); ++it)
+    {
+        if (it->count >= count)
+        {
+            offset = it->offset;
+            it->offset += count;
+            it->count -= count;
+            if (it->count == 0)
+            {
+                mRanges.erase(it);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void GeometryPool::FreeList::free(uint32_t offset, uint32_t count)
+{
+    auto next = std::lower_bound(mRanges.begin(), mRanges.end(), offset,
+        [](const Range &range, uint32_t value) { return range.offset < value; });
+
+    // merge with the neighbours the range touches
+    if (next != mRanges.begin())
+    {
+        auto prev = next - 1;
+        if (prev->offset + prev->count == offset)
+        {
+            prev->count += count;
+            if (next != mRanges.end() && prev->offset + prev->count == next->offset)
+            {
+                prev->count += next->count;
+                mRanges.erase(next);
+            }
+            return;
+        }
+    }
+
+    if (next != mRanges.end() && offset + count == next->offset)
+    {
+        next->offset = offset;
+        next->count += count;
+        return;
+    }
+
+    mRanges.insert(next, { offset, count });
+}
+
+uint32_t GeometryPool::FreeList::getFreeCount() const
+{
+    uint32_t count = 0;
+    for (auto &range : mRanges)
+    {
+        count += range.count;
+    }
+    return count;
+}
+
+void GeometryPool::FreeList::rebuild(const std::vector<Range> &usedRanges)
+{
+    mRanges.clear();
+
+    uint32_t offset = 0;
+    for (auto &used : usedRanges)
+    {
+        if (used.offset > offset)
+        {
+            mRanges.push_back({ offset, used.offset - offset });
+        }
+        offset = used.offset + used.count;
+    }
+
+    if (offset < mCapacity)
+    {
+        mRanges.push_back({ offset, mCapacity - offset });
+    }
+}
+
+void GeometryPool::planMoves(std::vector<Block> &blocks, std::vector<Move> &moves, std::vector<Range> &usedRanges)
+{
+    std::sort(blocks.begin(), blocks.end(), [](const Block &a, const Block &b) { return *a.offset < *b.offset; });
+
+    // everything below the cursor is packed
+    uint32_t cursor = 0;
+    for (auto &block : blocks)
+    {
+        uint32_t offset = *block.offset;
+        if (block.movable && offset > cursor)
+        {
+            moves.push_back({ block.offset, block.count, offset, cursor, block.copy });
+            offset = cursor;
+        }
+
+        usedRanges.push_back({ offset, block.count });
+        cursor = offset + block.count;
+    }
+}
+
+GeometryPool::GeometryPool(uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity)
+    : mVertexStride(vertexStride)
+    , mVertexRanges(vertexCapacity)
+    , mIndexRanges(indexCapacity)
+{
+    // create vertex buffer
+    {
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(vertexStride) * vertexCapacity;
+
+        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVertexBuffer, mVertexBufferMemory);
+    }
+
+    // create index buffer, the cluster cull writes its ranges on the async compute queue while
+    // the graphics queue draws from the rest
+    {
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(sizeof(uint32_t)) * indexCapacity;
+
+        VKRenderer::getInstance().createSharedBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndexBuffer, mIndexBufferMemory);
+    }
+}
+
+GeometryPool::~GeometryPool()
+{
+    // the renderer waited for the device, no draw reads the pool anymore
+    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mIndexBuffer, nullptr);
+    vkFreeMemory(VKRenderer::getInstance().getDevice(), mIndexBufferMemory, nullptr);
+    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mVertexBuffer, nullptr);
+    vkFreeMemory(VKRenderer::getInstance().getDevice(), mVertexBufferMemory, nullptr);
+}
+
+bool GeometryPool::allocate(const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+    Allocation &allocation, uint64_t &uploadValue)
+{
+    uint32_t vertexOffset;
+    uint32_t firstIndex;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        if (!mVertexRanges.allocate(vertexCount, vertexOffset))
+        {
+            if (mVertexRanges.getFreeCount() >= vertexCount)
+            {
+                LOGI("geometry pool has no free range of %u vertices, waiting for compaction\n", vertexCount);
+            }
+            else
+            {
+                LOGW("geometry pool is out of vertices\n");
+            }
+            return false;
+        }
+
+        if (!mIndexRanges.allocate(indexCount, firstIndex))
+        {
+            mVertexRanges.free(vertexOffset, vertexCount);
+            if (mIndexRanges.getFreeCount() >= indexCount)
+            {
+                LOGI("geometry pool has no free range of %u indices, waiting for compaction\n", indexCount);
+            }
+            else
+            {
+                LOGW("geometry pool is out of indices\n");
+            }
+            return false;
+        }
+
+        allocation.vertexOffset = vertexOffset;
+        allocation.vertexCount = vertexCount;
+        allocation.firstIndex = firstIndex;
+        allocation.indexCount = indexCount;
+
+        // compaction leaves it alone until the uploads are submitted
+        mLiveAllocations[&allocation] = UINT64_MAX;
+    }
+
+    uploadValue = VKRenderer::getInstance().uploadBuffer(vertices, static_cast<VkDeviceSize>(mVertexStride) * vertexCount,
+        mVertexBuffer, static_cast<VkDeviceSize>(mVertexStride) * vertexOffset,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+    uploadValue = std::max(uploadValue, VKRenderer::getInstance().uploadSharedBuffer(indices, sizeof(uint32_t) * indexCount,
+        mIndexBuffer, sizeof(uint32_t) * firstIndex,
+        VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLiveAllocations[&allocation] = uploadValue;
+    }
+
+    return true;
+}
+
+bool GeometryPool::reserveIndices(uint32_t indexCount, Allocation &allocation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mIndexRanges.allocate(indexCount, allocation.firstIndex))
+    {
+        LOGW("geometry pool is out of indices\n");
+        return false;
+    }
+
+    allocation.vertexOffset = 0;
+    allocation.vertexCount = 0;
+    allocation.indexCount = indexCount;
+    mLiveAllocations[&allocation] = 0;
+    return true;
+}
+
+void GeometryPool::free(const Allocation &allocation, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLiveAllocations.erase(const_cast<Allocation*>(&allocation));
+    mPendingFrees.push_back({ value, allocation });
+}
+
+bool GeometryPool::collect(uint64_t completedValue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    bool reclaimed = false;
+    auto it = mPendingFrees.begin();
+    while (it != mPendingFrees.end())
+    {
+        if (it->value <= completedValue)
+        {
+            if (it->allocation.vertexCount > 0)
+            {
+                mVertexRanges.free(it->allocation.vertexOffset, it->allocation.vertexCount);
+            }
+            mIndexRanges.free(it->allocation.firstIndex, it->allocation.indexCount);
+            it = mPendingFrees.erase(it);
+            reclaimed = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return reclaimed;
+}
+
+bool GeometryPool::compact(uint64_t completedValue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // ranges waiting to be freed may still be read by the GPU, they stay like the ranges
+    // still uploading
+    std::vector<Block> vertexBlocks;
+    std::vector<Block> indexBlocks;
+    for (auto &pending : mPendingFrees)
+    {
+        if (pending.allocation.vertexCount > 0)
+        {
+            vertexBlocks.push_back({ &pending.allocation.vertexOffset, pending.allocation.vertexCount, false, false });
+        }
+        indexBlocks.push_back({ &pending.allocation.firstIndex, pending.allocation.indexCount, false, false });
+    }
+    for (auto &live : mLiveAllocations)
+    {
+        auto allocation = live.first;
+        bool movable = live.second <= completedValue;
+        if (allocation->vertexCount > 0)
+        {
+            vertexBlocks.push_back({ &allocation->vertexOffset, allocation->vertexCount, movable, true });
+        }
+        indexBlocks.push_back({ &allocation->firstIndex, allocation->indexCount, movable, allocation->vertexCount > 0 });
+    }
+
+    std::vector<Move> vertexMoves;
+    std::vector<Move> indexMoves;
+    std::vector<Range> vertexRanges;
+    std::vector<Range> indexRanges;
+    planMoves(vertexBlocks, vertexMoves, vertexRanges);
+    planMoves(indexBlocks, indexMoves, indexRanges);
+
+    if (vertexMoves.empty() && indexMoves.empty())
+    {
+        return false;
+    }
+
+    // the ranges may overlap their old place, so they go through a scratch buffer
+    std::vector<VkBufferCopy> vertexCopies;
+    std::vector<VkBufferCopy> indexCopies;
+    VkDeviceSize scratchSize = 0;
+    for (auto &move : vertexMoves)
+    {
+        VkDeviceSize size = static_cast<VkDeviceSize>(mVertexStride) * move.count;
+        vertexCopies.push_back({ static_cast<VkDeviceSize>(mVertexStride) * move.from, scratchSize, size });
+        scratchSize += size;
+    }
+    for (auto &move : indexMoves)
+    {
+        if (move.copy)
+        {
+            VkDeviceSize size = sizeof(uint32_t) * move.count;
+            indexCopies.push_back({ sizeof(uint32_t) * move.from, scratchSize, size });
+            scratchSize += size;
+        }
+    }
+
+    auto &renderer = VKRenderer::getInstance();
+    VkBuffer scratchBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory scratchBufferMemory = VK_NULL_HANDLE;
+    if (scratchSize > 0)
+    {
+        renderer.createBuffer(scratchSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scratchBuffer, scratchBufferMemory);
+    }
+
+    VkCommandBuffer cmdBuffer = renderer.beginSingleTimeCommands();
+
+    // frames in flight still draw from the old ranges and write cluster indices, everything
+    // submitted before has to finish before the ranges are overwritten. Once the copy is done
+    // the old ranges are free right away.
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (scratchSize > 0)
+    {
+        if (!vertexCopies.empty())
+        {
+            vkCmdCopyBuffer(cmdBuffer, mVertexBuffer, scratchBuffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+        }
+        if (!indexCopies.empty())
+        {
+            vkCmdCopyBuffer(cmdBuffer, mIndexBuffer, scratchBuffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+        }
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        // back into the pool at the new offsets
+        for (auto &copy : vertexCopies)
+        {
+            copy.srcOffset = copy.dstOffset;
+        }
+        for (size_t i = 0; i < vertexMoves.size(); i++)
+        {
+            vertexCopies[i].dstOffset = static_cast<VkDeviceSize>(mVertexStride) * vertexMoves[i].to;
+        }
+        size_t copyIndex = 0;
+        for (auto &move : indexMoves)
+        {
+            if (move.copy)
+            {
+                auto &copy = indexCopies[copyIndex++];
+                copy.srcOffset = copy.dstOffset;
+                copy.dstOffset = sizeof(uint32_t) * move.to;
+            }
+        }
+
+        if (!vertexCopies.empty())
+        {
+            vkCmdCopyBuffer(cmdBuffer, scratchBuffer, mVertexBuffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+        }
+        if (!indexCopies.empty())
+        {
+            vkCmdCopyBuffer(cmdBuffer, scratchBuffer, mIndexBuffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+        }
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    renderer.endSingleTimeCommands(cmdBuffer);
+
+    if (scratchSize > 0)
+    {
+        vkDestroyBuffer(renderer.getDevice(), scratchBuffer, nullptr);
+        vkFreeMemory(renderer.getDevice(), scratchBufferMemory, nullptr);
+    }
+
+    for (auto &move : vertexMoves)
+    {
+        *move.offset = move.to;
+    }
+    for (auto &move : indexMoves)
+    {
+        *move.offset = move.to;
+    }
+    mVertexRanges.rebuild(vertexRanges);
+    mIndexRanges.rebuild(indexRanges);
+
+    LOGI("geometry pool compacted, moved %u vertex and %u index ranges\n",
+        static_cast<uint32_t>(vertexMoves.size()), static_cast<uint32_t>(indexMoves.size()));
+
+    return true;
+}
+
+void GeometryPool::bind(VkCommandBuffer cmdBuffer) const
+{
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &mVertexBuffer, offsets);
+    vkCmdBindIndexBuffer(cmdBuffer, mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
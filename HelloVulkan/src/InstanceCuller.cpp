@@ -0,0 +1,88 @@
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "InstanceCuller.h"
+#include "VKRenderer.h"
+#include "ViewUniforms.h"
+
+// matches local_size_x of cull.comp
+const uint32_t InstanceCuller::GROUP_SIZE = 64;
+
+InstanceCuller::InstanceCuller()
+{
+    // create descriptor set layout
+    {
+        std::array<VkDescriptorSetLayoutBinding, 8> bindings = {};
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER :
+                i < 7 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            bindings[i].pImmutableSamplers = nullptr;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+        mDescriptorSetLayout = descriptorAllocator.getLayout(bindings.data(), static_cast<uint32_t>(bindings.size()));
+
+        // create update template, the buffers in binding order followed by the depth pyramid
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(bindings.size());
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            entries[i].dstBinding = bindings[i].binding;
+            entries[i].dstArrayElement = 0;
+            entries[i].descriptorCount = 1;
+            entries[i].descriptorType = bindings[i].descriptorType;
+            entries[i].offset = offsetof(DescriptorData, buffers) + i * sizeof(VkDescriptorBufferInfo);
+            entries[i].stride = sizeof(VkDescriptorBufferInfo);
+        }
+        entries[7].offset = offsetof(DescriptorData, depthPyramid);
+        entries[7].stride = sizeof(VkDescriptorImageInfo);
+
+        mUpdateTemplate = descriptorAllocator.createUpdateTemplate(mDescriptorSetLayout, entries);
+    }
+
+    // create compute pipeline, the bounding sphere of the mesh and the phase are push constants
+    {
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkDescriptorSetLayout setLayouts[] = { VKRenderer::getInstance().getViewUniforms()->getDescriptorSetLayout(), mDescriptorSetLayout };
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.pNext = nullptr;
+        pipelineLayoutCreateInfo.setLayoutCount = 2;
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        auto result = vkCreatePipelineLayout(VKRenderer::getInstance().getDevice(), &pipelineLayoutCreateInfo, nullptr, &mPLayout);
+        assert(result == VK_SUCCESS);
+
+        VKRenderer::getInstance().createComputePipeline("cull.comp.spv", mPLayout, mPipeline);
+    }
+}
+
+InstanceCuller::~InstanceCuller()
+{
+    vkDestroyPipeline(VKRenderer::getInstance().getDevice(), mPipeline, nullptr);
+    vkDestroyPipelineLayout(VKRenderer::getInstance().getDevice(), mPLayout, nullptr);
+}
+
+void InstanceCuller::recordDispatch(VkCommandBuffer cmdBuffer, VkDescriptorSet descriptorSet,
+    const std::array<float, 4> &boundingSphere, uint32_t maxInstanceCount, Phase phase) const
+{
+    PushConstants pushConstants = { boundingSphere, static_cast<uint32_t>(phase) };
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+    VkDescriptorSet descriptorSets[] = { VKRenderer::getInstance().getViewUniforms()->getDescriptorSet(), descriptorSet };
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPLayout, 0, 2, descriptorSets, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, mPLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    vkCmdDispatch(cmdBuffer, (maxInstanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+}
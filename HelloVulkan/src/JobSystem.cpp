@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include "JobSystem.h"
+#include "Logging.h"
+
+#ifdef HV_JOBSYSTEM_BENCHMARK
+#include <chrono>
+#include <cmath>
+#endif
+
+#ifdef _ANDROID
+#include <sched.h>
+#else
+#include <windows.h>
+#endif
+
+const uint32_t JobSystem::INVALID_THREAD_INDEX = 0xFFFFFFFF;
+
+static thread_local uint32_t sThreadIndex = JobSystem::INVALID_THREAD_INDEX;
+
+struct Job
+{
+    JobSystem::Function function;
+    JobCounter* counter;
+};
+
+// Chase-Lev deque with a fixed capacity. Only the owning worker calls push() and pop(),
+// any thread may steal(). push() fails when the deque is full.
+class JobDeque
+{
+public:
+    static const int64_t CAPACITY = 4096;
+
+    bool push(Job *job)
+    {
+        int64_t bottom = mBottom.load(std::memory_order_relaxed);
+        int64_t top = mTop.load(std::memory_order_acquire);
+        if (bottom - top >= CAPACITY)
+        {
+            return false;
+        }
+
+        mJobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Job* pop()
+    {
+        int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = mTop.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            // empty
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = mJobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // last job, race the thieves for it
+            if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                job = nullptr;
+            }
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal()
+    {
+        int64_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+
+        Job* job = mJobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return job;
+    }
+
+private:
+    std::atomic<int64_t> mTop{ 0 };
+    std::atomic<int64_t> mBottom{ 0 };
+    std::array<std::atomic<Job*>, CAPACITY> mJobs;
+};
+
+JobSystem::JobSystem(uint32_t threadCount, bool pinThreads)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = std::max(2u, threadCount);
+
+    for (uint32_t threadIndex = 0; threadIndex < threadCount; threadIndex++)
+    {
+        mDeques.push_back(new JobDeque());
+    }
+
+    // the creating thread is worker 0
+    sThreadIndex = 0;
+    if (pinThreads)
+    {
+        pinCurrentThread(0);
+    }
+
+    for (uint32_t threadIndex = 1; threadIndex < threadCount; threadIndex++)
+    {
+        mWorkers.push_back(std::thread(&JobSystem::workerMain, this, threadIndex, pinThreads));
+    }
+
+    LOGI("job system running on %u threads\n", threadCount);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mQuit = true;
+    }
+    mWakeCondition.notify_all();
+
+    for (auto &worker : mWorkers)
+    {
+        worker.join();
+    }
+
+    assert(mQueuedJobs == 0);
+
+    for (auto &deque : mDeques)
+    {
+        delete deque;
+    }
+    sThreadIndex = INVALID_THREAD_INDEX;
+}
+
+uint32_t JobSystem::getThreadIndex()
+{
+    return sThreadIndex;
+}
+
+void JobSystem::attachCurrentThread()
+{
+    assert(sThreadIndex == INVALID_THREAD_INDEX);
+    sThreadIndex = 0;
+}
+
+void JobSystem::detachCurrentThread()
+{
+    assert(sThreadIndex == 0);
+    sThreadIndex = INVALID_THREAD_INDEX;
+}
+
+void JobSystem::run(const Function &function, JobCounter *counter, JobCounter *dependency)
+{
+    Job* job = new Job{ function, counter };
+
+    if (counter)
+    {
+        counter->mPending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (dependency)
+    {
+        std::lock_guard<std::mutex> lock(dependency->mMutex);
+        if (!dependency->isDone())
+        {
+            // started by whoever finishes the last job of the dependency
+            dependency->mDependents.push_back(job);
+            return;
+        }
+    }
+
+    schedule(job);
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    uint32_t threadIndex = getThreadIndex();
+
+    while (!counter.isDone())
+    {
+        if (threadIndex != INVALID_THREAD_INDEX)
+        {
+            Job* job = findJob(threadIndex);
+            if (job)
+            {
+                execute(job);
+                continue;
+            }
+        }
+        std::this_thread::yield();
+    }
+
+    // the last job may still be inside the counter, don't let the caller destroy it before it's done
+    std::lock_guard<std::mutex> lock(counter.mMutex);
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const RangeFunction &function)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    batchSize = std::max(1u, batchSize);
+    bool isWorker = getThreadIndex() != INVALID_THREAD_INDEX;
+
+    // a worker keeps the first batch for itself
+    uint32_t firstBatch = isWorker ? batchSize : 0;
+
+    JobCounter counter;
+    for (uint32_t begin = firstBatch; begin < count; begin += batchSize)
+    {
+        uint32_t end = std::min(begin + batchSize, count);
+        run([&function, begin, end]() { function(begin, end); }, &counter);
+    }
+
+    if (isWorker)
+    {
+        function(0, std::min(firstBatch, count));
+    }
+
+    wait(counter);
+}
+
+void JobSystem::schedule(Job *job)
+{
+    mQueuedJobs.fetch_add(1);
+
+    uint32_t threadIndex = getThreadIndex();
+    if (threadIndex == INVALID_THREAD_INDEX || !mDeques[threadIndex]->push(job))
+    {
+        std::lock_guard<std::mutex> lock(mSharedMutex);
+        mSharedJobs.push_back(job);
+    }
+
+    if (mSleepingWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mWakeCondition.notify_one();
+    }
+}
+
+Job* JobSystem::findJob(uint32_t threadIndex)
+{
+    Job* job = mDeques[threadIndex]->pop();
+
+    if (!job)
+    {
+        std::lock_guard<std::mutex> lock(mSharedMutex);
+        if (!mSharedJobs.empty())
+        {
+            job = mSharedJobs.front();
+            mSharedJobs.pop_front();
+        }
+    }
+
+    uint32_t threadCount = getThreadCount();
+    for (uint32_t i = 1; i < threadCount && !job; i++)
+    {
+        job = mDeques[(threadIndex + i) % threadCount]->steal();
+    }
+
+    if (job)
+    {
+        mQueuedJobs.fetch_sub(1);
+    }
+    return job;
+}
+
+void JobSystem::execute(Job *job)
+{
+    job->function();
+
+    JobCounter* counter = job->counter;
+    delete job;
+
+    if (counter)
+    {
+        std::vector<Job*> dependents;
+        {
+            std::lock_guard<std::mutex> lock(counter->mMutex);
+            if (counter->mPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                dependents.swap(counter->mDependents);
+            }
+        }
+
+        for (auto &dependent : dependents)
+        {
+            schedule(dependent);
+        }
+    }
+}
+
+void JobSystem::workerMain(uint32_t threadIndex, bool pinThread)
+{
+    sThreadIndex = threadIndex;
+    if (pinThread)
+    {
+        pinCurrentThread(threadIndex);
+    }
+
+    const uint32_t SPIN_COUNT = 64;
+
+    while (!mQuit)
+    {
+        Job* job = nullptr;
+        for (uint32_t spin = 0; spin < SPIN_COUNT && !job; spin++)
+        {
+            job = findJob(threadIndex);
+            if (!job)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        if (job)
+        {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepingWorkers++;
+        mWakeCondition.wait(lock, [this]() { return mQuit || mQueuedJobs.load() > 0; });
+        mSleepingWorkers--;
+    }
+}
+
+void JobSystem::pinCurrentThread(uint32_t threadIndex)
+{
+    uint32_t core = threadIndex % std::max(1u, std::thread::hardware_concurrency());
+
+#ifdef _ANDROID
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+    {
+        LOGW("failed to pin job thread %u to core %u\n", threadIndex, core);
+    }
+#else
+    if (SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core) == 0)
+    {
+        LOGW("failed to pin job thread %u to core %u\n", threadIndex, core);
+    }
+#endif
+}
+
+#ifdef HV_JOBSYSTEM_BENCHMARK
+void JobSystem::benchmark()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // throughput of empty jobs, started in batches that fit into a deque
+    {
+        const uint32_t BATCH_COUNT = 100;
+        const uint32_t BATCH_SIZE = 1000;
+
+        auto start = Clock::now();
+        for (uint32_t batch = 0; batch < BATCH_COUNT; batch++)
+        {
+            JobCounter counter;
+            for (uint32_t i = 0; i < BATCH_SIZE; i++)
+            {
+                run([]() {}, &counter);
+            }
+            wait(counter);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+        LOGI("job system: %.1f ns per empty job\n", ns / (BATCH_COUNT * BATCH_SIZE));
+    }
+
+    // round trip of a single job, the latency a dependent task pays
+    {
+        const uint32_t ROUND_TRIPS = 10000;
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ROUND_TRIPS; i++)
+        {
+            JobCounter counter;
+            run([]() {}, &counter);
+            wait(counter);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+        LOGI("job system: %.1f ns per run and wait round trip\n", ns / ROUND_TRIPS);
+    }
+
+    // parallelFor against a plain loop
+    {
+        const uint32_t COUNT = 1 << 20;
+        std::vector<float> values(COUNT);
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < COUNT; i++)
+        {
+            values[i] = sqrtf(static_cast<float>(i));
+        }
+        double serialMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        start = Clock::now();
+        parallelFor(COUNT, 4096, [&values](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                values[i] = sqrtf(static_cast<float>(i));
+            }
+        });
+        double parallelMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        LOGI("job system: %u sqrt serial %.3f ms, parallelFor %.3f ms on %u threads\n", COUNT, serialMs, parallelMs, getThreadCount());
+    }
+}
+#endif
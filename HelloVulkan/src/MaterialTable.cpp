@@ -0,0 +1,210 @@
+#include <array>
+#include <cassert>
+
+#include "MaterialTable.h"
+#include "ShadowMap.h"
+#include "SubmissionTracker.h"
+#include "VKRenderer.h"
+
+const uint32_t MaterialTable::MAX_MATERIALS = 1024;
+
+MaterialTable::MaterialTable()
+{
+    // create material buffer
+    {
+        VkDeviceSize bufferSize = MAX_MATERIALS * sizeof(Material);
+
+        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mMaterialBuffer, mMaterialBufferMemory);
+    }
+
+    // create descriptor set layout, the texture and sampler arrays are written while
+    // command buffers binding the set are pending and only the slots in use are valid
+    {
+        VkDescriptorSetLayoutBinding textureLayoutBinding = {};
+        textureLayoutBinding.binding = 0;
+        textureLayoutBinding.descriptorCount = MAX_MATERIALS;
+        textureLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        textureLayoutBinding.pImmutableSamplers = nullptr;
+        textureLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
+        samplerLayoutBinding.binding = 1;
+        samplerLayoutBinding.descriptorCount = MAX_MATERIALS;
+        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        samplerLayoutBinding.pImmutableSamplers = nullptr;
+        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutBinding materialLayoutBinding = {};
+        materialLayoutBinding.binding = 2;
+        materialLayoutBinding.descriptorCount = 1;
+        materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        materialLayoutBinding.pImmutableSamplers = nullptr;
+        materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutBinding shadowSamplerLayoutBinding = {};
+        shadowSamplerLayoutBinding.binding = 3;
+        shadowSamplerLayoutBinding.descriptorCount = 1;
+        shadowSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        shadowSamplerLayoutBinding.pImmutableSamplers = nullptr;
+        shadowSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings = { textureLayoutBinding, samplerLayoutBinding, materialLayoutBinding, shadowSamplerLayoutBinding };
+
+        const VkDescriptorBindingFlagsEXT arrayFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+        std::array<VkDescriptorBindingFlagsEXT, 4> bindingFlags = { arrayFlags, arrayFlags, 0, 0 };
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        auto result = vkCreateDescriptorSetLayout(VKRenderer::getInstance().getDevice(), &layoutInfo, nullptr, &mDescriptorSetLayout);
+        assert(result == VK_SUCCESS);
+    }
+
+    // create descriptor pool
+    {
+        std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        poolSizes[0].descriptorCount = MAX_MATERIALS;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+        poolSizes[1].descriptorCount = MAX_MATERIALS;
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[2].descriptorCount = 1;
+        poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[3].descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+
+        auto result = vkCreateDescriptorPool(VKRenderer::getInstance().getDevice(), &poolInfo, nullptr, &mDescriptorPool);
+        assert(result == VK_SUCCESS);
+
+        // create descriptor set
+        VkDescriptorSetLayout layouts[] = { mDescriptorSetLayout };
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = mDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = layouts;
+
+        result = vkAllocateDescriptorSets(VKRenderer::getInstance().getDevice(), &allocInfo, &mDescriptorSet);
+        assert(result == VK_SUCCESS);
+
+        VkDescriptorBufferInfo materialBufferInfo = {};
+        materialBufferInfo.buffer = mMaterialBuffer;
+        materialBufferInfo.offset = 0;
+        materialBufferInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorImageInfo shadowImageInfo = {};
+        shadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        shadowImageInfo.imageView = VKRenderer::getInstance().getShadowMap()->getShadowMapView();
+        shadowImageInfo.sampler = VKRenderer::getInstance().getShadowMap()->getShadowMapSampler();
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = mDescriptorSet;
+        descriptorWrites[0].dstBinding = 2;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &materialBufferInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = mDescriptorSet;
+        descriptorWrites[1].dstBinding = 3;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pImageInfo = &shadowImageInfo;
+
+        vkUpdateDescriptorSets(VKRenderer::getInstance().getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+MaterialTable::~MaterialTable()
+{
+    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mMaterialBuffer, nullptr);
+    vkFreeMemory(VKRenderer::getInstance().getDevice(), mMaterialBufferMemory, nullptr);
+    vkDestroyDescriptorSetLayout(VKRenderer::getInstance().getDevice(), mDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(VKRenderer::getInstance().getDevice(), mDescriptorPool, nullptr);
+}
+
+uint32_t MaterialTable::add(VkImageView textureView, VkSampler sampler, uint64_t &uploadValue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // slots of removed materials come back once no frame reads them anymore
+    auto &tracker = VKRenderer::getInstance().getGraphicsTracker();
+    while (!mPendingSlots.empty() && tracker.isComplete(mPendingSlots.front().value))
+    {
+        mFreeSlots.push_back(mPendingSlots.front().materialId);
+        mPendingSlots.pop_front();
+    }
+
+    uint32_t materialId;
+    if (!mFreeSlots.empty())
+    {
+        materialId = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        assert(mMaterialCount < MAX_MATERIALS);
+        materialId = mMaterialCount++;
+    }
+
+    // a material has its own texture and sampler for now, the indices let them be shared
+    Material material = {};
+    material.textureIndex = materialId;
+    material.samplerIndex = materialId;
+
+    VkDescriptorImageInfo textureInfo = {};
+    textureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    textureInfo.imageView = textureView;
+
+    VkDescriptorImageInfo samplerInfo = {};
+    samplerInfo.sampler = sampler;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = mDescriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = material.textureIndex;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pImageInfo = &textureInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = mDescriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = material.samplerIndex;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &samplerInfo;
+
+    vkUpdateDescriptorSets(VKRenderer::getInstance().getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    uploadValue = VKRenderer::getInstance().uploadBuffer(&material, sizeof(material), mMaterialBuffer, materialId * sizeof(Material),
+        VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    return materialId;
+}
+
+void MaterialTable::remove(uint32_t materialId, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingSlots.push_back({ value, materialId });
+}
@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+#include "MeshSimplifier.h"
+
+// weights of the texture coordinates and normals against positions in the unit cube
+static const float TEXCOORD_WEIGHT = 1.0f;
+static const float NORMAL_WEIGHT = 0.5f;
+// a level removing less of the triangles before it isn't worth a draw of its own
+static const float MIN_LOD_REDUCTION = 0.15f;
+// collapses turning a triangle further than this cosine away from its normal are rejected
+static const float MIN_NORMAL_COSINE = 0.2f;
+
+template<uint32_t N>
+void MeshSimplifier::Quadric<N>::addTriangle(const float* p0, const float* p1, const float* p2, float area)
+{
+    // an orthonormal basis of the triangle's plane through p0, the quadric is the squared
+    // distance to that plane in all N dimensions
+    float e1[N];
+    float e2[N];
+    float length1 = 0.f;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        e1[i] = p1[i] - p0[i];
+        length1 += e1[i] * e1[i];
+    }
+    length1 = std::sqrt(length1);
+    if (length1 < 1e-12f)
+    {
+        return;
+    }
+
+    float projection = 0.f;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        e1[i] /= length1;
+        projection += e1[i] * (p2[i] - p0[i]);
+    }
+
+    float length2 = 0.f;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        e2[i] = p2[i] - p0[i] - projection * e1[i];
+        length2 += e2[i] * e2[i];
+    }
+    length2 = std::sqrt(length2);
+    if (length2 < 1e-12f)
+    {
+        return;
+    }
+
+    float p0e1 = 0.f;
+    float p0e2 = 0.f;
+    float p0p0 = 0.f;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        e2[i] /= length2;
+        p0e1 += p0[i] * e1[i];
+        p0e2 += p0[i] * e2[i];
+        p0p0 += p0[i] * p0[i];
+    }
+
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        for (uint32_t j = i; j < N; j++)
+        {
+            a[k++] += area * ((i == j ? 1.f : 0.f) - e1[i] * e1[j] - e2[i] * e2[j]);
+        }
+        b[i] += area * (p0e1 * e1[i] + p0e2 * e2[i] - p0[i]);
+    }
+    c += area * (p0p0 - p0e1 * p0e1 - p0e2 * p0e2);
+    weight += area;
+}
+
+template<uint32_t N>
+void MeshSimplifier::Quadric<N>::add(const Quadric &other)
+{
+    for (uint32_t i = 0; i < N * (N + 1) / 2; i++)
+    {
+        a[i] += other.a[i];
+    }
+    for (uint32_t i = 0; i < N; i++)
+    {
+        b[i] += other.b[i];
+    }
+    c += other.c;
+    weight += other.weight;
+}
+
+template<uint32_t N>
+float MeshSimplifier::Quadric<N>::evaluate(const float* v) const
+{
+    float result = c;
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        for (uint32_t j = i; j < N; j++)
+        {
+            result += a[k++] * v[i] * v[j] * (i == j ? 1.f : 2.f);
+        }
+        result += 2.f * b[i] * v[i];
+    }
+
+    // rounding may push it just below zero
+    return std::max(result, 0.f);
+}
+
+static void cross(const float* p0, const float* p1, const float* p2, float* normal)
+{
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+MeshSimplifier::MeshSimplifier(const uint8_t* vertices, size_t stride, size_t positionOffset, size_t texCoordOffset,
+    size_t normalOffset, uint32_t vertexCount)
+    : mVertexCount(vertexCount)
+    , mScale(1.f)
+    , mAttributes(vertexCount * ATTRIBUTE_COUNT)
+    , mLocked(vertexCount, 0)
+    , mQuadrics(vertexCount)
+    , mPositionQuadrics(vertexCount)
+{
+    assert(vertexCount > 0);
+
+    auto getAttribute = [&](uint32_t vertex, size_t offset) {
+        return reinterpret_cast<const float*>(vertices + vertex * stride + offset);
+    };
+
+    // the errors are measured in the unit cube, attributes are weighed against it
+    float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const float* pos = getAttribute(i, positionOffset);
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            minPos[j] = std::min(minPos[j], pos[j]);
+            maxPos[j] = std::max(maxPos[j], pos[j]);
+        }
+    }
+
+    float extent = std::max(std::max(maxPos[0] - minPos[0], maxPos[1] - minPos[1]), maxPos[2] - minPos[2]);
+    if (extent > 0.f)
+    {
+        mScale = 1.f / extent;
+    }
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const float* pos = getAttribute(i, positionOffset);
+        const float* texCoord = getAttribute(i, texCoordOffset);
+        const float* normal = getAttribute(i, normalOffset);
+
+        float* attributes = &mAttributes[i * ATTRIBUTE_COUNT];
+        attributes[0] = (pos[0] - minPos[0]) * mScale;
+        attributes[1] = (pos[1] - minPos[1]) * mScale;
+        attributes[2] = (pos[2] - minPos[2]) * mScale;
+        attributes[3] = texCoord[0] * TEXCOORD_WEIGHT;
+        attributes[4] = texCoord[1] * TEXCOORD_WEIGHT;
+        attributes[5] = normal[0] * NORMAL_WEIGHT;
+        attributes[6] = normal[1] * NORMAL_WEIGHT;
+        attributes[7] = normal[2] * NORMAL_WEIGHT;
+    }
+
+    // vertices split on UV seams or normal creases share their position with another one,
+    // moving them would tear the surface open. Sorted by position the copies are adjacent.
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return std::lexicographical_compare(&mAttributes[a * ATTRIBUTE_COUNT], &mAttributes[a * ATTRIBUTE_COUNT] + 3,
+            &mAttributes[b * ATTRIBUTE_COUNT], &mAttributes[b * ATTRIBUTE_COUNT] + 3);
+    });
+
+    for (uint32_t i = 1; i < vertexCount; i++)
+    {
+        if (std::equal(&mAttributes[order[i - 1] * ATTRIBUTE_COUNT], &mAttributes[order[i - 1] * ATTRIBUTE_COUNT] + 3,
+            &mAttributes[order[i] * ATTRIBUTE_COUNT]))
+        {
+            mLocked[order[i - 1]] = 1;
+            mLocked[order[i]] = 1;
+        }
+    }
+}
+
+void MeshSimplifier::lockBorders(const std::vector<uint32_t> &indices)
+{
+    // edges of one triangle only are on an open border, those of more than two are not
+    // manifold, neither can collapse without changing the outline
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+    edgeUses.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        for (uint32_t e = 0; e < 3; e++)
+        {
+            uint32_t a = indices[i + e];
+            uint32_t b = indices[i + (e + 1) % 3];
+            edgeUses[(static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b)]++;
+        }
+    }
+
+    for (const auto &edge : edgeUses)
+    {
+        if (edge.second != 2)
+        {
+            mLocked[static_cast<uint32_t>(edge.first >> 32)] = 1;
+            mLocked[static_cast<uint32_t>(edge.first & 0xFFFFFFFF)] = 1;
+        }
+    }
+}
+
+uint32_t MeshSimplifier::collapseEdges(std::vector<uint32_t> &indices, uint32_t targetTriangleCount, float &maxError)
+{
+    uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+    // triangles around each vertex
+    std::vector<uint32_t> firstTriangle(mVertexCount + 1, 0);
+    for (auto index : indices)
+    {
+        firstTriangle[index + 1]++;
+    }
+    for (uint32_t i = 0; i < mVertexCount; i++)
+    {
+        firstTriangle[i + 1] += firstTriangle[i];
+    }
+
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    {
+        std::vector<uint32_t> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            vertexTriangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    // both directions of every edge, the cost is the error of the merged quadrics at the
+    // vertex collapsed onto. Edges of two triangles are listed once, from the one that has
+    // them in increasing order.
+    std::vector<Collapse> collapses;
+    collapses.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        for (uint32_t e = 0; e < 3; e++)
+        {
+            uint32_t a = indices[i + e];
+            uint32_t b = indices[i + (e + 1) % 3];
+            if (a > b)
+            {
+                continue;
+            }
+
+            for (uint32_t direction = 0; direction < 2; direction++)
+            {
+                uint32_t from = direction == 0 ? a : b;
+                uint32_t to = direction == 0 ? b : a;
+                if (mLocked[from])
+                {
+                    continue;
+                }
+
+                const float* target = &mAttributes[to * ATTRIBUTE_COUNT];
+                float weight = std::max(mQuadrics[from].weight + mQuadrics[to].weight, 1e-20f);
+                float cost = (mQuadrics[from].evaluate(target) + mQuadrics[to].evaluate(target)) / weight;
+                collapses.push_back({ cost, from, to });
+            }
+        }
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+        return a.cost < b.cost;
+    });
+
+    // cheapest first, a vertex takes part in one collapse per round so the triangles around
+    // it are still those in vertexTriangles, with earlier collapses looked up in remap
+    std::vector<uint32_t> remap(mVertexCount);
+    std::iota(remap.begin(), remap.end(), 0);
+    std::vector<uint8_t> collapsed(mVertexCount, 0);
+
+    uint32_t removedTriangles = 0;
+    uint32_t collapseCount = 0;
+    for (const auto &collapse : collapses)
+    {
+        if (triangleCount - removedTriangles <= targetTriangleCount)
+        {
+            break;
+        }
+
+        if (collapsed[collapse.from] || collapsed[collapse.to])
+        {
+            continue;
+        }
+
+        // the triangles sharing the edge vanish, the others must not fold over
+        bool flips = false;
+        uint32_t vanishing = 0;
+        for (uint32_t i = firstTriangle[collapse.from]; i < firstTriangle[collapse.from + 1]; i++)
+        {
+            uint32_t triangle = vertexTriangles[i];
+            uint32_t corners[3];
+            bool sharesEdge = false;
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                corners[j] = remap[indices[triangle * 3 + j]];
+                sharesEdge = sharesEdge || corners[j] == collapse.to;
+            }
+
+            if (sharesEdge)
+            {
+                vanishing++;
+                continue;
+            }
+
+            const float* before[3];
+            const float* after[3];
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                before[j] = &mAttributes[corners[j] * ATTRIBUTE_COUNT];
+                after[j] = corners[j] == collapse.from ? &mAttributes[collapse.to * ATTRIBUTE_COUNT] : before[j];
+            }
+
+            float normalBefore[3];
+            float normalAfter[3];
+            cross(before[0], before[1], before[2], normalBefore);
+            cross(after[0], after[1], after[2], normalAfter);
+
+            float dot = normalBefore[0] * normalAfter[0] + normalBefore[1] * normalAfter[1] + normalBefore[2] * normalAfter[2];
+            float lengthBefore = std::sqrt(normalBefore[0] * normalBefore[0] + normalBefore[1] * normalBefore[1] + normalBefore[2] * normalBefore[2]);
+            float lengthAfter = std::sqrt(normalAfter[0] * normalAfter[0] + normalAfter[1] * normalAfter[1] + normalAfter[2] * normalAfter[2]);
+            if (dot < MIN_NORMAL_COSINE * lengthBefore * lengthAfter)
+            {
+                flips = true;
+                break;
+            }
+        }
+
+        if (flips)
+        {
+            continue;
+        }
+
+        // the level's error is geometric, the attributes only steer the order
+        const float* target = &mAttributes[collapse.to * ATTRIBUTE_COUNT];
+        float positionWeight = std::max(mPositionQuadrics[collapse.from].weight + mPositionQuadrics[collapse.to].weight, 1e-20f);
+        float positionError = (mPositionQuadrics[collapse.from].evaluate(target) + mPositionQuadrics[collapse.to].evaluate(target)) / positionWeight;
+        maxError = std::max(maxError, positionError);
+
+        mQuadrics[collapse.to].add(mQuadrics[collapse.from]);
+        mPositionQuadrics[collapse.to].add(mPositionQuadrics[collapse.from]);
+
+        remap[collapse.from] = collapse.to;
+        collapsed[collapse.from] = 1;
+        collapsed[collapse.to] = 1;
+        removedTriangles += vanishing;
+        collapseCount++;
+    }
+
+    // drop the triangles that lost an edge
+    size_t write = 0;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        uint32_t a = remap[indices[i]];
+        uint32_t b = remap[indices[i + 1]];
+        uint32_t c = remap[indices[i + 2]];
+        if (a != b && b != c && c != a)
+        {
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+    }
+    indices.resize(write);
+
+    return collapseCount;
+}
+
+void MeshSimplifier::build(std::vector<uint32_t> &indices, std::vector<Lod> &lods)
+{
+    assert(indices.size() % 3 == 0);
+
+    lods.clear();
+    lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.f });
+
+    // every vertex starts with the planes of the triangles around it
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const float* p0 = &mAttributes[indices[i] * ATTRIBUTE_COUNT];
+        const float* p1 = &mAttributes[indices[i + 1] * ATTRIBUTE_COUNT];
+        const float* p2 = &mAttributes[indices[i + 2] * ATTRIBUTE_COUNT];
+
+        float normal[3];
+        cross(p0, p1, p2, normal);
+        float area = 0.5f * std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+        Quadric<ATTRIBUTE_COUNT> quadric = {};
+        quadric.addTriangle(p0, p1, p2, area);
+        Quadric<3> positionQuadric = {};
+        positionQuadric.addTriangle(p0, p1, p2, area);
+
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            mQuadrics[indices[i + j]].add(quadric);
+            mPositionQuadrics[indices[i + j]].add(positionQuadric);
+        }
+    }
+
+    lockBorders(indices);
+
+    // each level continues from the one before, the quadrics keep the original surface so
+    // the error never shrinks along the chain
+    std::vector<uint32_t> current(indices);
+    float maxError = 0.f;
+    while (lods.size() < MAX_LODS)
+    {
+        uint32_t previousCount = static_cast<uint32_t>(current.size() / 3);
+        uint32_t targetCount = previousCount / 2;
+
+        while (current.size() / 3 > targetCount)
+        {
+            if (collapseEdges(current, targetCount, maxError) == 0)
+            {
+                break;
+            }
+        }
+
+        if (current.empty() || static_cast<float>(current.size() / 3) > previousCount * (1.f - MIN_LOD_REDUCTION))
+        {
+            break;
+        }
+
+        lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(current.size()), std::sqrt(maxError) / mScale });
+        indices.insert(indices.end(), current.begin(), current.end());
+    }
+}
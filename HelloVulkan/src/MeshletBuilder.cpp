@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#include "MeshletBuilder.h"
+
+// below this the normals spread too far for the cone to ever cull
+static const float MIN_CONE_COSINE = 0.1f;
+
+static void computeBounds(const uint8_t* vertices, size_t stride, size_t positionOffset,
+    const uint32_t* indices, MeshletBuilder::Meshlet &meshlet)
+{
+    auto getPosition = [&](uint32_t vertex) {
+        return reinterpret_cast<const float*>(vertices + vertex * stride + positionOffset);
+    };
+
+    // sphere around the center of the box
+    float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t i = 0; i < meshlet.indexCount; i++)
+    {
+        const float* pos = getPosition(indices[meshlet.firstIndex + i]);
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            minPos[j] = std::min(minPos[j], pos[j]);
+            maxPos[j] = std::max(maxPos[j], pos[j]);
+        }
+    }
+
+    float center[3] = { (minPos[0] + maxPos[0]) * 0.5f, (minPos[1] + maxPos[1]) * 0.5f, (minPos[2] + maxPos[2]) * 0.5f };
+    float radius = 0.f;
+    for (uint32_t i = 0; i < meshlet.indexCount; i++)
+    {
+        const float* pos = getPosition(indices[meshlet.firstIndex + i]);
+        float d[3] = { pos[0] - center[0], pos[1] - center[1], pos[2] - center[2] };
+        radius = std::max(radius, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+    }
+
+    // the cone axis is the mean of the unit normals, its cutoff the sine of the widest
+    // angle a normal makes with it
+    std::vector<std::array<float, 3>> normals;
+    normals.reserve(meshlet.indexCount / 3);
+    float axis[3] = { 0.f, 0.f, 0.f };
+    for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+    {
+        const float* p0 = getPosition(indices[meshlet.firstIndex + i]);
+        const float* p1 = getPosition(indices[meshlet.firstIndex + i + 1]);
+        const float* p2 = getPosition(indices[meshlet.firstIndex + i + 2]);
+
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        std::array<float, 3> normal = { {
+            e1[1] * e2[2] - e1[2] * e2[1],
+            e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0] } };
+
+        float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length <= 0.f)
+        {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            normal[j] /= length;
+            axis[j] += normal[j];
+        }
+        normals.push_back(normal);
+    }
+
+    float cutoff = 1.f;
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axisLength > 0.f)
+    {
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            axis[j] /= axisLength;
+        }
+
+        float minCosine = 1.f;
+        for (const auto &normal : normals)
+        {
+            minCosine = std::min(minCosine, normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2]);
+        }
+
+        if (minCosine > MIN_CONE_COSINE)
+        {
+            cutoff = std::sqrt(1.f - minCosine * minCosine);
+        }
+    }
+
+    meshlet.boundingSphere[0] = center[0];
+    meshlet.boundingSphere[1] = center[1];
+    meshlet.boundingSphere[2] = center[2];
+    meshlet.boundingSphere[3] = radius;
+    meshlet.cone[0] = axis[0];
+    meshlet.cone[1] = axis[1];
+    meshlet.cone[2] = axis[2];
+    meshlet.cone[3] = cutoff;
+}
+
+void MeshletBuilder::build(const uint8_t* vertices, size_t stride, size_t positionOffset, uint32_t vertexCount,
+    uint32_t* indices, uint32_t indexCount, std::vector<Meshlet> &meshlets)
+{
+    assert(indexCount % 3 == 0);
+    uint32_t triangleCount = indexCount / 3;
+
+    auto getPosition = [&](uint32_t vertex) {
+        return reinterpret_cast<const float*>(vertices + vertex * stride + positionOffset);
+    };
+
+    // triangles around each vertex
+    std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        firstTriangle[indices[i] + 1]++;
+    }
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        firstTriangle[i + 1] += firstTriangle[i];
+    }
+
+    std::vector<uint32_t> vertexTriangles(indexCount);
+    {
+        std::vector<uint32_t> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (uint32_t i = 0; i < indexCount; i++)
+        {
+            vertexTriangles[cursor[indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<float> centroids(triangleCount * 3);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const float* p0 = getPosition(indices[t * 3]);
+        const float* p1 = getPosition(indices[t * 3 + 1]);
+        const float* p2 = getPosition(indices[t * 3 + 2]);
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            centroids[t * 3 + j] = (p0[j] + p1[j] + p2[j]) / 3.f;
+        }
+    }
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indexCount);
+    std::vector<uint8_t> used(triangleCount, 0);
+    // meshlet a vertex was last added to, plus one
+    std::vector<uint32_t> vertexMeshlet(vertexCount, 0);
+
+    meshlets.clear();
+    uint32_t seed = 0;
+    while (true)
+    {
+        while (seed < triangleCount && used[seed])
+        {
+            seed++;
+        }
+        if (seed == triangleCount)
+        {
+            break;
+        }
+
+        uint32_t meshletMark = static_cast<uint32_t>(meshlets.size()) + 1;
+        std::vector<uint32_t> meshletVertices;
+        uint32_t meshletTriangles = 0;
+        float centroidSum[3] = { 0.f, 0.f, 0.f };
+
+        Meshlet meshlet = {};
+        meshlet.firstIndex = static_cast<uint32_t>(ordered.size());
+
+        uint32_t next = seed;
+        while (next != UINT32_MAX)
+        {
+            used[next] = 1;
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                uint32_t vertex = indices[next * 3 + j];
+                if (vertexMeshlet[vertex] != meshletMark)
+                {
+                    vertexMeshlet[vertex] = meshletMark;
+                    meshletVertices.push_back(vertex);
+                }
+                ordered.push_back(vertex);
+                centroidSum[j] += centroids[next * 3 + j];
+            }
+            meshletTriangles++;
+
+            if (meshletTriangles == MAX_TRIANGLES)
+            {
+                break;
+            }
+
+            // the neighbour adding the fewest vertices that still fits, the closest to the
+            // center of the meshlet among those
+            float center[3] = { centroidSum[0] / meshletTriangles, centroidSum[1] / meshletTriangles, centroidSum[2] / meshletTriangles };
+            next = UINT32_MAX;
+            uint32_t bestNewVertices = UINT32_MAX;
+            float bestDistance = FLT_MAX;
+            for (auto vertex : meshletVertices)
+            {
+                for (uint32_t i = firstTriangle[vertex]; i < firstTriangle[vertex + 1]; i++)
+                {
+                    uint32_t triangle = vertexTriangles[i];
+                    if (used[triangle])
+                    {
+                        continue;
+                    }
+
+                    uint32_t newVertices = 0;
+                    for (uint32_t j = 0; j < 3; j++)
+                    {
+                        newVertices += vertexMeshlet[indices[triangle * 3 + j]] != meshletMark ? 1 : 0;
+                    }
+                    if (meshletVertices.size() + newVertices > MAX_VERTICES || newVertices > bestNewVertices)
+                    {
+                        continue;
+                    }
+
+                    float d[3] = { centroids[triangle * 3] - center[0], centroids[triangle * 3 + 1] - center[1], centroids[triangle * 3 + 2] - center[2] };
+                    float distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                    if (newVertices < bestNewVertices || distance < bestDistance)
+                    {
+                        next = triangle;
+                        bestNewVertices = newVertices;
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        meshlet.indexCount = static_cast<uint32_t>(ordered.size()) - meshlet.firstIndex;
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(ordered.begin(), ordered.end(), indices);
+
+    for (auto &meshlet : meshlets)
+    {
+        computeBounds(vertices, stride, positionOffset, indices, meshlet);
+    }
+}
@@ -1,11 +1,26 @@
+#include <algorithm>
 #include <array>
-#include <chrono>
+#include <atomic>
+#include <cfloat>
+#include <cstring>
 #include <string>
 #include "Asset.h"
+#include "ClusterCuller.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "DepthPyramid.h"
+#include "GeometryPool.h"
+#include "InstanceCuller.h"
+#include "JobSystem.h"
+#include "MaterialTable.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
 #include "Model.h"
+#include "ModelPipeline.h"
 #include "mathfu/glsl_mappings.h"
 #include "ShadowMap.h"
 #include "VKRenderer.h"
+#include "ViewUniforms.h"
 
 #pragma warning( push )  
 #pragma warning( disable : 4100 )  
@@ -26,78 +41,208 @@ public:
     }
 };
 
-struct UniformBufferObject
+// a vertex of the obj is a combination of a position, a texture coordinate and a normal
+struct ObjVertexKey
 {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-    mat4 shadowTransform;
+    int32_t position;
+    int32_t texCoord;
+    int32_t normal;
+
+    bool operator==(const ObjVertexKey &other) const
+    {
+        return position == other.position && texCoord == other.texCoord && normal == other.normal;
+    }
 };
 
-Model::Model(std::string name, float offsetZ)
-    : mOffsetZ(offsetZ)
+struct ObjVertexKeyHash
 {
-    // create texture image
+    size_t operator()(const ObjVertexKey &key) const
     {
-        std::string texturePath = "textures/" + name + ".jpg";
-        int32_t texWidth, texHeight, texChannels;
-        Asset texFile(texturePath, 0);
-        auto size = texFile.getLength();
-        std::vector<uint8_t> texData(size);
-        texFile.read(texData.data(), size);
-        texFile.close();
+        return std::hash<uint64_t>()((static_cast<uint64_t>(key.position) * 73856093) ^ (static_cast<uint64_t>(key.texCoord) * 19349663) ^ (static_cast<uint64_t>(key.normal) * 83492791));
+    }
+};
 
-        auto pixels = stbi_load_from_memory(texData.data(), size, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
+// read by the cull pass, the camera and the light come from the view uniform block and
+// the per-instance model matrix from the instance buffer
+struct UniformBufferObject
+{
+    uint32_t instanceCount;
+    // the visible instances of each LOD start at a multiple of it
+    uint32_t instanceCapacity;
+    uint32_t lodCount;
+    uint32_t clusterSlotCount;
+    // of each LOD in mesh units, scaled by the instance and projected to pixels
+    float lodErrors[MeshSimplifier::MAX_LODS];
+};
 
-        assert(pixels);
+const uint32_t Model::INITIAL_INSTANCE_CAPACITY = 16;
+const uint32_t Model::OCCLUDER_TRIANGLE_LIMIT = 1024;
+const uint32_t Model::MESHLET_TRIANGLE_THRESHOLD = 4096;
 
-        VKRenderer::getInstance().createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mStagingImage, mStagingImageMemory);
+static std::atomic<uint64_t> sNextRecordVersion{ 1 };
+static std::atomic<uint32_t> sNextMaterialId{ 0 };
 
-        void* data;
-        vkMapMemory(VKRenderer::getInstance().getDevice(), mStagingImageMemory, 0, imageSize, 0, &data);
-        assert(data);
+Model::Model(std::string name)
+    : mName(name)
+    , mRecordVersion(sNextRecordVersion.fetch_add(1))
+{
+    // decode the texture and parse the mesh at the same time
+    int32_t texWidth, texHeight, texChannels;
+    stbi_uc* pixels = nullptr;
+    {
+        auto &jobSystem = VKRenderer::getInstance().getJobSystem();
+        JobCounter decodeCounter;
+
+        jobSystem.run([&]() {
+            std::string texturePath = "textures/" + name + ".jpg";
+            Asset texFile(texturePath, 0);
+            auto size = texFile.getLength();
+            std::vector<uint8_t> texData(size);
+            texFile.read(texData.data(), size);
+            texFile.close();
+
+            pixels = stbi_load_from_memory(texData.data(), size, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+        }, &decodeCounter);
+
+        jobSystem.run([&]() {
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string err;
+
+            std::string modelPath = "models/" + name + ".obj";
+            Asset obj(modelPath, 0);
+            auto size = obj.getLength();
+            std::vector<char> objData(size);
+            obj.read(objData.data(), size);
+            obj.close();
+
+            vectorwrapbuf<char> databuf(objData);
+            std::istream is(&databuf);
+
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &is))
+            {
+                assert(false);
+            }
+
+            // corners sharing all their attributes become one vertex, so the simplifier
+            // sees which triangles are connected
+            std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> uniqueVertices;
+
+            for (const auto& shape : shapes)
+            {
+                for (const auto& index : shape.mesh.indices)
+                {
+                    ObjVertexKey key = { index.vertex_index, index.texcoord_index, index.normal_index };
+                    auto it = uniqueVertices.find(key);
+                    if (it != uniqueVertices.end())
+                    {
+                        mIndices.push_back(it->second);
+                        continue;
+                    }
+
+                    Vertex vertex = {};
+
+                    vertex.pos = {
+                        attrib.vertices[3 * index.vertex_index + 0],
+                        attrib.vertices[3 * index.vertex_index + 1],
+                        attrib.vertices[3 * index.vertex_index + 2]
+                    };
+
+                    vertex.texCoord = {
+                        attrib.texcoords[2 * index.texcoord_index + 0],
+                        1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                    };
+
+                    vertex.color = { 1.0f, 1.0f, 1.0f };
+
+                    vertex.normal = {
+                        attrib.normals[3 * index.normal_index + 0],
+                        attrib.normals[3 * index.normal_index + 1],
+                        attrib.normals[3 * index.normal_index + 2]
+                    };
+
+                    uniqueVertices[key] = static_cast<uint32_t>(mVertices.size());
+                    mIndices.push_back(static_cast<uint32_t>(mVertices.size()));
+                    mVertices.push_back(vertex);
+                }
+            }
+
+            // the LODs follow the full mesh in mIndices
+            MeshSimplifier simplifier(reinterpret_cast<const uint8_t*>(mVertices.data()), sizeof(Vertex), offsetof(Vertex, pos),
+                offsetof(Vertex, texCoord), offsetof(Vertex, normal), static_cast<uint32_t>(mVertices.size()));
+            simplifier.build(mIndices, mLods);
 
-        VkImageSubresource subresource = {};
-        subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        subresource.mipLevel = 0;
-        subresource.arrayLayer = 0;
+            // large meshes are rarely visible all at once, their full mesh is also culled
+            // in meshlets. Only reorders its triangles.
+            if (mLods[0].indexCount / 3 >= MESHLET_TRIANGLE_THRESHOLD)
+            {
+                MeshletBuilder::build(reinterpret_cast<const uint8_t*>(mVertices.data()), sizeof(Vertex), offsetof(Vertex, pos),
+                    static_cast<uint32_t>(mVertices.size()), mIndices.data() + mLods[0].firstIndex, mLods[0].indexCount, mMeshlets);
+            }
+        }, &decodeCounter);
 
-        VkSubresourceLayout stagingImageLayout;
-        vkGetImageSubresourceLayout(VKRenderer::getInstance().getDevice(), mStagingImage, &subresource, &stagingImageLayout);
+        jobSystem.wait(decodeCounter);
+    }
 
-        if (stagingImageLayout.rowPitch == texWidth * 4)
+    // bounding box for the CPU cull, and a sphere around its center the cull pass scales
+    // per instance
+    {
+        vec3 minPos = mVertices[0].pos;
+        vec3 maxPos = mVertices[0].pos;
+        for (const auto &vertex : mVertices)
         {
-            memcpy(data, pixels, imageSize);
+            minPos = vec3::Min(minPos, vertex.pos);
+            maxPos = vec3::Max(maxPos, vertex.pos);
         }
-        else
+
+        vec3 center = (minPos + maxPos) * 0.5f;
+        float radius = 0.f;
+        for (const auto &vertex : mVertices)
         {
-            uint8_t* dataBytes = reinterpret_cast<uint8_t*>(data);
+            radius = std::max(radius, (vertex.pos - center).Length());
+        }
 
-            for (auto y = 0; y < texHeight; y++)
-            {
-                memcpy(
-                    &dataBytes[y * stagingImageLayout.rowPitch],
-                    &pixels[y * texWidth * 4],
-                    texWidth * 4
-                );
-            }
+        vec3 extents = (maxPos - minPos) * 0.5f;
+
+        mBoundingSphere = { center.x(), center.y(), center.z(), radius };
+        mBoundingBox = { center.x(), center.y(), center.z(), extents.x(), extents.y(), extents.z() };
+    }
+
+    // keep a copy of the positions when the mesh is cheap enough to rasterize on the CPU.
+    // The full mesh, the LODs may stick out of it and hide what is visible.
+    if (mLods[0].indexCount / 3 <= OCCLUDER_TRIANGLE_LIMIT)
+    {
+        mOccluderPositions.reserve(mVertices.size() * 3);
+        for (const auto &vertex : mVertices)
+        {
+            mOccluderPositions.push_back(vertex.pos.x());
+            mOccluderPositions.push_back(vertex.pos.y());
+            mOccluderPositions.push_back(vertex.pos.z());
         }
+        mOccluderIndices.assign(mIndices.begin(), mIndices.begin() + mLods[0].indexCount);
+    }
 
-        vkUnmapMemory(VKRenderer::getInstance().getDevice(), mStagingImageMemory);
-        stbi_image_free(pixels);
+    // the draw of a LOD reads its visible instances from firstInstance on
+    if (VKRenderer::getInstance().getEnabledFeatures().drawIndirectFirstInstance)
+    {
+        mLodCount = static_cast<uint32_t>(mLods.size());
+        mClusterSlotCount = mMeshlets.empty() ? 0 : ClusterCuller::INSTANCE_SLOTS;
+    }
+
+    // create texture image
+    {
+        VkDeviceSize imageSize = texWidth * texHeight * 4;
+
+        assert(pixels);
 
         VKRenderer::getInstance().createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
             VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             mTextureImage, mTextureImageMemory);
 
-        VKRenderer::getInstance().transitionImageLayout(mStagingImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-        VKRenderer::getInstance().transitionImageLayout(mTextureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-        VKRenderer::getInstance().copyImage(mStagingImage, mTextureImage, texWidth, texHeight);
+        mUploadValue = std::max(mUploadValue, VKRenderer::getInstance().uploadImage(pixels, imageSize, texWidth, texHeight, mTextureImage));
 
-        VKRenderer::getInstance().transitionImageLayout(mTextureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        stbi_image_free(pixels);
     }
 
     // create texture image view
@@ -129,842 +274,511 @@ Model::Model(std::string name, float offsetZ)
         ASSERT_VK_SUCCESS(result);
     }
 
-    // Load Model
+    // the material table takes the texture when there is one, otherwise the model's own
+    // descriptor set binds it
+    if (auto materialTable = VKRenderer::getInstance().getMaterialTable())
+    {
+        uint64_t uploadValue = 0;
+        mMaterialId = materialTable->add(mTextureImageView, mTextureSampler, uploadValue);
+        mUploadValue = std::max(mUploadValue, uploadValue);
+    }
+    else
     {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string err;
+        mMaterialId = sNextMaterialId.fetch_add(1);
+    }
 
-        std::string modelPath = "models/" + name + ".obj";
-        Asset obj(modelPath, 0);
-        auto size = obj.getLength();
-        std::vector<char> objData(size);
-        obj.read(objData.data(), size);
-        obj.close();
+    // upload vertices and indices into the shared geometry pool
+    allocateGeometry();
 
-        vectorwrapbuf<char> databuf(objData);
-        std::istream is(&databuf);
+    // reserve the indices the cluster cull pass writes, without room the instances are
+    // drawn whole
+    if (mClusterSlotCount > 0 && !VKRenderer::getInstance().getGeometryPool()->reserveIndices(mClusterSlotCount * mLods[0].indexCount, mClusterIndices))
+    {
+        mClusterSlotCount = 0;
+    }
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &is))
-        {
-            assert(false);
-        }
+    // create meshlet buffer
+    if (mClusterSlotCount > 0)
+    {
+        VkDeviceSize bufferSize = mMeshlets.size() * sizeof(MeshletBuilder::Meshlet);
 
-        for (const auto& shape : shapes)
-        {
-            for (const auto& index : shape.mesh.indices)
-            {
-                Vertex vertex = {};
+        VKRenderer::getInstance().createSharedBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mMeshletBuffer, mMeshletBufferMemory);
 
-                vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-                };
+        mUploadValue = std::max(mUploadValue, VKRenderer::getInstance().uploadSharedBuffer(mMeshlets.data(), bufferSize, mMeshletBuffer, 0,
+            VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+    }
 
-                vertex.texCoord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                };
+    // create uniform buffer, staged together with the instances
+    {
+        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-                vertex.color = { 1.0f, 1.0f, 1.0f };
+        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mUniformBuffer, mUniformBufferMemory);
+    }
 
-                vertex.normal = {
-                    attrib.normals[3 * index.normal_index + 0],
-                    attrib.normals[3 * index.normal_index + 1],
-                    attrib.normals[3 * index.normal_index + 2]
-                };
+    // create indirect buffer, the draws of the main pass LODs followed by those of the shadow
+    // pass and of the cluster slots, then the count of instances handed to the slots. Like the
+    // instances and visible indices, the cluster cull reads it on the async compute queue.
+    {
+        VkDeviceSize bufferSize = (2 * MeshSimplifier::MAX_LODS + ClusterCuller::INSTANCE_SLOTS) * sizeof(VkDrawIndexedIndirectCommand) + sizeof(uint32_t);
 
-                mVertices.push_back(vertex);
-                mIndices.push_back(static_cast<uint32_t>(mIndices.size()));
-            }
-        }
+        VKRenderer::getInstance().createSharedBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndirectBuffer, mIndirectBufferMemory);
     }
 
+    createInstanceResources(INITIAL_INSTANCE_CAPACITY);
+}
+
+Model::~Model()
+{
+    // the last frame that drew this model, or its uploads, may still be in flight
+    auto &deletionQueue = VKRenderer::getInstance().getDeletionQueue();
+    auto value = std::max(mLastUsedValue, mUploadValue);
 
-    // create vertex buffer
+    if (auto materialTable = VKRenderer::getInstance().getMaterialTable())
     {
-        VkDeviceSize bufferSize = sizeof(mVertices[0]) * mVertices.size();
+        materialTable->remove(mMaterialId, value);
+    }
 
-        // staging buffer
-        VkBuffer            stagingBuffer;
-        VkDeviceMemory      stagingBufferMemory;
+    deletionQueue.pushSampler(value, mTextureSampler);
+    deletionQueue.pushImageView(value, mTextureImageView);
+    deletionQueue.pushImage(value, mTextureImage);
+    deletionQueue.pushMemory(value, mTextureImageMemory);
+    deletionQueue.pushBuffer(value, mIndirectBuffer);
+    deletionQueue.pushMemory(value, mIndirectBufferMemory);
+    deletionQueue.pushBuffer(value, mUniformBuffer);
+    deletionQueue.pushMemory(value, mUniformBufferMemory);
+    if (mClusterSlotCount > 0)
+    {
+        deletionQueue.pushBuffer(value, mMeshletBuffer);
+        deletionQueue.pushMemory(value, mMeshletBufferMemory);
+        VKRenderer::getInstance().getGeometryPool()->free(mClusterIndices, value);
+    }
+    if (mHasGeometry)
+    {
+        VKRenderer::getInstance().getGeometryPool()->free(mGeometry, value);
+    }
+
+    releaseInstanceResources();
+}
+
+bool Model::allocateGeometry()
+{
+    assert(!mHasGeometry);
 
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    uint64_t uploadValue = 0;
+    mHasGeometry = VKRenderer::getInstance().getGeometryPool()->allocate(mVertices.data(), static_cast<uint32_t>(mVertices.size()),
+        mIndices.data(), static_cast<uint32_t>(mIndices.size()), mGeometry, uploadValue);
 
-        void* data;
-        vkMapMemory(VKRenderer::getInstance().getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-        assert(data);
-        memcpy(data, mVertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(VKRenderer::getInstance().getDevice(), stagingBufferMemory);
+    mUploadValue = std::max(mUploadValue, uploadValue);
+    return mHasGeometry;
+}
 
-        // device local buffer
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVertexBuffer, mVertexBufferMemory);
+void Model::onGeometryMoved()
+{
+    // the offsets are baked into the recorded indirect draws and dispatches
+    mRecordVersion = sNextRecordVersion.fetch_add(1);
+}
 
-        // copy vertex buffer from host visible to device local
-        VKRenderer::getInstance().copyBuffer(stagingBuffer, mVertexBuffer, bufferSize);
+uint32_t Model::getStagingSlotSize() const
+{
+    return sizeof(UniformBufferObject) + mInstanceCapacity * (sizeof(mat4) + sizeof(uint32_t));
+}
 
-        vkDestroyBuffer(VKRenderer::getInstance().getDevice(), stagingBuffer, nullptr);
-        vkFreeMemory(VKRenderer::getInstance().getDevice(), stagingBufferMemory, nullptr);
+// the previous buffers and descriptor sets may still be in use by frames in flight
+void Model::releaseInstanceResources()
+{
+    auto &deletionQueue = VKRenderer::getInstance().getDeletionQueue();
+    auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+    auto value = std::max(mLastUsedValue, mUploadValue);
+
+    // the CPU is done writing the staging slots
+    vkUnmapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory);
+
+    if (mClusterSlotCount > 0)
+    {
+        descriptorAllocator.free(mClusterCullDescriptorSet, value);
     }
+    descriptorAllocator.free(mCullDescriptorSet, value);
+    descriptorAllocator.free(mShadowDescriptorSet, value);
+    descriptorAllocator.free(mDescriptorSet, value);
+    deletionQueue.pushBuffer(value, mOccludedBuffer);
+    deletionQueue.pushMemory(value, mOccludedBufferMemory);
+    deletionQueue.pushBuffer(value, mHistoryBuffer);
+    deletionQueue.pushMemory(value, mHistoryBufferMemory);
+    deletionQueue.pushBuffer(value, mShadowVisibleBuffer);
+    deletionQueue.pushMemory(value, mShadowVisibleBufferMemory);
+    deletionQueue.pushBuffer(value, mVisibleBuffer);
+    deletionQueue.pushMemory(value, mVisibleBufferMemory);
+    deletionQueue.pushBuffer(value, mInstanceBuffer);
+    deletionQueue.pushMemory(value, mInstanceBufferMemory);
+    deletionQueue.pushBuffer(value, mUniformStagingBuffer);
+    deletionQueue.pushMemory(value, mUniformStagingBufferMemory);
+}
 
+void Model::createInstanceResources(uint32_t capacity)
+{
+    mInstanceCapacity = capacity;
+
+    // create instance buffer, the staging buffer holds the uniform block, the instances and their
+    // occlusion flags of every frame in flight
     {
-        // create index buffer
-        VkDeviceSize bufferSize = sizeof(mIndices[0]) * mIndices.size();
+        VkDeviceSize bufferSize = capacity * sizeof(mat4);
+        VkDeviceSize stagingSize = getStagingSlotSize() * VKRenderer::getInstance().getFramesInFlight();
 
-        // staging buffer
-        VkBuffer            stagingBuffer;
-        VkDeviceMemory      stagingBufferMemory;
+        VKRenderer::getInstance().createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformStagingBuffer, mUniformStagingBufferMemory);
+        VKRenderer::getInstance().createSharedBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mInstanceBuffer, mInstanceBufferMemory);
 
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        // indices of the instances that passed culling, written by the cull pass into the
+        // range of their LOD or the slot that hands them to the cluster cull
+        VkDeviceSize visibleSize = capacity * mLodCount * sizeof(uint32_t);
+        VKRenderer::getInstance().createSharedBuffer(visibleSize + mClusterSlotCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVisibleBuffer, mVisibleBufferMemory);
+        VKRenderer::getInstance().createBuffer(visibleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mShadowVisibleBuffer, mShadowVisibleBufferMemory);
 
-        void* data;
-        vkMapMemory(VKRenderer::getInstance().getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-        assert(data);
-        memcpy(data, mIndices.data(), (size_t)bufferSize);
-        vkUnmapMemory(VKRenderer::getInstance().getDevice(), stagingBufferMemory);
+        // left uninitialized, the history only decides which main pass draws an instance and
+        // which LOD it starts from
+        VkDeviceSize historySize = capacity * sizeof(uint32_t);
+        VKRenderer::getInstance().createBuffer(historySize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mHistoryBuffer, mHistoryBufferMemory);
 
-        // device local buffer
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndexBuffer, mIndexBufferMemory);
+        VkDeviceSize occludedSize = capacity * sizeof(uint32_t);
+        VKRenderer::getInstance().createBuffer(occludedSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mOccludedBuffer, mOccludedBufferMemory);
 
-        // copy index buffer from host visible to device local
-        VKRenderer::getInstance().copyBuffer(stagingBuffer, mIndexBuffer, bufferSize);
+        void* data = nullptr;
+        auto result = vkMapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, 0, stagingSize, 0, &data);
+        ASSERT_VK_SUCCESS(result);
+        mUniformStagingData = static_cast<uint8_t*>(data);
+    }
 
-        vkDestroyBuffer(VKRenderer::getInstance().getDevice(), stagingBuffer, nullptr);
-        vkFreeMemory(VKRenderer::getInstance().getDevice(), stagingBufferMemory, nullptr);
+    // create descriptor sets from the shared pools, the texture and the shadow map are left
+    // to the material table when there is one and ignored by the update template
+    {
+        auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+        auto pipeline = VKRenderer::getInstance().getModelPipeline();
+
+        ModelPipeline::DescriptorData descriptorData = {};
+        descriptorData.instanceBuffer = { mInstanceBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.visibleBuffer = { mVisibleBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        descriptorData.texture.imageView = mTextureImageView;
+        descriptorData.texture.sampler = mTextureSampler;
+        descriptorData.shadowMap.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        descriptorData.shadowMap.imageView = VKRenderer::getInstance().getShadowMap()->getShadowMapView();
+        descriptorData.shadowMap.sampler = VKRenderer::getInstance().getShadowMap()->getShadowMapSampler();
+
+        mDescriptorSet = descriptorAllocator.allocate(pipeline->getDescriptorSetLayout());
+        descriptorAllocator.update(mDescriptorSet.set, pipeline->getUpdateTemplate(), &descriptorData);
+
+        // the shadow pass reads the instances culled against the light
+        descriptorData.visibleBuffer = { mShadowVisibleBuffer, 0, VK_WHOLE_SIZE };
+
+        mShadowDescriptorSet = descriptorAllocator.allocate(pipeline->getShadowDescriptorSetLayout());
+        descriptorAllocator.update(mShadowDescriptorSet.set, pipeline->getShadowUpdateTemplate(), &descriptorData);
     }
 
-    // create uniform buffer
+    // create cull descriptor set
     {
-        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+        auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+        auto culler = VKRenderer::getInstance().getInstanceCuller();
+
+        InstanceCuller::DescriptorData descriptorData = {};
+        descriptorData.buffers[0] = { mUniformBuffer, 0, sizeof(UniformBufferObject) };
+        descriptorData.buffers[1] = { mOccludedBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[2] = { mInstanceBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[3] = { mVisibleBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[4] = { mShadowVisibleBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[5] = { mIndirectBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[6] = { mHistoryBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.depthPyramid.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        descriptorData.depthPyramid.imageView = VKRenderer::getInstance().getDepthPyramid()->getImageView();
+        descriptorData.depthPyramid.sampler = VKRenderer::getInstance().getDepthPyramid()->getSampler();
+
+        mCullDescriptorSet = descriptorAllocator.allocate(culler->getDescriptorSetLayout());
+        descriptorAllocator.update(mCullDescriptorSet.set, culler->getUpdateTemplate(), &descriptorData);
+    }
 
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformStagingBuffer, mUniformStagingBufferMemory);
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mUniformBuffer, mUniformBufferMemory);
+    // create cluster cull descriptor set
+    if (mClusterSlotCount > 0)
+    {
+        auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+        auto culler = VKRenderer::getInstance().getClusterCuller();
+
+        ClusterCuller::DescriptorData descriptorData = {};
+        descriptorData.buffers[0] = { mInstanceBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[1] = { mVisibleBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[2] = { mIndirectBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[3] = { mMeshletBuffer, 0, VK_WHOLE_SIZE };
+        descriptorData.buffers[4] = { VKRenderer::getInstance().getGeometryPool()->getIndexBuffer(), 0, VK_WHOLE_SIZE };
+        descriptorData.depthPyramid.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        descriptorData.depthPyramid.imageView = VKRenderer::getInstance().getDepthPyramid()->getImageView();
+        descriptorData.depthPyramid.sampler = VKRenderer::getInstance().getDepthPyramid()->getSampler();
+
+        mClusterCullDescriptorSet = descriptorAllocator.allocate(culler->getDescriptorSetLayout());
+        descriptorAllocator.update(mClusterCullDescriptorSet.set, culler->getUpdateTemplate(), &descriptorData);
     }
 
-    // create shadow uniform buffer
+    // the draws bind the new buffers
+    mRecordVersion = sNextRecordVersion.fetch_add(1);
+}
+
+void Model::addInstance(uint32_t id, const mathfu::mat4 &transform)
+{
+    assert(mInstanceIndices.find(id) == mInstanceIndices.end());
+
+    // recorded commands only depend on the capacity, the count reaches the GPU with the uniforms
+    if (mInstanceIds.size() == mInstanceCapacity)
     {
-        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+        releaseInstanceResources();
+        createInstanceResources(mInstanceCapacity * 2);
+    }
+
+    mInstanceIndices[id] = static_cast<uint32_t>(mInstanceIds.size());
+    mInstanceIds.push_back(id);
+    mInstanceTransforms.push_back(transform);
+}
+
+void Model::removeInstance(uint32_t id)
+{
+    auto it = mInstanceIndices.find(id);
+    assert(it != mInstanceIndices.end());
+
+    // move the last instance into the gap
+    uint32_t index = it->second;
+    mInstanceIndices.erase(it);
+
+    if (index != mInstanceIds.size() - 1)
+    {
+        mInstanceIds[index] = mInstanceIds.back();
+        mInstanceTransforms[index] = mInstanceTransforms.back();
+        mInstanceIndices[mInstanceIds[index]] = index;
+    }
+    mInstanceIds.pop_back();
+    mInstanceTransforms.pop_back();
+}
+
+void Model::setInstanceTransform(uint32_t id, const mathfu::mat4 &transform)
+{
+    auto it = mInstanceIndices.find(id);
+    if (it != mInstanceIndices.end())
+    {
+        mInstanceTransforms[it->second] = transform;
+    }
+}
+
+void Model::recordDraw(BindState &state) const
+{
+    auto &pipeline = *VKRenderer::getInstance().getModelPipeline();
+
+    state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getPipeline());
+    state.bindGeometry(*VKRenderer::getInstance().getGeometryPool());
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getPipelineLayout(), 0, VKRenderer::getInstance().getViewUniforms()->getDescriptorSet());
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getPipelineLayout(), 1, mDescriptorSet.set);
+
+    if (auto materialTable = VKRenderer::getInstance().getMaterialTable())
+    {
+        state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getPipelineLayout(), 2, materialTable->getDescriptorSet());
+        vkCmdPushConstants(state.getCommandBuffer(), pipeline.getPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &mMaterialId);
+    }
+
+    for (uint32_t lod = 0; lod < mLodCount; lod++)
+    {
+        vkCmdDrawIndexedIndirect(state.getCommandBuffer(), mIndirectBuffer, lod * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    // the meshlets kept of each slot, no indices when the slot is empty
+    for (uint32_t slot = 0; slot < mClusterSlotCount; slot++)
+    {
+        VkDeviceSize offset = (2 * MeshSimplifier::MAX_LODS + slot) * sizeof(VkDrawIndexedIndirectCommand);
+        vkCmdDrawIndexedIndirect(state.getCommandBuffer(), mIndirectBuffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+void Model::recordShadowDraw(BindState &state) const
+{
+    auto &pipeline = *VKRenderer::getInstance().getModelPipeline();
+
+    state.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getShadowPipeline());
+    state.bindGeometry(*VKRenderer::getInstance().getGeometryPool());
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getShadowPipelineLayout(), 0, VKRenderer::getInstance().getViewUniforms()->getDescriptorSet());
+    state.bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getShadowPipelineLayout(), 1, mShadowDescriptorSet.set);
+
+    for (uint32_t lod = 0; lod < mLodCount; lod++)
+    {
+        VkDeviceSize offset = (MeshSimplifier::MAX_LODS + lod) * sizeof(VkDrawIndexedIndirectCommand);
+        vkCmdDrawIndexedIndirect(state.getCommandBuffer(), mIndirectBuffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+uint32_t Model::getSortKey(RenderQueue::Pass pass) const
+{
+    // all models share the pipelines of a pass. The instances of a model are drawn by one
+    // indirect draw, ordered by the nearest one.
+    auto &pipeline = *VKRenderer::getInstance().getModelPipeline();
+    uint32_t pipelineId = pass == RenderQueue::PASS_SHADOW ? pipeline.getShadowPipelineId() : pipeline.getPipelineId();
+
+    return RenderQueue::makeKey(pass, pipelineId, mMaterialId, RenderQueue::makeDepthBucket(mSortDepths[pass]));
+}
 
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mShadowUniformStagingBuffer, mShadowUniformStagingBufferMemory);
-        VKRenderer::getInstance().createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mShadowUniformBuffer, mShadowUniformBufferMemory);
-    }
-
-    // create descriptor set layout
-    {
-        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
-
-        VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding shadowSamplerLayoutBinding = {};
-        shadowSamplerLayoutBinding.binding = 2;
-        shadowSamplerLayoutBinding.descriptorCount = 1;
-        shadowSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        shadowSamplerLayoutBinding.pImmutableSamplers = nullptr;
-        shadowSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        std::array<VkDescriptorSetLayoutBinding, 3> bindings = { uboLayoutBinding, samplerLayoutBinding, shadowSamplerLayoutBinding };
-
-        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-        layoutInfo.pBindings = bindings.data();
-
-        auto result = vkCreateDescriptorSetLayout(VKRenderer::getInstance().getDevice(), &layoutInfo, nullptr, &mDescriptorSetLayout);
-        assert(result == VK_SUCCESS);
-    }
-
-    // create descriptor pool
-    {
-        std::array<VkDescriptorPoolSize, 3> poolSizes = {};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = 1;
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = 1;
-        poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[2].descriptorCount = 1;
-
-        VkDescriptorPoolCreateInfo poolInfo = {};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = 1;
-        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-
-        auto result = vkCreateDescriptorPool(VKRenderer::getInstance().getDevice(), &poolInfo, nullptr, &mDescriptorPool);
-        assert(result == VK_SUCCESS);
-
-        // create descriptor set
-        VkDescriptorSetLayout uboLayouts[] = { mDescriptorSetLayout };
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = mDescriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = uboLayouts;
-
-        result = vkAllocateDescriptorSets(VKRenderer::getInstance().getDevice(), &allocInfo, &mDescriptorSet);
-        assert(result == VK_SUCCESS);
-
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = mUniformBuffer;
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkDescriptorImageInfo imageInfo = {};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = mTextureImageView;
-        imageInfo.sampler = mTextureSampler;
-
-        VkDescriptorImageInfo shadowImageInfo = {};
-        shadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        shadowImageInfo.imageView = VKRenderer::getInstance().getShadowMap()->getShadowMapView();
-        shadowImageInfo.sampler = VKRenderer::getInstance().getShadowMap()->getShadowMapSampler();
-
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = mDescriptorSet;
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = mDescriptorSet;
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = mDescriptorSet;
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pImageInfo = &shadowImageInfo;
-
-        vkUpdateDescriptorSets(VKRenderer::getInstance().getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-    }
-
-    // create shadow descriptor set layout
-    {
-        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
-
-        std::array<VkDescriptorSetLayoutBinding, 1> bindings = { uboLayoutBinding };
-
-        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-        layoutInfo.pBindings = bindings.data();
-
-        auto result = vkCreateDescriptorSetLayout(VKRenderer::getInstance().getDevice(), &layoutInfo, nullptr, &mShadowDescriptorSetLayout);
-        assert(result == VK_SUCCESS);
-    }
-
-    // create shadow descriptor pool
-    {
-        std::array<VkDescriptorPoolSize, 1> poolSizes = {};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = 1;
-
-        VkDescriptorPoolCreateInfo poolInfo = {};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = 1;
-        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-
-        auto result = vkCreateDescriptorPool(VKRenderer::getInstance().getDevice(), &poolInfo, nullptr, &mShadowDescriptorPool);
-        assert(result == VK_SUCCESS);
-
-        // create descriptor set
-        VkDescriptorSetLayout uboLayouts[] = { mShadowDescriptorSetLayout };
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = mShadowDescriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = uboLayouts;
-
-        result = vkAllocateDescriptorSets(VKRenderer::getInstance().getDevice(), &allocInfo, &mShadowDescriptorSet);
-        assert(result == VK_SUCCESS);
-
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = mShadowUniformBuffer;
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = mShadowDescriptorSet;
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        vkUpdateDescriptorSets(VKRenderer::getInstance().getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-    }
-
-    // create graphics pipeline
-    {
-        VkDescriptorSetLayout setLayouts[] = { mDescriptorSetLayout };
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.pNext = nullptr;
-        pipelineLayoutCreateInfo.setLayoutCount = 1;
-        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
-        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
-
-        auto result = vkCreatePipelineLayout(VKRenderer::getInstance().getDevice(), &pipelineLayoutCreateInfo, nullptr, &mPLayout);
-        assert(result == VK_SUCCESS);
-
-        Asset vs("shader.vert.spv", 0);
-        auto size = vs.getLength();
-        std::vector<uint8_t> vsData(size);
-        vs.read(vsData.data(), size);
-        vs.close();
-
-        Asset fs("shader.frag.spv", 0);
-        size = fs.getLength();
-        std::vector<uint8_t> fsData(size);
-        fs.read(fsData.data(), size);
-        fs.close();
-
-        VkShaderModule vertexShader, fragmentShader;
-
-        VkShaderModuleCreateInfo shaderModuleCreateInfo;
-        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        shaderModuleCreateInfo.pNext = nullptr;
-        shaderModuleCreateInfo.codeSize = vsData.size();
-        shaderModuleCreateInfo.pCode = (const uint32_t*)(vsData.data());
-        shaderModuleCreateInfo.flags = 0;
-
-        result = vkCreateShaderModule(
-            VKRenderer::getInstance().getDevice(), &shaderModuleCreateInfo, nullptr, &vertexShader);
-        assert(result == VK_SUCCESS);
-
-        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        shaderModuleCreateInfo.pNext = nullptr;
-        shaderModuleCreateInfo.codeSize = fsData.size();
-        shaderModuleCreateInfo.pCode = (const uint32_t*)(fsData.data());
-        shaderModuleCreateInfo.flags = 0;
-
-        result = vkCreateShaderModule(
-            VKRenderer::getInstance().getDevice(), &shaderModuleCreateInfo, nullptr, &fragmentShader);
-        assert(result == VK_SUCCESS);
-
-        VkPipelineShaderStageCreateInfo shaderStages[2];
-
-        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderStages[0].pNext = nullptr;
-        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shaderStages[0].module = vertexShader;
-        shaderStages[0].pSpecializationInfo = nullptr;
-        shaderStages[0].flags = 0;
-        shaderStages[0].pName = "main";
-
-        shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderStages[1].pNext = nullptr;
-        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        shaderStages[1].module = fragmentShader;
-        shaderStages[1].pSpecializationInfo = nullptr;
-        shaderStages[1].flags = 0;
-        shaderStages[1].pName = "main";
-
-        auto displaySize = VKRenderer::getInstance().getDisplaySize();
-
-        VkViewport viewports;
-        viewports.minDepth = 0.0f;
-        viewports.maxDepth = 1.0f;
-        viewports.x = 0;
-        viewports.y = 0;
-        viewports.width = (float)displaySize.width;
-        viewports.height = (float)displaySize.height;
-
-        VkRect2D scissor;
-        scissor.extent = displaySize;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-
-        VkPipelineViewportStateCreateInfo viewportInfo{};
-        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportInfo.pNext = nullptr;
-        viewportInfo.viewportCount = 1;
-        viewportInfo.pViewports = &viewports;
-        viewportInfo.scissorCount = 1;
-        viewportInfo.pScissors = &scissor;
-
-        VkSampleMask sampleMask = ~0u;
-        VkPipelineMultisampleStateCreateInfo multisampleInfo{};
-        multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampleInfo.pNext = nullptr;
-        multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampleInfo.sampleShadingEnable = VK_FALSE;
-        multisampleInfo.minSampleShading = 0;
-        multisampleInfo.pSampleMask = &sampleMask;
-        multisampleInfo.alphaToCoverageEnable = VK_FALSE;
-        multisampleInfo.alphaToOneEnable = VK_FALSE;
-
-        VkPipelineColorBlendAttachmentState attachmentStates{};
-        attachmentStates.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        attachmentStates.blendEnable = VK_FALSE;
-
-        VkPipelineColorBlendStateCreateInfo colorBlendInfo{};
-        colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlendInfo.pNext = nullptr;
-        colorBlendInfo.logicOpEnable = VK_FALSE;
-        colorBlendInfo.logicOp = VK_LOGIC_OP_COPY;
-        colorBlendInfo.attachmentCount = 1;
-        colorBlendInfo.pAttachments = &attachmentStates;
-
-        VkPipelineRasterizationStateCreateInfo rasterInfo{};
-        rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterInfo.pNext = nullptr;
-        rasterInfo.depthClampEnable = VK_FALSE;
-        rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-        rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterInfo.cullMode = VK_CULL_MODE_NONE;
-        rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterInfo.depthBiasEnable = VK_FALSE;
-        rasterInfo.lineWidth = 1;
-
-        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
-        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssemblyInfo.pNext = nullptr;
-        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.pNext = nullptr;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-        VkPipelineCacheCreateInfo pipelineCacheInfo{};
-        pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-        pipelineCacheInfo.pNext = nullptr;
-        pipelineCacheInfo.initialDataSize = 0;
-        pipelineCacheInfo.pInitialData = nullptr;
-        pipelineCacheInfo.flags = 0;
-
-        result = vkCreatePipelineCache(VKRenderer::getInstance().getDevice(), &pipelineCacheInfo, nullptr, &mPCache);
-        assert(result == VK_SUCCESS);
-
-        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
-        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;
-        depthStencil.depthWriteEnable = VK_TRUE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-        depthStencil.depthBoundsTestEnable = VK_FALSE;
-        depthStencil.minDepthBounds = 0.f;
-        depthStencil.maxDepthBounds = 0.f;
-        depthStencil.stencilTestEnable = VK_FALSE;
-        depthStencil.front = {};
-        depthStencil.back = {};
-
-        VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineCreateInfo.pNext = nullptr;
-        pipelineCreateInfo.flags = 0;
-        pipelineCreateInfo.stageCount = 2;
-        pipelineCreateInfo.pStages = shaderStages;
-        pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
-        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyInfo;
-        pipelineCreateInfo.pTessellationState = nullptr;
-        pipelineCreateInfo.pViewportState = &viewportInfo;
-        pipelineCreateInfo.pRasterizationState = &rasterInfo;
-        pipelineCreateInfo.pMultisampleState = &multisampleInfo;
-        pipelineCreateInfo.pDepthStencilState = &depthStencil;
-        pipelineCreateInfo.pColorBlendState = &colorBlendInfo;
-        pipelineCreateInfo.pDynamicState = nullptr;
-        pipelineCreateInfo.layout = mPLayout;
-        pipelineCreateInfo.renderPass = VKRenderer::getInstance().getRenderPass();
-        pipelineCreateInfo.subpass = 0;
-        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-        pipelineCreateInfo.basePipelineIndex = 0;
-
-        result = vkCreateGraphicsPipelines(VKRenderer::getInstance().getDevice(), mPCache, 1, &pipelineCreateInfo, nullptr, &mPipeline);
-        assert(result == VK_SUCCESS);
-
-        vkDestroyShaderModule(VKRenderer::getInstance().getDevice(), vertexShader, nullptr);
-        vkDestroyShaderModule(VKRenderer::getInstance().getDevice(), fragmentShader, nullptr);
-
-        // create command buffer
-        mCmdBufferLen = VKRenderer::getInstance().getSwapChainLength();
-        mCmdBuffer.resize(mCmdBufferLen);
-
-        for (uint32_t bufferIndex = 0; bufferIndex < mCmdBufferLen; bufferIndex++)
+void Model::addOccluders(OcclusionRasterizer &rasterizer) const
+{
+    for (uint32_t i = 0; i < mInstanceBounds.getCount(); i++)
+    {
+        if (mVisibleFlags[i])
         {
-            VkCommandBufferAllocateInfo cmdBufferAllocationInfo{};
-            cmdBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            cmdBufferAllocationInfo.pNext = nullptr;
-            cmdBufferAllocationInfo.commandPool = VKRenderer::getInstance().getCommandPool();
-            cmdBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
-            cmdBufferAllocationInfo.commandBufferCount = 1;
-
-            result = vkAllocateCommandBuffers(VKRenderer::getInstance().getDevice(), &cmdBufferAllocationInfo, &mCmdBuffer[bufferIndex]);
-            assert(result == VK_SUCCESS);
-
-            VkCommandBufferInheritanceInfo cmdBufferInheritanceInfo = {};
-            cmdBufferInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
-            cmdBufferInheritanceInfo.renderPass = VKRenderer::getInstance().getRenderPass();
-            cmdBufferInheritanceInfo.subpass = 0;
-            cmdBufferInheritanceInfo.framebuffer = VKRenderer::getInstance().getFramebuffer(bufferIndex);
-
-            VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-            cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            cmdBufferBeginInfo.pNext = nullptr;
-            cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-            cmdBufferBeginInfo.pInheritanceInfo = &cmdBufferInheritanceInfo;
-
-            result = vkBeginCommandBuffer(mCmdBuffer[bufferIndex], &cmdBufferBeginInfo);
-            assert(result == VK_SUCCESS);
-
-            vkCmdBindPipeline(mCmdBuffer[bufferIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                mPipeline);
-
-            VkBuffer vertexBuffers[] = { mVertexBuffer };
-            VkDeviceSize offsets[] = { 0 };
-            vkCmdBindVertexBuffers(mCmdBuffer[bufferIndex], 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(mCmdBuffer[bufferIndex], mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdBindDescriptorSets(mCmdBuffer[bufferIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mPLayout, 0, 1, &mDescriptorSet, 0, nullptr);
-
-            vkCmdDrawIndexed(mCmdBuffer[bufferIndex], static_cast<uint32_t>(mIndices.size()), 1, 0, 0, 0);
-
-            result = vkEndCommandBuffer(mCmdBuffer[bufferIndex]);
-            assert(result == VK_SUCCESS);
+            rasterizer.addOccluder(mOccluderPositions, mOccluderIndices, mInstanceTransforms[i]);
         }
     }
+}
 
-    // create shadow graphics pipeline
-    {
-        VkDescriptorSetLayout setLayouts[] = { mShadowDescriptorSetLayout };
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.pNext = nullptr;
-        pipelineLayoutCreateInfo.setLayoutCount = 1;
-        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
-        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
-
-        auto result = vkCreatePipelineLayout(VKRenderer::getInstance().getDevice(), &pipelineLayoutCreateInfo, nullptr, &mShadowPLayout);
-        assert(result == VK_SUCCESS);
-
-        Asset vs("shader.vert.spv", 0);
-        auto size = vs.getLength();
-        std::vector<uint8_t> vsData(size);
-        vs.read(vsData.data(), size);
-        vs.close();
-
-        VkShaderModule vertexShader;
-
-        VkShaderModuleCreateInfo shaderModuleCreateInfo{};
-        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        shaderModuleCreateInfo.pNext = nullptr;
-        shaderModuleCreateInfo.codeSize = vsData.size();
-        shaderModuleCreateInfo.pCode = (const uint32_t*)(vsData.data());
-        shaderModuleCreateInfo.flags = 0;
-
-        result = vkCreateShaderModule(
-            VKRenderer::getInstance().getDevice(), &shaderModuleCreateInfo, nullptr, &vertexShader);
-        assert(result == VK_SUCCESS);
-
-
-        VkPipelineShaderStageCreateInfo shaderStages[1];
-
-        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderStages[0].pNext = nullptr;
-        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shaderStages[0].module = vertexShader;
-        shaderStages[0].pSpecializationInfo = nullptr;
-        shaderStages[0].flags = 0;
-        shaderStages[0].pName = "main";
-
-        auto displaySize = VKRenderer::getInstance().getDisplaySize();
-
-        VkViewport viewports;
-        viewports.minDepth = 0.0f;
-        viewports.maxDepth = 1.0f;
-        viewports.x = 0;
-        viewports.y = 0;
-        viewports.width = static_cast<float>(ShadowMap::SHADOWMAP_DIM);
-        viewports.height = static_cast<float>(ShadowMap::SHADOWMAP_DIM);
-
-        VkRect2D scissor;
-        scissor.extent = displaySize;
-        scissor.extent.width = ShadowMap::SHADOWMAP_DIM;
-        scissor.extent.height = ShadowMap::SHADOWMAP_DIM;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-
-        VkPipelineViewportStateCreateInfo viewportInfo{};
-        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportInfo.pNext = nullptr;
-        viewportInfo.viewportCount = 1;
-        viewportInfo.pViewports = &viewports;
-        viewportInfo.scissorCount = 1;
-        viewportInfo.pScissors = &scissor;
-
-        VkSampleMask sampleMask = ~0u;
-        VkPipelineMultisampleStateCreateInfo multisampleInfo{};
-        multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampleInfo.pNext = nullptr;
-        multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampleInfo.sampleShadingEnable = VK_FALSE;
-        multisampleInfo.minSampleShading = 0;
-        multisampleInfo.pSampleMask = &sampleMask;
-        multisampleInfo.alphaToCoverageEnable = VK_FALSE;
-        multisampleInfo.alphaToOneEnable = VK_FALSE;
-
-        VkPipelineRasterizationStateCreateInfo rasterInfo{};
-        rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterInfo.pNext = nullptr;
-        rasterInfo.depthClampEnable = VK_FALSE;
-        rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-        rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterInfo.cullMode = VK_CULL_MODE_NONE;
-        rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterInfo.depthBiasEnable = VK_FALSE;
-        rasterInfo.lineWidth = 1;
-
-        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
-        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssemblyInfo.pNext = nullptr;
-        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.pNext = nullptr;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-        VkPipelineCacheCreateInfo pipelineCacheInfo{};
-        pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-        pipelineCacheInfo.pNext = nullptr;
-        pipelineCacheInfo.initialDataSize = 0;
-        pipelineCacheInfo.pInitialData = nullptr;
-        pipelineCacheInfo.flags = 0;
-
-        result = vkCreatePipelineCache(VKRenderer::getInstance().getDevice(), &pipelineCacheInfo, nullptr, &mShadowPCache);
-        assert(result == VK_SUCCESS);
-
-        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
-        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;
-        depthStencil.depthWriteEnable = VK_TRUE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-        depthStencil.depthBoundsTestEnable = VK_FALSE;
-        depthStencil.minDepthBounds = 0.f;
-        depthStencil.maxDepthBounds = 0.f;
-        depthStencil.stencilTestEnable = VK_FALSE;
-        depthStencil.front = {};
-        depthStencil.back = {};
-
-        VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineCreateInfo.pNext = nullptr;
-        pipelineCreateInfo.flags = 0;
-        pipelineCreateInfo.stageCount = 1;
-        pipelineCreateInfo.pStages = shaderStages;
-        pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
-        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyInfo;
-        pipelineCreateInfo.pTessellationState = nullptr;
-        pipelineCreateInfo.pViewportState = &viewportInfo;
-        pipelineCreateInfo.pRasterizationState = &rasterInfo;
-        pipelineCreateInfo.pMultisampleState = &multisampleInfo;
-        pipelineCreateInfo.pDepthStencilState = &depthStencil;
-        pipelineCreateInfo.pColorBlendState = nullptr;
-        pipelineCreateInfo.pDynamicState = nullptr;
-        pipelineCreateInfo.layout = mShadowPLayout;
-        pipelineCreateInfo.renderPass = VKRenderer::getInstance().getShadowMap()->getRenderPass();
-        pipelineCreateInfo.subpass = 0;
-        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-        pipelineCreateInfo.basePipelineIndex = 0;
-
-        result = vkCreateGraphicsPipelines(VKRenderer::getInstance().getDevice(), mShadowPCache, 1, &pipelineCreateInfo, nullptr, &mShadowPipeline);
-        assert(result == VK_SUCCESS);
-
-        vkDestroyShaderModule(VKRenderer::getInstance().getDevice(), vertexShader, nullptr);
-
-        // create command buffer
-        mCmdBufferLen = VKRenderer::getInstance().getSwapChainLength();
-        mShadowCmdBuffer.resize(mCmdBufferLen);
-
-        for (uint32_t bufferIndex = 0; bufferIndex < mCmdBufferLen; bufferIndex++)
+uint32_t Model::cullOccluded(const OcclusionRasterizer &rasterizer, uint32_t frameIndex)
+{
+    // update() cleared the flags
+    auto flags = reinterpret_cast<uint32_t*>(mUniformStagingData + frameIndex * getStagingSlotSize() +
+        sizeof(UniformBufferObject) + mInstanceCapacity * sizeof(mat4));
+
+    uint32_t occluded = 0;
+    for (uint32_t i = 0; i < mInstanceBounds.getCount(); i++)
+    {
+        if (mVisibleFlags[i] && rasterizer.isOccluded(mInstanceBounds, i))
         {
-            VkCommandBufferAllocateInfo cmdBufferAllocationInfo{};
-            cmdBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            cmdBufferAllocationInfo.pNext = nullptr;
-            cmdBufferAllocationInfo.commandPool = VKRenderer::getInstance().getCommandPool();
-            cmdBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
-            cmdBufferAllocationInfo.commandBufferCount = 1;
-
-            result = vkAllocateCommandBuffers(VKRenderer::getInstance().getDevice(), &cmdBufferAllocationInfo, &mShadowCmdBuffer[bufferIndex]);
-            assert(result == VK_SUCCESS);
-
-            VkCommandBufferInheritanceInfo cmdBufferInheritanceInfo = {};
-            cmdBufferInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
-            cmdBufferInheritanceInfo.renderPass = VKRenderer::getInstance().getShadowMap()->getRenderPass();
-            cmdBufferInheritanceInfo.subpass = 0;
-            cmdBufferInheritanceInfo.framebuffer = VKRenderer::getInstance().getShadowMap()->getFramebuffer();
-
-            VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-            cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            cmdBufferBeginInfo.pNext = nullptr;
-            cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-            cmdBufferBeginInfo.pInheritanceInfo = &cmdBufferInheritanceInfo;
-
-            result = vkBeginCommandBuffer(mShadowCmdBuffer[bufferIndex], &cmdBufferBeginInfo);
-            assert(result == VK_SUCCESS);
-
-            vkCmdBindPipeline(mShadowCmdBuffer[bufferIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                mShadowPipeline);
-
-            VkBuffer vertexBuffers[] = { mVertexBuffer };
-            VkDeviceSize offsets[] = { 0 };
-            vkCmdBindVertexBuffers(mShadowCmdBuffer[bufferIndex], 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(mShadowCmdBuffer[bufferIndex], mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdBindDescriptorSets(mShadowCmdBuffer[bufferIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowPLayout, 0, 1, &mShadowDescriptorSet, 0, nullptr);
-
-            vkCmdDrawIndexed(mShadowCmdBuffer[bufferIndex], static_cast<uint32_t>(mIndices.size()), 1, 0, 0, 0);
-
-            result = vkEndCommandBuffer(mShadowCmdBuffer[bufferIndex]);
-            assert(result == VK_SUCCESS);
+            flags[i] = 1;
+            occluded++;
         }
     }
+
+    return occluded;
 }
 
-Model::~Model()
+void Model::update(const std::array<Frustum, RenderQueue::PASS_COUNT> &frusta, uint32_t frameIndex)
 {
-    vkFreeCommandBuffers(VKRenderer::getInstance().getDevice(), VKRenderer::getInstance().getCommandPool(), static_cast<uint32_t>(mCmdBuffer.size()), mCmdBuffer.data());
-    mCmdBuffer.clear();
-
-    vkFreeCommandBuffers(VKRenderer::getInstance().getDevice(), VKRenderer::getInstance().getCommandPool(), static_cast<uint32_t>(mShadowCmdBuffer.size()), mShadowCmdBuffer.data());
-    mShadowCmdBuffer.clear();
-
-    vkDestroyPipeline(VKRenderer::getInstance().getDevice(), mShadowPipeline, nullptr);
-    vkDestroyPipelineCache(VKRenderer::getInstance().getDevice(), mShadowPCache, nullptr);
-    vkDestroyPipelineLayout(VKRenderer::getInstance().getDevice(), mShadowPLayout, nullptr);
-    vkDestroyPipeline(VKRenderer::getInstance().getDevice(), mPipeline, nullptr);
-    vkDestroyPipelineCache(VKRenderer::getInstance().getDevice(), mPCache, nullptr);
-    vkDestroyPipelineLayout(VKRenderer::getInstance().getDevice(), mPLayout, nullptr);
-    vkDestroyDescriptorSetLayout(VKRenderer::getInstance().getDevice(), mShadowDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(VKRenderer::getInstance().getDevice(), mDescriptorSetLayout, nullptr);
-    vkDestroySampler(VKRenderer::getInstance().getDevice(), mTextureSampler, nullptr);
-    vkDestroyImageView(VKRenderer::getInstance().getDevice(), mTextureImageView, nullptr);
-    vkDestroyImage(VKRenderer::getInstance().getDevice(), mTextureImage, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mTextureImageMemory, nullptr);
-    vkDestroyImage(VKRenderer::getInstance().getDevice(), mStagingImage, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mStagingImageMemory, nullptr);
-    vkFreeDescriptorSets(VKRenderer::getInstance().getDevice(), mShadowDescriptorPool, 1, &mShadowDescriptorSet);
-    vkDestroyDescriptorPool(VKRenderer::getInstance().getDevice(), mShadowDescriptorPool, nullptr);
-    vkFreeDescriptorSets(VKRenderer::getInstance().getDevice(), mDescriptorPool, 1, &mDescriptorSet);
-    vkDestroyDescriptorPool(VKRenderer::getInstance().getDevice(), mDescriptorPool, nullptr);
-    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mShadowUniformBuffer, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mShadowUniformBufferMemory, nullptr);
-    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mUniformBuffer, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mUniformBufferMemory, nullptr);
-    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mShadowUniformStagingBuffer, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mShadowUniformStagingBufferMemory, nullptr);
-    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mUniformStagingBuffer, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, nullptr);
-    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mIndexBuffer, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mIndexBufferMemory, nullptr);
-    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mVertexBuffer, nullptr);
-    vkFreeMemory(VKRenderer::getInstance().getDevice(), mVertexBufferMemory, nullptr);
+    uint32_t instanceCount = static_cast<uint32_t>(mInstanceIds.size());
+    mInstanceBounds.resize(instanceCount);
+    for (uint32_t i = 0; i < instanceCount; i++)
+    {
+        mInstanceBounds.set(i, mInstanceTransforms[i], mBoundingBox);
+    }
+
+    mVisibleFlags.resize(instanceCount);
+    for (uint32_t pass = 0; pass < RenderQueue::PASS_COUNT; pass++)
+    {
+        mVisibleInstanceCounts[pass] = frusta[pass].countVisible(mInstanceBounds, pass == RenderQueue::PASS_MAIN ? mVisibleFlags.data() : nullptr);
+
+        // plane 4 is the near plane, the shadow pass keeps no flags and takes all instances
+        vec4 nearPlane = frusta[pass].getPlane(4);
+        float depth = FLT_MAX;
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            if (pass == RenderQueue::PASS_MAIN && !mVisibleFlags[i])
+            {
+                continue;
+            }
+
+            float distance = nearPlane[0] * mInstanceBounds.getCenterX()[i] + nearPlane[1] * mInstanceBounds.getCenterY()[i] +
+                nearPlane[2] * mInstanceBounds.getCenterZ()[i] + nearPlane[3];
+            depth = std::min(depth, distance);
+        }
+        mSortDepths[pass] = std::max(depth, 0.f);
+    }
+
+    uint8_t* staging = mUniformStagingData + frameIndex * getStagingSlotSize();
+
+    UniformBufferObject ubo = {};
+    ubo.instanceCount = instanceCount;
+    ubo.instanceCapacity = mInstanceCapacity;
+    ubo.lodCount = mLodCount;
+    ubo.clusterSlotCount = mClusterSlotCount;
+    for (uint32_t i = 0; i < mLodCount; i++)
+    {
+        ubo.lodErrors[i] = mLods[i].error;
+    }
+
+    memcpy(staging, &ubo, sizeof(ubo));
+    memcpy(staging + sizeof(ubo), mInstanceTransforms.data(), mInstanceTransforms.size() * sizeof(mat4));
+    memset(staging + sizeof(ubo) + mInstanceCapacity * sizeof(mat4), 0, instanceCount * sizeof(uint32_t));
 }
 
-void Model::executeCommandBuffer(VkCommandBuffer primaryCmdBuffer, uint32_t nextIndex)
+void Model::recordUniformCopies(VkCommandBuffer cmdBuffer, uint32_t frameIndex) const
 {
-    vkCmdExecuteCommands(primaryCmdBuffer, 1, &mCmdBuffer[nextIndex]);
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = frameIndex * getStagingSlotSize();
+    copyRegion.size = sizeof(UniformBufferObject);
+    vkCmdCopyBuffer(cmdBuffer, mUniformStagingBuffer, mUniformBuffer, 1, &copyRegion);
+
+    // the whole capacity, so the copy stays valid while instances come and go
+    copyRegion.srcOffset += sizeof(UniformBufferObject);
+    copyRegion.size = mInstanceCapacity * sizeof(mat4);
+    vkCmdCopyBuffer(cmdBuffer, mUniformStagingBuffer, mInstanceBuffer, 1, &copyRegion);
+
+    copyRegion.srcOffset += copyRegion.size;
+    copyRegion.size = mInstanceCapacity * sizeof(uint32_t);
+    vkCmdCopyBuffer(cmdBuffer, mUniformStagingBuffer, mOccludedBuffer, 1, &copyRegion);
+
+    // the cull pass counts the visible instances from zero. All LODs index the same vertices,
+    // their draws differ in the range of the index buffer and of the visible instances.
+    std::array<VkDrawIndexedIndirectCommand, 2 * MeshSimplifier::MAX_LODS + ClusterCuller::INSTANCE_SLOTS> draws = {};
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t lod = 0; lod < mLodCount; lod++)
+        {
+            auto &draw = draws[pass * MeshSimplifier::MAX_LODS + lod];
+            draw.indexCount = mLods[lod].indexCount;
+            draw.firstIndex = mGeometry.firstIndex + mLods[lod].firstIndex;
+            draw.vertexOffset = static_cast<int32_t>(mGeometry.vertexOffset);
+            draw.firstInstance = lod * mInstanceCapacity;
+        }
+    }
+
+    // a single instance each, the cluster cull pass counts the indices it copies from zero
+    for (uint32_t slot = 0; slot < mClusterSlotCount; slot++)
+    {
+        auto &draw = draws[2 * MeshSimplifier::MAX_LODS + slot];
+        draw.instanceCount = 1;
+        draw.firstIndex = mClusterIndices.firstIndex + slot * mLods[0].indexCount;
+        draw.vertexOffset = static_cast<int32_t>(mGeometry.vertexOffset);
+        draw.firstInstance = mLodCount * mInstanceCapacity + slot;
+    }
+    vkCmdUpdateBuffer(cmdBuffer, mIndirectBuffer, 0, sizeof(draws), draws.data());
+    vkCmdFillBuffer(cmdBuffer, mIndirectBuffer, sizeof(draws), sizeof(uint32_t), 0);
 }
 
-void Model::executeShadowCommandBuffer(VkCommandBuffer primaryCmdBuffer, uint32_t nextIndex)
+void Model::recordCull(VkCommandBuffer cmdBuffer, InstanceCuller::Phase phase) const
 {
-    vkCmdExecuteCommands(primaryCmdBuffer, 1, &mShadowCmdBuffer[nextIndex]);
+    VKRenderer::getInstance().getInstanceCuller()->recordDispatch(cmdBuffer, mCullDescriptorSet.set, mBoundingSphere, mInstanceCapacity, phase);
 }
 
-void Model::update()
+void Model::recordClusterCull(VkCommandBuffer cmdBuffer, InstanceCuller::Phase phase) const
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
+    if (mClusterSlotCount == 0)
+    {
+        return;
+    }
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count() / 1000.0f;
-    auto displaySize = VKRenderer::getInstance().getDisplaySize();
+    ClusterCuller::Dispatch dispatch = {};
+    dispatch.meshletCount = static_cast<uint32_t>(mMeshlets.size());
+    dispatch.firstVisible = mLodCount * mInstanceCapacity;
+    dispatch.slotCount = mClusterSlotCount;
+    dispatch.meshFirstIndex = mGeometry.firstIndex + mLods[0].firstIndex;
+    dispatch.outputFirstIndex = mClusterIndices.firstIndex;
+    dispatch.slotIndexCount = mLods[0].indexCount;
 
-    UniformBufferObject ubo = {};
-    mat4 transMat = Matrix<float, 4>::FromTranslationVector(Vector<float, 3>{ 0, 0, mOffsetZ });
-    auto rotMat = Matrix<float, 3>::RotationY(time * 90.f / 180.f * 3.1415926f);
-    ubo.model = transMat * mat4::FromRotationMatrix(rotMat);
-
-    // offscreen shadow ubo
-    ubo.view = mat4::LookAt(vec3(0.0f, 0.0f, 0.0f), vec3(2.f, 2.f, -2.f), vec3(0.0f, 1.0f, 0.0f), 1.0f);
-    vec3 sphereCenterRS;
-    sphereCenterRS = ubo.view * vec3(0, 0, 0);
-    float l = sphereCenterRS.x() - 10;
-    float b = sphereCenterRS.y() - 10;
-    float n = sphereCenterRS.z() - 10;
-    float r = sphereCenterRS.x() + 10;
-    float t = sphereCenterRS.y() + 10;
-    float f = sphereCenterRS.z() + 10;
-    ubo.proj = mat4::Ortho(l, r, b, t, n, f, 1.f);
-    ubo.proj(1, 1) *= -1;
-
-    void* data = nullptr;
-    vkMapMemory(VKRenderer::getInstance().getDevice(), mShadowUniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-    assert(data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(VKRenderer::getInstance().getDevice(), mShadowUniformStagingBufferMemory);
-
-    VKRenderer::getInstance().copyBuffer(mShadowUniformStagingBuffer, mShadowUniformBuffer, sizeof(ubo));
-
-    mat4 T(
-        0.5f, 0.0f, 0.0f, 0.0f,
-        0.0f, 0.5f, 0.0f, 0.0f,
-        0.0f, 0.0f, 1.0f, 0.0f,
-        0.5f, 0.5f, 0.0f, 1.0f);
-
-    // on screen ubo
-    ubo.shadowTransform = T * ubo.proj * ubo.view * ubo.model;
-    ubo.view = mat4::LookAt(vec3(0.0f, 0.0f, 0.0f), vec3(4.0f, 4.0f, 4.0f), vec3(0.0f, 1.0f, 0.0f), 1.0f);
-    ubo.proj = mat4::Perspective((45.0f) / 180.f * 3.1415926f, (float)displaySize.width / (float)displaySize.height, 0.1f, 10.0f);
-    ubo.proj(1, 1) *= -1; 
-
-    vkMapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-    assert(data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory);
+    VKRenderer::getInstance().getClusterCuller()->recordDispatch(cmdBuffer, mClusterCullDescriptorSet.set, dispatch, phase);
+}
+
+void Model::recordMainDrawReset(VkCommandBuffer cmdBuffer) const
+{
+    for (uint32_t lod = 0; lod < mLodCount; lod++)
+    {
+        VkDeviceSize offset = lod * sizeof(VkDrawIndexedIndirectCommand) + offsetof(VkDrawIndexedIndirectCommand, instanceCount);
+        vkCmdFillBuffer(cmdBuffer, mIndirectBuffer, offset, sizeof(uint32_t), 0);
+    }
 
-    VKRenderer::getInstance().copyBuffer(mUniformStagingBuffer, mUniformBuffer, sizeof(ubo));
+    // the slots are handed out again from the first
+    if (mClusterSlotCount > 0)
+    {
+        for (uint32_t slot = 0; slot < mClusterSlotCount; slot++)
+        {
+            VkDeviceSize offset = (2 * MeshSimplifier::MAX_LODS + slot) * sizeof(VkDrawIndexedIndirectCommand) + offsetof(VkDrawIndexedIndirectCommand, indexCount);
+            vkCmdFillBuffer(cmdBuffer, mIndirectBuffer, offset, sizeof(uint32_t), 0);
+        }
+
+        VkDeviceSize offset = (2 * MeshSimplifier::MAX_LODS + ClusterCuller::INSTANCE_SLOTS) * sizeof(VkDrawIndexedIndirectCommand);
+        vkCmdFillBuffer(cmdBuffer, mIndirectBuffer, offset, sizeof(uint32_t), 0);
+    }
 }
\ No newline at end of file
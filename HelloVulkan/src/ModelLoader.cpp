@@ -0,0 +1,69 @@
+#include "Logging.h"
+#include "Model.h"
+#include "ModelLoader.h"
+
+ModelLoader::ModelLoader()
+{
+    mThread = std::thread(&ModelLoader::run, this);
+}
+
+ModelLoader::~ModelLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mCondition.notify_one();
+    mThread.join();
+
+    // never claimed by the renderer, their uploads are tracked by the deletion queue
+    for (auto &result : mLoaded)
+    {
+        delete result.model;
+    }
+    mLoaded.clear();
+}
+
+void ModelLoader::request(const std::string &name)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRequests.push_back(name);
+    }
+    mCondition.notify_one();
+}
+
+void ModelLoader::poll(std::vector<Result> &loaded)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    loaded.insert(loaded.end(), mLoaded.begin(), mLoaded.end());
+    mLoaded.clear();
+}
+
+void ModelLoader::run()
+{
+    while (true)
+    {
+        std::string name;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this]() { return mQuit || !mRequests.empty(); });
+
+            if (mQuit)
+            {
+                return;
+            }
+
+            name = mRequests.front();
+            mRequests.pop_front();
+        }
+
+        LOGI("loading model %s\n", name.c_str());
+        Model* model = new Model(name);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mLoaded.push_back({ name, model });
+        }
+    }
+}
@@ -0,0 +1,498 @@
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "Asset.h"
+#include "DescriptorAllocator.h"
+#include "MaterialTable.h"
+#include "Model.h"
+#include "ModelPipeline.h"
+#include "ShadowMap.h"
+#include "VKRenderer.h"
+#include "ViewUniforms.h"
+
+static std::atomic<uint32_t> sNextPipelineId{ 0 };
+
+ModelPipeline::ModelPipeline()
+    : mPipelineId(sNextPipelineId.fetch_add(1))
+    , mShadowPipelineId(sNextPipelineId.fetch_add(1))
+{
+    // create descriptor set layout, binding 0 is left out since the camera is in the view
+    // uniform block at set 0. With the material table the texture and the shadow map are
+    // in its set instead.
+    auto materialTable = VKRenderer::getInstance().getMaterialTable();
+    auto &descriptorAllocator = VKRenderer::getInstance().getDescriptorAllocator();
+    {
+        VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
+        samplerLayoutBinding.binding = 1;
+        samplerLayoutBinding.descriptorCount = 1;
+        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerLayoutBinding.pImmutableSamplers = nullptr;
+        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutBinding shadowSamplerLayoutBinding = {};
+        shadowSamplerLayoutBinding.binding = 2;
+        shadowSamplerLayoutBinding.descriptorCount = 1;
+        shadowSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        shadowSamplerLayoutBinding.pImmutableSamplers = nullptr;
+        shadowSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+        instanceLayoutBinding.binding = 3;
+        instanceLayoutBinding.descriptorCount = 1;
+        instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        instanceLayoutBinding.pImmutableSamplers = nullptr;
+        instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutBinding visibleLayoutBinding = {};
+        visibleLayoutBinding.binding = 4;
+        visibleLayoutBinding.descriptorCount = 1;
+        visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        visibleLayoutBinding.pImmutableSamplers = nullptr;
+        visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings = { instanceLayoutBinding, visibleLayoutBinding };
+        if (!materialTable)
+        {
+            bindings.push_back(samplerLayoutBinding);
+            bindings.push_back(shadowSamplerLayoutBinding);
+        }
+
+        mDescriptorSetLayout = descriptorAllocator.getLayout(bindings.data(), static_cast<uint32_t>(bindings.size()));
+
+        // create update template, the bindings in the order of DescriptorData
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(bindings.size());
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            entries[i].dstBinding = bindings[i].binding;
+            entries[i].dstArrayElement = 0;
+            entries[i].descriptorCount = 1;
+            entries[i].descriptorType = bindings[i].descriptorType;
+        }
+        entries[0].offset = offsetof(DescriptorData, instanceBuffer);
+        entries[0].stride = sizeof(VkDescriptorBufferInfo);
+        entries[1].offset = offsetof(DescriptorData, visibleBuffer);
+        entries[1].stride = sizeof(VkDescriptorBufferInfo);
+        if (!materialTable)
+        {
+            entries[2].offset = offsetof(DescriptorData, texture);
+            entries[2].stride = sizeof(VkDescriptorImageInfo);
+            entries[3].offset = offsetof(DescriptorData, shadowMap);
+            entries[3].stride = sizeof(VkDescriptorImageInfo);
+        }
+
+        mUpdateTemplate = descriptorAllocator.createUpdateTemplate(mDescriptorSetLayout, entries);
+    }
+
+    // create shadow descriptor set layout
+    {
+        VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+        instanceLayoutBinding.binding = 3;
+        instanceLayoutBinding.descriptorCount = 1;
+        instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        instanceLayoutBinding.pImmutableSamplers = nullptr;
+        instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutBinding visibleLayoutBinding = {};
+        visibleLayoutBinding.binding = 4;
+        visibleLayoutBinding.descriptorCount = 1;
+        visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        visibleLayoutBinding.pImmutableSamplers = nullptr;
+        visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings = { instanceLayoutBinding, visibleLayoutBinding };
+
+        // the same handle as the main layout when the material table takes the textures
+        mShadowDescriptorSetLayout = descriptorAllocator.getLayout(bindings.data(), static_cast<uint32_t>(bindings.size()));
+
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(bindings.size());
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            entries[i].dstBinding = bindings[i].binding;
+            entries[i].dstArrayElement = 0;
+            entries[i].descriptorCount = 1;
+            entries[i].descriptorType = bindings[i].descriptorType;
+            entries[i].stride = sizeof(VkDescriptorBufferInfo);
+        }
+        entries[0].offset = offsetof(DescriptorData, instanceBuffer);
+        entries[1].offset = offsetof(DescriptorData, visibleBuffer);
+
+        mShadowUpdateTemplate = descriptorAllocator.createUpdateTemplate(mShadowDescriptorSetLayout, entries);
+    }
+
+    // create graphics pipeline, the material table adds set 2 and the material of the draw
+    {
+        std::vector<VkDescriptorSetLayout> setLayouts = { VKRenderer::getInstance().getViewUniforms()->getDescriptorSetLayout(), mDescriptorSetLayout };
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(uint32_t);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.pNext = nullptr;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+        if (materialTable)
+        {
+            setLayouts.push_back(materialTable->getDescriptorSetLayout());
+            pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+            pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+        }
+        pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+
+        auto result = vkCreatePipelineLayout(VKRenderer::getInstance().getDevice(), &pipelineLayoutCreateInfo, nullptr, &mPLayout);
+        assert(result == VK_SUCCESS);
+
+        Asset vs("shader.vert.spv", 0);
+        auto size = vs.getLength();
+        std::vector<uint8_t> vsData(size);
+        vs.read(vsData.data(), size);
+        vs.close();
+
+        Asset fs(materialTable ? "shader_bindless.frag.spv" : "shader.frag.spv", 0);
+        size = fs.getLength();
+        std::vector<uint8_t> fsData(size);
+        fs.read(fsData.data(), size);
+        fs.close();
+
+        VkShaderModule vertexShader, fragmentShader;
+
+        VkShaderModuleCreateInfo shaderModuleCreateInfo;
+        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCreateInfo.pNext = nullptr;
+        shaderModuleCreateInfo.codeSize = vsData.size();
+        shaderModuleCreateInfo.pCode = (const uint32_t*)(vsData.data());
+        shaderModuleCreateInfo.flags = 0;
+
+        result = vkCreateShaderModule(
+            VKRenderer::getInstance().getDevice(), &shaderModuleCreateInfo, nullptr, &vertexShader);
+        assert(result == VK_SUCCESS);
+
+        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCreateInfo.pNext = nullptr;
+        shaderModuleCreateInfo.codeSize = fsData.size();
+        shaderModuleCreateInfo.pCode = (const uint32_t*)(fsData.data());
+        shaderModuleCreateInfo.flags = 0;
+
+        result = vkCreateShaderModule(
+            VKRenderer::getInstance().getDevice(), &shaderModuleCreateInfo, nullptr, &fragmentShader);
+        assert(result == VK_SUCCESS);
+
+        VkPipelineShaderStageCreateInfo shaderStages[2];
+
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].pNext = nullptr;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = vertexShader;
+        shaderStages[0].pSpecializationInfo = nullptr;
+        shaderStages[0].flags = 0;
+        shaderStages[0].pName = "main";
+
+        shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[1].pNext = nullptr;
+        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[1].module = fragmentShader;
+        shaderStages[1].pSpecializationInfo = nullptr;
+        shaderStages[1].flags = 0;
+        shaderStages[1].pName = "main";
+
+        auto displaySize = VKRenderer::getInstance().getDisplaySize();
+
+        VkViewport viewports;
+        viewports.minDepth = 0.0f;
+        viewports.maxDepth = 1.0f;
+        viewports.x = 0;
+        viewports.y = 0;
+        viewports.width = (float)displaySize.width;
+        viewports.height = (float)displaySize.height;
+
+        VkRect2D scissor;
+        scissor.extent = displaySize;
+        scissor.offset.x = 0;
+        scissor.offset.y = 0;
+
+        VkPipelineViewportStateCreateInfo viewportInfo{};
+        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportInfo.pNext = nullptr;
+        viewportInfo.viewportCount = 1;
+        viewportInfo.pViewports = &viewports;
+        viewportInfo.scissorCount = 1;
+        viewportInfo.pScissors = &scissor;
+
+        VkSampleMask sampleMask = ~0u;
+        VkPipelineMultisampleStateCreateInfo multisampleInfo{};
+        multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampleInfo.pNext = nullptr;
+        multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampleInfo.sampleShadingEnable = VK_FALSE;
+        multisampleInfo.minSampleShading = 0;
+        multisampleInfo.pSampleMask = &sampleMask;
+        multisampleInfo.alphaToCoverageEnable = VK_FALSE;
+        multisampleInfo.alphaToOneEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState attachmentStates{};
+        attachmentStates.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        attachmentStates.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlendInfo{};
+        colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlendInfo.pNext = nullptr;
+        colorBlendInfo.logicOpEnable = VK_FALSE;
+        colorBlendInfo.logicOp = VK_LOGIC_OP_COPY;
+        colorBlendInfo.attachmentCount = 1;
+        colorBlendInfo.pAttachments = &attachmentStates;
+
+        VkPipelineRasterizationStateCreateInfo rasterInfo{};
+        rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterInfo.pNext = nullptr;
+        rasterInfo.depthClampEnable = VK_FALSE;
+        rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+        rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterInfo.cullMode = VK_CULL_MODE_NONE;
+        rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterInfo.depthBiasEnable = VK_FALSE;
+        rasterInfo.lineWidth = 1;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssemblyInfo.pNext = nullptr;
+        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+        auto bindingDescription = Model::Vertex::getBindingDescription();
+        auto attributeDescriptions = Model::Vertex::getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.pNext = nullptr;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineCacheCreateInfo pipelineCacheInfo{};
+        pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        pipelineCacheInfo.pNext = nullptr;
+        pipelineCacheInfo.initialDataSize = 0;
+        pipelineCacheInfo.pInitialData = nullptr;
+        pipelineCacheInfo.flags = 0;
+
+        result = vkCreatePipelineCache(VKRenderer::getInstance().getDevice(), &pipelineCacheInfo, nullptr, &mPCache);
+        assert(result == VK_SUCCESS);
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.minDepthBounds = 0.f;
+        depthStencil.maxDepthBounds = 0.f;
+        depthStencil.stencilTestEnable = VK_FALSE;
+        depthStencil.front = {};
+        depthStencil.back = {};
+
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineCreateInfo.pNext = nullptr;
+        pipelineCreateInfo.flags = 0;
+        pipelineCreateInfo.stageCount = 2;
+        pipelineCreateInfo.pStages = shaderStages;
+        pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyInfo;
+        pipelineCreateInfo.pTessellationState = nullptr;
+        pipelineCreateInfo.pViewportState = &viewportInfo;
+        pipelineCreateInfo.pRasterizationState = &rasterInfo;
+        pipelineCreateInfo.pMultisampleState = &multisampleInfo;
+        pipelineCreateInfo.pDepthStencilState = &depthStencil;
+        pipelineCreateInfo.pColorBlendState = &colorBlendInfo;
+        pipelineCreateInfo.pDynamicState = nullptr;
+        pipelineCreateInfo.layout = mPLayout;
+        pipelineCreateInfo.renderPass = VKRenderer::getInstance().getRenderPass();
+        pipelineCreateInfo.subpass = 0;
+        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineCreateInfo.basePipelineIndex = 0;
+
+        result = vkCreateGraphicsPipelines(VKRenderer::getInstance().getDevice(), mPCache, 1, &pipelineCreateInfo, nullptr, &mPipeline);
+        assert(result == VK_SUCCESS);
+
+        vkDestroyShaderModule(VKRenderer::getInstance().getDevice(), vertexShader, nullptr);
+        vkDestroyShaderModule(VKRenderer::getInstance().getDevice(), fragmentShader, nullptr);
+
+    }
+
+    // create shadow graphics pipeline
+    {
+        VkDescriptorSetLayout setLayouts[] = { VKRenderer::getInstance().getViewUniforms()->getDescriptorSetLayout(), mShadowDescriptorSetLayout };
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.pNext = nullptr;
+        pipelineLayoutCreateInfo.setLayoutCount = 2;
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+
+        auto result = vkCreatePipelineLayout(VKRenderer::getInstance().getDevice(), &pipelineLayoutCreateInfo, nullptr, &mShadowPLayout);
+        assert(result == VK_SUCCESS);
+
+        Asset vs("shadow.vert.spv", 0);
+        auto size = vs.getLength();
+        std::vector<uint8_t> vsData(size);
+        vs.read(vsData.data(), size);
+        vs.close();
+
+        VkShaderModule vertexShader;
+
+        VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCreateInfo.pNext = nullptr;
+        shaderModuleCreateInfo.codeSize = vsData.size();
+        shaderModuleCreateInfo.pCode = (const uint32_t*)(vsData.data());
+        shaderModuleCreateInfo.flags = 0;
+
+        result = vkCreateShaderModule(
+            VKRenderer::getInstance().getDevice(), &shaderModuleCreateInfo, nullptr, &vertexShader);
+        assert(result == VK_SUCCESS);
+
+
+        VkPipelineShaderStageCreateInfo shaderStages[1];
+
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].pNext = nullptr;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = vertexShader;
+        shaderStages[0].pSpecializationInfo = nullptr;
+        shaderStages[0].flags = 0;
+        shaderStages[0].pName = "main";
+
+        auto displaySize = VKRenderer::getInstance().getDisplaySize();
+
+        VkViewport viewports;
+        viewports.minDepth = 0.0f;
+        viewports.maxDepth = 1.0f;
+        viewports.x = 0;
+        viewports.y = 0;
+        viewports.width = static_cast<float>(ShadowMap::SHADOWMAP_DIM);
+        viewports.height = static_cast<float>(ShadowMap::SHADOWMAP_DIM);
+
+        VkRect2D scissor;
+        scissor.extent = displaySize;
+        scissor.extent.width = ShadowMap::SHADOWMAP_DIM;
+        scissor.extent.height = ShadowMap::SHADOWMAP_DIM;
+        scissor.offset.x = 0;
+        scissor.offset.y = 0;
+
+        VkPipelineViewportStateCreateInfo viewportInfo{};
+        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportInfo.pNext = nullptr;
+        viewportInfo.viewportCount = 1;
+        viewportInfo.pViewports = &viewports;
+        viewportInfo.scissorCount = 1;
+        viewportInfo.pScissors = &scissor;
+
+        VkSampleMask sampleMask = ~0u;
+        VkPipelineMultisampleStateCreateInfo multisampleInfo{};
+        multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampleInfo.pNext = nullptr;
+        multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampleInfo.sampleShadingEnable = VK_FALSE;
+        multisampleInfo.minSampleShading = 0;
+        multisampleInfo.pSampleMask = &sampleMask;
+        multisampleInfo.alphaToCoverageEnable = VK_FALSE;
+        multisampleInfo.alphaToOneEnable = VK_FALSE;
+
+        VkPipelineRasterizationStateCreateInfo rasterInfo{};
+        rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterInfo.pNext = nullptr;
+        rasterInfo.depthClampEnable = VK_FALSE;
+        rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+        rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterInfo.cullMode = VK_CULL_MODE_NONE;
+        rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterInfo.depthBiasEnable = VK_FALSE;
+        rasterInfo.lineWidth = 1;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssemblyInfo.pNext = nullptr;
+        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+        auto bindingDescription = Model::Vertex::getBindingDescription();
+        auto attributeDescriptions = Model::Vertex::getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.pNext = nullptr;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineCacheCreateInfo pipelineCacheInfo{};
+        pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        pipelineCacheInfo.pNext = nullptr;
+        pipelineCacheInfo.initialDataSize = 0;
+        pipelineCacheInfo.pInitialData = nullptr;
+        pipelineCacheInfo.flags = 0;
+
+        result = vkCreatePipelineCache(VKRenderer::getInstance().getDevice(), &pipelineCacheInfo, nullptr, &mShadowPCache);
+        assert(result == VK_SUCCESS);
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.minDepthBounds = 0.f;
+        depthStencil.maxDepthBounds = 0.f;
+        depthStencil.stencilTestEnable = VK_FALSE;
+        depthStencil.front = {};
+        depthStencil.back = {};
+
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineCreateInfo.pNext = nullptr;
+        pipelineCreateInfo.flags = 0;
+        pipelineCreateInfo.stageCount = 1;
+        pipelineCreateInfo.pStages = shaderStages;
+        pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyInfo;
+        pipelineCreateInfo.pTessellationState = nullptr;
+        pipelineCreateInfo.pViewportState = &viewportInfo;
+        pipelineCreateInfo.pRasterizationState = &rasterInfo;
+        pipelineCreateInfo.pMultisampleState = &multisampleInfo;
+        pipelineCreateInfo.pDepthStencilState = &depthStencil;
+        pipelineCreateInfo.pColorBlendState = nullptr;
+        pipelineCreateInfo.pDynamicState = nullptr;
+        pipelineCreateInfo.layout = mShadowPLayout;
+        pipelineCreateInfo.renderPass = VKRenderer::getInstance().getShadowMap()->getRenderPass();
+        pipelineCreateInfo.subpass = 0;
+        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineCreateInfo.basePipelineIndex = 0;
+
+        result = vkCreateGraphicsPipelines(VKRenderer::getInstance().getDevice(), mShadowPCache, 1, &pipelineCreateInfo, nullptr, &mShadowPipeline);
+        assert(result == VK_SUCCESS);
+
+        vkDestroyShaderModule(VKRenderer::getInstance().getDevice(), vertexShader, nullptr);
+
+    }
+}
+
+ModelPipeline::~ModelPipeline()
+{
+    // the renderer waited for the device, no model is drawn anymore
+    vkDestroyPipeline(VKRenderer::getInstance().getDevice(), mShadowPipeline, nullptr);
+    vkDestroyPipelineCache(VKRenderer::getInstance().getDevice(), mShadowPCache, nullptr);
+    vkDestroyPipelineLayout(VKRenderer::getInstance().getDevice(), mShadowPLayout, nullptr);
+    vkDestroyPipeline(VKRenderer::getInstance().getDevice(), mPipeline, nullptr);
+    vkDestroyPipelineCache(VKRenderer::getInstance().getDevice(), mPCache, nullptr);
+    vkDestroyPipelineLayout(VKRenderer::getInstance().getDevice(), mPLayout, nullptr);
+}
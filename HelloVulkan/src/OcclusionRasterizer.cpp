@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "OcclusionRasterizer.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+
+typedef __m128 Float4;
+typedef __m128 Mask4;
+
+static inline Float4 simdSplat(float value) { return _mm_set1_ps(value); }
+static inline Float4 simdSet(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline Float4 simdAdd(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+static inline Float4 simdMul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+static inline Mask4 simdGreaterEqual(Float4 a, Float4 b) { return _mm_cmpge_ps(a, b); }
+static inline Mask4 simdAnd(Mask4 a, Mask4 b) { return _mm_and_ps(a, b); }
+static inline uint32_t simdBits(Mask4 mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask)); }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+typedef float32x4_t Float4;
+typedef uint32x4_t Mask4;
+
+static inline Float4 simdSplat(float value) { return vdupq_n_f32(value); }
+static inline Float4 simdSet(float a, float b, float c, float d) { float values[4] = { a, b, c, d }; return vld1q_f32(values); }
+static inline Float4 simdAdd(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+static inline Float4 simdMul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+static inline Mask4 simdGreaterEqual(Float4 a, Float4 b) { return vcgeq_f32(a, b); }
+static inline Mask4 simdAnd(Mask4 a, Mask4 b) { return vandq_u32(a, b); }
+static inline uint32_t simdBits(Mask4 mask) { static const uint32_t laneBits[4] = { 1, 2, 4, 8 }; return vaddvq_u32(vandq_u32(mask, vld1q_u32(laneBits))); }
+#else
+struct Float4 { float v[4]; };
+struct Mask4 { bool v[4]; };
+
+static inline Float4 simdSplat(float value) { return Float4{ { value, value, value, value } }; }
+static inline Float4 simdSet(float a, float b, float c, float d) { return Float4{ { a, b, c, d } }; }
+static inline Float4 simdAdd(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline Float4 simdMul(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline Mask4 simdGreaterEqual(Float4 a, Float4 b) { Mask4 m; for (int i = 0; i < 4; i++) m.v[i] = a.v[i] >= b.v[i]; return m; }
+static inline Mask4 simdAnd(Mask4 a, Mask4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] && b.v[i]; return a; }
+static inline uint32_t simdBits(Mask4 mask) { return (mask.v[0] ? 1 : 0) | (mask.v[1] ? 2 : 0) | (mask.v[2] ? 4 : 0) | (mask.v[3] ? 8 : 0); }
+#endif
+
+using namespace mathfu;
+
+const uint32_t OcclusionRasterizer::WIDTH = 256;
+const uint32_t OcclusionRasterizer::HEIGHT = 128;
+const uint32_t OcclusionRasterizer::TILE_WIDTH = 8;
+const uint32_t OcclusionRasterizer::TILE_HEIGHT = 4;
+const uint32_t OcclusionRasterizer::BIN_WIDTH = 8;
+const uint32_t OcclusionRasterizer::BIN_HEIGHT = 8;
+const uint32_t OcclusionRasterizer::TRIANGLE_BUDGET = 8192;
+
+// reference depth of tiles no occluder covers, nothing is behind it
+static const float EMPTY_DEPTH = FLT_MAX;
+// working depth of tiles without partial coverage
+static const float NO_DEPTH = -FLT_MAX;
+// vertices this close to the camera plane aren't projected
+static const float MIN_W = 1e-4f;
+static const uint32_t FULL_MASK = 0xffffffff;
+
+// matrix stored row by row
+static void transformPoint(const float* matrix, float x, float y, float z, float* clip)
+{
+    for (int row = 0; row < 4; row++)
+    {
+        clip[row] = matrix[row * 4] * x + matrix[row * 4 + 1] * y + matrix[row * 4 + 2] * z + matrix[row * 4 + 3];
+    }
+}
+
+OcclusionRasterizer::OcclusionRasterizer(JobSystem &jobSystem)
+    : mJobSystem(jobSystem)
+    , mTilesX(WIDTH / TILE_WIDTH)
+    , mTilesY(HEIGHT / TILE_HEIGHT)
+    , mBinsX((WIDTH / TILE_WIDTH + BIN_WIDTH - 1) / BIN_WIDTH)
+    , mBinsY((HEIGHT / TILE_HEIGHT + BIN_HEIGHT - 1) / BIN_HEIGHT)
+{
+    mTiles.resize(mTilesX * mTilesY, Tile{ EMPTY_DEPTH, NO_DEPTH, 0 });
+    mBins.resize(mBinsX * mBinsY);
+}
+
+void OcclusionRasterizer::begin(const mat4 &viewProj)
+{
+    for (int row = 0; row < 4; row++)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            mViewProj[row * 4 + column] = viewProj(row, column);
+        }
+    }
+    mTriangles.clear();
+    for (auto &bin : mBins)
+    {
+        bin.clear();
+    }
+}
+
+void OcclusionRasterizer::addOccluder(const std::vector<float> &positions, const std::vector<uint32_t> &indices, const mat4 &transform)
+{
+    float mvp[16];
+    for (int row = 0; row < 4; row++)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            mvp[row * 4 + column] = 0.f;
+            for (int k = 0; k < 4; k++)
+            {
+                mvp[row * 4 + column] += mViewProj[row * 4 + k] * transform(k, column);
+            }
+        }
+    }
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        if (mTriangles.size() >= TRIANGLE_BUDGET)
+        {
+            return;
+        }
+
+        Triangle triangle;
+        bool projected = true;
+        for (int v = 0; v < 3 && projected; v++)
+        {
+            const float* position = &positions[3 * indices[i + v]];
+            float clip[4];
+            transformPoint(mvp, position[0], position[1], position[2], clip);
+
+            // crossing the camera plane would need clipping, dropping the triangle only
+            // loses some occlusion
+            projected = clip[3] >= MIN_W;
+
+            float invW = 1.f / clip[3];
+            triangle.x[v] = (clip[0] * invW * 0.5f + 0.5f) * WIDTH;
+            triangle.y[v] = (clip[1] * invW * 0.5f + 0.5f) * HEIGHT;
+            triangle.z[v] = clip[2] * invW;
+        }
+
+        if (!projected)
+        {
+            continue;
+        }
+
+        // wind every triangle the same way, so the edge functions are positive inside
+        float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+        if (area == 0.f)
+        {
+            continue;
+        }
+
+        if (area < 0.f)
+        {
+            std::swap(triangle.x[1], triangle.x[2]);
+            std::swap(triangle.y[1], triangle.y[2]);
+            std::swap(triangle.z[1], triangle.z[2]);
+        }
+
+        // tiles of the screen rectangle, triangles off screen are dropped before binning
+        float minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+        float maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+        float minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+        float maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+
+        int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+        int x1 = std::min(static_cast<int>(std::ceil(maxX)), static_cast<int>(WIDTH));
+        int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+        int y1 = std::min(static_cast<int>(std::ceil(maxY)), static_cast<int>(HEIGHT));
+
+        if (x0 >= x1 || y0 >= y1)
+        {
+            continue;
+        }
+
+        triangle.tileX0 = static_cast<uint16_t>(x0 / TILE_WIDTH);
+        triangle.tileY0 = static_cast<uint16_t>(y0 / TILE_HEIGHT);
+        triangle.tileX1 = static_cast<uint16_t>((x1 + TILE_WIDTH - 1) / TILE_WIDTH);
+        triangle.tileY1 = static_cast<uint16_t>((y1 + TILE_HEIGHT - 1) / TILE_HEIGHT);
+
+        uint32_t triangleIndex = static_cast<uint32_t>(mTriangles.size());
+        mTriangles.push_back(triangle);
+
+        for (uint32_t binY = triangle.tileY0 / BIN_HEIGHT; binY <= (triangle.tileY1 - 1u) / BIN_HEIGHT; binY++)
+        {
+            for (uint32_t binX = triangle.tileX0 / BIN_WIDTH; binX <= (triangle.tileX1 - 1u) / BIN_WIDTH; binX++)
+            {
+                mBins[binY * mBinsX + binX].push_back(triangleIndex);
+            }
+        }
+    }
+}
+
+void OcclusionRasterizer::rasterize()
+{
+    mJobSystem.parallelFor(mBinsX * mBinsY, 1, [this](uint32_t begin, uint32_t end) {
+        for (uint32_t bin = begin; bin < end; bin++)
+        {
+            rasterizeBin(bin);
+        }
+    });
+}
+
+void OcclusionRasterizer::rasterizeBin(uint32_t bin)
+{
+    uint32_t binTileX0 = (bin % mBinsX) * BIN_WIDTH;
+    uint32_t binTileY0 = (bin / mBinsX) * BIN_HEIGHT;
+    uint32_t binTileX1 = std::min(binTileX0 + BIN_WIDTH, mTilesX);
+    uint32_t binTileY1 = std::min(binTileY0 + BIN_HEIGHT, mTilesY);
+
+    for (uint32_t tileY = binTileY0; tileY < binTileY1; tileY++)
+    {
+        for (uint32_t tileX = binTileX0; tileX < binTileX1; tileX++)
+        {
+            mTiles[tileY * mTilesX + tileX] = Tile{ EMPTY_DEPTH, NO_DEPTH, 0 };
+        }
+    }
+
+    const Float4 laneCenters = simdSet(0.5f, 1.5f, 2.5f, 3.5f);
+    const Float4 zero = simdSplat(0.f);
+
+    for (auto triangleIndex : mBins[bin])
+    {
+        auto &triangle = mTriangles[triangleIndex];
+
+        // edge k runs from vertex k to the next one, e = a * x + b * y + c. Weighted by the
+        // depth of the opposite vertex over the area they interpolate the depth, which makes
+        // the depth a plane as well.
+        float a[3], b[3], c[3];
+        for (int k = 0; k < 3; k++)
+        {
+            int next = (k + 1) % 3;
+            a[k] = triangle.y[k] - triangle.y[next];
+            b[k] = triangle.x[next] - triangle.x[k];
+            c[k] = -a[k] * triangle.x[k] - b[k] * triangle.y[k];
+        }
+
+        float invArea = 1.f / (a[0] * triangle.x[2] + b[0] * triangle.y[2] + c[0]);
+        float depthA = 0.f, depthB = 0.f, depthC = 0.f;
+        for (int k = 0; k < 3; k++)
+        {
+            float weight = triangle.z[(k + 2) % 3] * invArea;
+            depthA += a[k] * weight;
+            depthB += b[k] * weight;
+            depthC += c[k] * weight;
+        }
+
+        float minZ = std::min(std::min(triangle.z[0], triangle.z[1]), triangle.z[2]);
+        float maxZ = std::max(std::max(triangle.z[0], triangle.z[1]), triangle.z[2]);
+
+        uint32_t tileX0 = std::max<uint32_t>(triangle.tileX0, binTileX0);
+        uint32_t tileX1 = std::min<uint32_t>(triangle.tileX1, binTileX1);
+        uint32_t tileY0 = std::max<uint32_t>(triangle.tileY0, binTileY0);
+        uint32_t tileY1 = std::min<uint32_t>(triangle.tileY1, binTileY1);
+
+        for (uint32_t tileY = tileY0; tileY < tileY1; tileY++)
+        {
+            for (uint32_t tileX = tileX0; tileX < tileX1; tileX++)
+            {
+                auto &tile = mTiles[tileY * mTilesX + tileX];
+
+                float left = static_cast<float>(tileX * TILE_WIDTH);
+                float top = static_cast<float>(tileY * TILE_HEIGHT);
+
+                // nearest and farthest depth of the triangle over the pixel centers of the
+                // tile, at opposite corners of the plane and never past its vertices
+                float nearX = depthA > 0.f ? left + 0.5f : left + TILE_WIDTH - 0.5f;
+                float nearY = depthB > 0.f ? top + 0.5f : top + TILE_HEIGHT - 0.5f;
+                float farX = depthA > 0.f ? left + TILE_WIDTH - 0.5f : left + 0.5f;
+                float farY = depthB > 0.f ? top + TILE_HEIGHT - 0.5f : top + 0.5f;
+                float nearDepth = std::max(depthA * nearX + depthB * nearY + depthC, minZ);
+                float farDepth = std::min(depthA * farX + depthB * farY + depthC, maxZ);
+
+                // already behind every pixel of the tile
+                if (nearDepth >= tile.referenceDepth)
+                {
+                    continue;
+                }
+
+                uint32_t coverage = 0;
+                for (uint32_t row = 0; row < TILE_HEIGHT; row++)
+                {
+                    float centerY = top + row + 0.5f;
+                    for (uint32_t column = 0; column < TILE_WIDTH; column += 4)
+                    {
+                        Float4 centerX = simdAdd(simdSplat(left + column), laneCenters);
+
+                        Float4 e0 = simdAdd(simdMul(simdSplat(a[0]), centerX), simdSplat(b[0] * centerY + c[0]));
+                        Float4 e1 = simdAdd(simdMul(simdSplat(a[1]), centerX), simdSplat(b[1] * centerY + c[1]));
+                        Float4 e2 = simdAdd(simdMul(simdSplat(a[2]), centerX), simdSplat(b[2] * centerY + c[2]));
+
+                        Mask4 inside = simdAnd(simdAnd(simdGreaterEqual(e0, zero), simdGreaterEqual(e1, zero)), simdGreaterEqual(e2, zero));
+                        coverage |= simdBits(inside) << (row * TILE_WIDTH + column);
+                    }
+                }
+
+                if (coverage == 0)
+                {
+                    continue;
+                }
+
+                // pixels behind the reference are bounded by it already
+                float depth = std::min(farDepth, tile.referenceDepth);
+
+                // the triangle is much nearer than the working layer, which would only push
+                // the next reference back, start over with it
+                if (tile.workingDepth - depth > tile.referenceDepth - tile.workingDepth)
+                {
+                    tile.workingDepth = NO_DEPTH;
+                    tile.mask = 0;
+                }
+
+                tile.workingDepth = std::max(tile.workingDepth, depth);
+                tile.mask |= coverage;
+
+                if (tile.mask == FULL_MASK)
+                {
+                    tile.referenceDepth = tile.workingDepth;
+                    tile.workingDepth = NO_DEPTH;
+                    tile.mask = 0;
+                }
+            }
+        }
+    }
+}
+
+bool OcclusionRasterizer::isOccluded(const BoundingBoxes &boxes, uint32_t index) const
+{
+    float center[3] = { boxes.getCenterX()[index], boxes.getCenterY()[index], boxes.getCenterZ()[index] };
+    float extent[3] = { boxes.getExtentX()[index], boxes.getExtentY()[index], boxes.getExtentZ()[index] };
+
+    float minX = FLT_MAX;
+    float maxX = -FLT_MAX;
+    float minY = FLT_MAX;
+    float maxY = -FLT_MAX;
+    float minZ = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float clip[4];
+        transformPoint(mViewProj,
+            center[0] + ((corner & 1) ? extent[0] : -extent[0]),
+            center[1] + ((corner & 2) ? extent[1] : -extent[1]),
+            center[2] + ((corner & 4) ? extent[2] : -extent[2]),
+            clip);
+
+        // reaches behind the camera, the projection doesn't bound it
+        if (clip[3] < MIN_W)
+        {
+            return false;
+        }
+
+        float invW = 1.f / clip[3];
+        float x = (clip[0] * invW * 0.5f + 0.5f) * WIDTH;
+        float y = (clip[1] * invW * 0.5f + 0.5f) * HEIGHT;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        minZ = std::min(minZ, clip[2] * invW);
+    }
+
+    int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+    int x1 = std::min(static_cast<int>(std::ceil(maxX)), static_cast<int>(WIDTH));
+    int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+    int y1 = std::min(static_cast<int>(std::ceil(maxY)), static_cast<int>(HEIGHT));
+
+    // off screen, that is up to the frustum cull
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return false;
+    }
+
+    // widening the rectangle to whole tiles only makes the test more conservative
+    uint32_t tileX1 = (x1 + TILE_WIDTH - 1) / TILE_WIDTH;
+    uint32_t tileY1 = (y1 + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    for (uint32_t tileY = y0 / TILE_HEIGHT; tileY < tileY1; tileY++)
+    {
+        for (uint32_t tileX = x0 / TILE_WIDTH; tileX < tileX1; tileX++)
+        {
+            if (mTiles[tileY * mTilesX + tileX].referenceDepth >= minZ)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
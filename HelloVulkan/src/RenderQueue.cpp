@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include "RenderQueue.h"
+
+#ifdef HV_SORT_BENCHMARK
+#include <chrono>
+#include <random>
+#include "Logging.h"
+#endif
+
+uint32_t RenderQueue::makeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depth)
+{
+    assert(pass < 4);
+
+    return (pass << 30) | ((pipeline & 0x3f) << 24) | ((material & 0x3fff) << 10) | (depth & 0x3ff);
+}
+
+uint32_t RenderQueue::makeDepthBucket(float distance)
+{
+    // the bits of a positive float grow with its value, exponent and mantissa together are
+    // close to its log2. 16 octaves from 2^-4 leave 6 bits of mantissa for the 10 bit bucket.
+    const uint32_t NEAREST = 123u << 23;
+    const uint32_t FARTHEST = (139u << 23) - 1;
+
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+
+    if (distance <= 0.f || bits < NEAREST)
+    {
+        return 0;
+    }
+
+    return (std::min(bits, FARTHEST) - NEAREST) >> 17;
+}
+
+void RenderQueue::sort()
+{
+    const uint32_t count = static_cast<uint32_t>(mPackets.size());
+    if (count < 2)
+    {
+        return;
+    }
+
+    // histograms of all digits in a single pass over the keys
+    std::array<std::array<uint32_t, BUCKET_COUNT>, DIGIT_COUNT> histograms;
+    for (auto &histogram : histograms)
+    {
+        histogram.fill(0);
+    }
+    for (const auto &packet : mPackets)
+    {
+        for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++)
+        {
+            histograms[digit][(packet.key >> (digit * DIGIT_BITS)) & (BUCKET_COUNT - 1)]++;
+        }
+    }
+
+    mScratch.resize(count);
+    Packet* src = mPackets.data();
+    Packet* dst = mScratch.data();
+
+    for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++)
+    {
+        auto &histogram = histograms[digit];
+        const uint32_t shift = digit * DIGIT_BITS;
+
+        // all keys share this digit, the pass wouldn't move anything
+        if (histogram[(src[0].key >> shift) & (BUCKET_COUNT - 1)] == count)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (auto &bucket : histogram)
+        {
+            uint32_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            dst[histogram[(src[i].key >> shift) & (BUCKET_COUNT - 1)]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    if (src != mPackets.data())
+    {
+        mPackets.swap(mScratch);
+    }
+}
+
+#ifdef HV_SORT_BENCHMARK
+void RenderQueue::benchmark()
+{
+    const uint32_t PACKET_COUNT = 50000;
+    const uint32_t RUN_COUNT = 100;
+
+    // random keys over every field, two sets so that no run starts from sorted packets
+    std::mt19937 random(1);
+    std::array<std::vector<uint32_t>, 2> keys;
+    for (auto &keySet : keys)
+    {
+        keySet.resize(PACKET_COUNT);
+        for (auto &key : keySet)
+        {
+            key = static_cast<uint32_t>(random());
+        }
+    }
+
+    RenderQueue queue;
+    float total = 0.f;
+    float best = 1e30f;
+    for (uint32_t run = 0; run < RUN_COUNT; run++)
+    {
+        auto &keySet = keys[run % 2];
+
+        queue.clear();
+        for (uint32_t i = 0; i < PACKET_COUNT; i++)
+        {
+            queue.push(keySet[i], i);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        queue.sort();
+        float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        total += milliseconds;
+        best = std::min(best, milliseconds);
+
+        for (uint32_t i = 1; i < PACKET_COUNT; i++)
+        {
+            assert(queue.getPackets()[i - 1].key <= queue.getPackets()[i].key);
+        }
+    }
+
+    LOGI("render queue: %u packets with random keys sorted in %.3f ms on average, %.3f ms at best\n",
+        PACKET_COUNT, total / RUN_COUNT, best);
+}
+#endif
@@ -0,0 +1,257 @@
+#include <cassert>
+#include "SubmissionTracker.h"
+
+SubmissionTracker::SubmissionTracker(VkDevice device, VkQueue queue, std::mutex &queueMutex, bool useTimelineSemaphore)
+    : mDevice(device)
+    , mQueue(queue)
+    , mQueueMutex(queueMutex)
+{
+#ifdef VK_KHR_timeline_semaphore
+    if (useTimelineSemaphore)
+    {
+        mWaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(mDevice, "vkWaitSemaphoresKHR");
+        mGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(mDevice, "vkGetSemaphoreCounterValueKHR");
+    }
+
+    if (mWaitSemaphores && mGetSemaphoreCounterValue)
+    {
+        VkSemaphoreTypeCreateInfoKHR semaphoreTypeCreateInfo{};
+        semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        semaphoreTypeCreateInfo.pNext = nullptr;
+        semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        semaphoreTypeCreateInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreCreateInfo{};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+        semaphoreCreateInfo.flags = 0;
+
+        auto result = vkCreateSemaphore(mDevice, &semaphoreCreateInfo, nullptr, &mTimelineSemaphore);
+        assert(result == VK_SUCCESS);
+    }
+#endif
+}
+
+SubmissionTracker::~SubmissionTracker()
+{
+    waitIdle();
+
+    if (mTimelineSemaphore != VK_NULL_HANDLE)
+    {
+        vkDestroySemaphore(mDevice, mTimelineSemaphore, nullptr);
+    }
+
+    for (auto &fence : mFreeFences)
+    {
+        vkDestroyFence(mDevice, fence, nullptr);
+    }
+    for (auto &fence : mRetiredFences)
+    {
+        vkDestroyFence(mDevice, fence, nullptr);
+    }
+}
+
+uint64_t SubmissionTracker::submit(const VkSubmitInfo &submitInfo)
+{
+    // values must reach the queue in the order they are handed out
+    std::lock_guard<std::mutex> queueLock(mQueueMutex);
+
+    uint64_t value = mLastSubmittedValue + 1;
+
+    VkSubmitInfo info = submitInfo;
+    VkFence fence = VK_NULL_HANDLE;
+
+    std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+
+#ifdef VK_KHR_timeline_semaphore
+    // binary semaphores ignore their entry in the value arrays
+    std::vector<uint64_t> waitValues(submitInfo.waitSemaphoreCount, 0);
+    std::vector<uint64_t> signalValues(submitInfo.signalSemaphoreCount, 0);
+
+    VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+    if (mTimelineSemaphore != VK_NULL_HANDLE)
+    {
+        signalSemaphores.push_back(mTimelineSemaphore);
+        signalValues.push_back(value);
+
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineSubmitInfo.pNext = submitInfo.pNext;
+        timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+        timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+        info.pNext = &timelineSubmitInfo;
+    }
+#endif
+
+    if (mTimelineSemaphore == VK_NULL_HANDLE)
+    {
+        std::lock_guard<std::mutex> fenceLock(mFenceMutex);
+
+        if (mFreeFences.empty())
+        {
+            VkFenceCreateInfo fenceCreateInfo{};
+            fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fenceCreateInfo.flags = 0;
+
+            auto result = vkCreateFence(mDevice, &fenceCreateInfo, nullptr, &fence);
+            assert(result == VK_SUCCESS);
+        }
+        else
+        {
+            fence = mFreeFences.back();
+            mFreeFences.pop_back();
+        }
+
+        mPendingFences.push_back({ value, fence });
+    }
+
+    info.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    info.pSignalSemaphores = signalSemaphores.data();
+
+    auto result = vkQueueSubmit(mQueue, 1, &info, fence);
+    assert(result == VK_SUCCESS);
+
+    mLastSubmittedValue = value;
+
+    return value;
+}
+
+uint64_t SubmissionTracker::getCompletedValue()
+{
+#ifdef VK_KHR_timeline_semaphore
+    if (mTimelineSemaphore != VK_NULL_HANDLE)
+    {
+        uint64_t value = 0;
+        auto result = mGetSemaphoreCounterValue(mDevice, mTimelineSemaphore, &value);
+        assert(result == VK_SUCCESS);
+
+        updateCompletedValue(value);
+        return mCompletedValue;
+    }
+#endif
+
+    retireFences(false, mLastSubmittedValue);
+    return mCompletedValue;
+}
+
+bool SubmissionTracker::isComplete(uint64_t value)
+{
+    if (value <= mCompletedValue)
+    {
+        return true;
+    }
+
+    return value <= getCompletedValue();
+}
+
+void SubmissionTracker::wait(uint64_t value)
+{
+    assert(value <= mLastSubmittedValue);
+
+    if (value <= mCompletedValue)
+    {
+        return;
+    }
+
+#ifdef VK_KHR_timeline_semaphore
+    if (mTimelineSemaphore != VK_NULL_HANDLE)
+    {
+        VkSemaphoreWaitInfoKHR waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.pNext = nullptr;
+        waitInfo.flags = 0;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &mTimelineSemaphore;
+        waitInfo.pValues = &value;
+
+        auto result = mWaitSemaphores(mDevice, &waitInfo, UINT64_MAX);
+        assert(result == VK_SUCCESS);
+
+        updateCompletedValue(value);
+        return;
+    }
+#endif
+
+    retireFences(true, value);
+}
+
+void SubmissionTracker::waitIdle()
+{
+    wait(mLastSubmittedValue);
+}
+
+void SubmissionTracker::updateCompletedValue(uint64_t value)
+{
+    uint64_t completed = mCompletedValue;
+    while (completed < value && !mCompletedValue.compare_exchange_weak(completed, value))
+    {
+    }
+}
+
+void SubmissionTracker::retireFences(bool block, uint64_t value)
+{
+    std::unique_lock<std::mutex> fenceLock(mFenceMutex);
+
+    // batches are not guaranteed to finish in submission order, so a value only
+    // counts as complete once every fence up to it has signaled
+    if (block)
+    {
+        std::vector<VkFence> fences;
+        for (auto &pending : mPendingFences)
+        {
+            if (pending.value > value)
+            {
+                break;
+            }
+            fences.push_back(pending.fence);
+        }
+
+        if (fences.empty())
+        {
+            return;
+        }
+
+        // wait unlocked, submits take the fence list while holding the queue mutex that
+        // may be shared with other queues. The fences stay out of reuse meanwhile.
+        mBlockingWaits++;
+        fenceLock.unlock();
+
+        auto result = vkWaitForFences(mDevice, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
+        assert(result == VK_SUCCESS);
+
+        fenceLock.lock();
+        mBlockingWaits--;
+    }
+
+    // another thread may have retired some of them while the lock was released
+    while (!mPendingFences.empty() && mPendingFences.front().value <= value)
+    {
+        auto &pending = mPendingFences.front();
+        if (!block && vkGetFenceStatus(mDevice, pending.fence) != VK_SUCCESS)
+        {
+            break;
+        }
+
+        mRetiredFences.push_back(pending.fence);
+        updateCompletedValue(pending.value);
+        mPendingFences.pop_front();
+    }
+
+    recycleFences();
+}
+
+void SubmissionTracker::recycleFences()
+{
+    if (mBlockingWaits > 0 || mRetiredFences.empty())
+    {
+        return;
+    }
+
+    auto result = vkResetFences(mDevice, static_cast<uint32_t>(mRetiredFences.size()), mRetiredFences.data());
+    assert(result == VK_SUCCESS);
+
+    mFreeFences.insert(mFreeFences.end(), mRetiredFences.begin(), mRetiredFences.end());
+    mRetiredFences.clear();
+}
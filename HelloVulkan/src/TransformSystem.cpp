@@ -0,0 +1,218 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include "JobSystem.h"
+#include "Logging.h"
+#include "TransformSystem.h"
+
+using namespace mathfu;
+
+const TransformSystem::Handle TransformSystem::INVALID_HANDLE = 0xFFFFFFFF;
+const uint32_t TransformSystem::UPDATE_BATCH_SIZE = 1024;
+
+TransformSystem::TransformSystem(JobSystem &jobSystem)
+    : mJobSystem(jobSystem)
+{
+
+}
+
+TransformSystem::Handle TransformSystem::create(Handle parent)
+{
+    assert(parent == INVALID_HANDLE || parent < mParents.size());
+
+    Handle handle;
+    if (!mFreeHandles.empty())
+    {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+    }
+    else
+    {
+        handle = static_cast<Handle>(mParents.size());
+        mTranslations.emplace_back();
+        mRotations.emplace_back();
+        mScales.emplace_back();
+        mParents.push_back(INVALID_HANDLE);
+        mChildCounts.push_back(0);
+        mDepths.push_back(0);
+        mLevelSlots.push_back(0);
+        mLocalDirty.push_back(0);
+        mWorldChanged.push_back(0);
+        mWorlds.emplace_back();
+    }
+
+    uint32_t depth = 0;
+    if (parent != INVALID_HANDLE)
+    {
+        depth = mDepths[parent] + 1;
+        mChildCounts[parent]++;
+    }
+
+    if (depth >= mLevels.size())
+    {
+        mLevels.resize(depth + 1);
+    }
+
+    mTranslations[handle] = { 0.f, 0.f, 0.f };
+    mRotations[handle] = { 0.f, 0.f, 0.f, 1.f };
+    mScales[handle] = { 1.f, 1.f, 1.f };
+    mParents[handle] = parent;
+    mChildCounts[handle] = 0;
+    mDepths[handle] = depth;
+    mLevelSlots[handle] = static_cast<uint32_t>(mLevels[depth].size());
+    mLocalDirty[handle] = 1;
+    mWorldChanged[handle] = 0;
+    mWorlds[handle] = mat4::Identity();
+    mLevels[depth].push_back(handle);
+    mTransformCount++;
+
+    return handle;
+}
+
+void TransformSystem::destroy(Handle handle)
+{
+    assert(mChildCounts[handle] == 0);
+
+    // the last handle of the level takes the slot
+    auto &level = mLevels[mDepths[handle]];
+    Handle moved = level.back();
+    level[mLevelSlots[handle]] = moved;
+    mLevelSlots[moved] = mLevelSlots[handle];
+    level.pop_back();
+
+    if (mParents[handle] != INVALID_HANDLE)
+    {
+        mChildCounts[mParents[handle]]--;
+    }
+
+    mParents[handle] = INVALID_HANDLE;
+    mFreeHandles.push_back(handle);
+    mTransformCount--;
+}
+
+void TransformSystem::setTranslation(Handle handle, const vec3 &translation)
+{
+    mTranslations[handle] = { translation.x(), translation.y(), translation.z() };
+    mLocalDirty[handle] = 1;
+}
+
+void TransformSystem::setRotation(Handle handle, const quat &rotation)
+{
+    mRotations[handle] = { rotation.vector().x(), rotation.vector().y(), rotation.vector().z(), rotation.scalar() };
+    mLocalDirty[handle] = 1;
+}
+
+void TransformSystem::setScale(Handle handle, const vec3 &scale)
+{
+    mScales[handle] = { scale.x(), scale.y(), scale.z() };
+    mLocalDirty[handle] = 1;
+}
+
+mat4 TransformSystem::getLocal(Handle handle) const
+{
+    // translation * rotation * scale, written out column by column
+    const auto &t = mTranslations[handle];
+    const auto &r = mRotations[handle];
+    const auto &s = mScales[handle];
+
+    float x2 = r[0] * r[0], y2 = r[1] * r[1], z2 = r[2] * r[2];
+    float xy = r[0] * r[1], xz = r[0] * r[2], yz = r[1] * r[2];
+    float wx = r[3] * r[0], wy = r[3] * r[1], wz = r[3] * r[2];
+
+    return mat4(
+        (1.f - 2.f * (y2 + z2)) * s[0], 2.f * (xy + wz) * s[0], 2.f * (xz - wy) * s[0], 0.f,
+        2.f * (xy - wz) * s[1], (1.f - 2.f * (x2 + z2)) * s[1], 2.f * (yz + wx) * s[1], 0.f,
+        2.f * (xz + wy) * s[2], 2.f * (yz - wx) * s[2], (1.f - 2.f * (x2 + y2)) * s[2], 0.f,
+        t[0], t[1], t[2], 1.f);
+}
+
+void TransformSystem::update()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::atomic<uint32_t> updatedCount{ 0 };
+    for (auto &level : mLevels)
+    {
+        mJobSystem.parallelFor(static_cast<uint32_t>(level.size()), UPDATE_BATCH_SIZE, [this, &level, &updatedCount](uint32_t begin, uint32_t end) {
+            uint32_t updated = 0;
+            for (uint32_t i = begin; i < end; i++)
+            {
+                Handle handle = level[i];
+                Handle parent = mParents[handle];
+
+                // a moved parent drags the whole subtree along
+                bool parentChanged = parent != INVALID_HANDLE && mWorldChanged[parent];
+                if (!mLocalDirty[handle] && !parentChanged)
+                {
+                    mWorldChanged[handle] = 0;
+                    continue;
+                }
+
+                // the matrix product is vectorized by mathfu
+                mWorlds[handle] = parent != INVALID_HANDLE ? mWorlds[parent] * getLocal(handle) : getLocal(handle);
+                mLocalDirty[handle] = 0;
+                mWorldChanged[handle] = 1;
+                updated++;
+            }
+            updatedCount += updated;
+        });
+    }
+
+    mStats.transformCount = mTransformCount;
+    mStats.updatedCount = updatedCount;
+    mStats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+#ifdef HV_TRANSFORM_BENCHMARK
+void TransformSystem::benchmark(JobSystem &jobSystem)
+{
+    // 1000 roots with 9 children of 10 children each
+    const uint32_t ROOT_COUNT = 1000;
+    const uint32_t CHILD_COUNT = 9;
+    const uint32_t GRANDCHILD_COUNT = 10;
+
+    TransformSystem transforms(jobSystem);
+    std::vector<Handle> roots;
+    for (uint32_t i = 0; i < ROOT_COUNT; i++)
+    {
+        roots.push_back(transforms.create());
+        transforms.setTranslation(roots.back(), vec3(static_cast<float>(i), 0.f, 0.f));
+        for (uint32_t j = 0; j < CHILD_COUNT; j++)
+        {
+            Handle child = transforms.create(roots.back());
+            transforms.setTranslation(child, vec3(0.f, static_cast<float>(j), 0.f));
+            for (uint32_t k = 0; k < GRANDCHILD_COUNT; k++)
+            {
+                Handle grandchild = transforms.create(child);
+                transforms.setScale(grandchild, vec3(0.5f, 0.5f, 0.5f));
+            }
+        }
+    }
+
+    transforms.update();
+    LOGI("transform system: %u transforms, first update %.3f ms\n",
+        transforms.getStats().transformCount, transforms.getStats().milliseconds);
+
+    // every root turns, so the whole hierarchy follows
+    for (uint32_t i = 0; i < ROOT_COUNT; i++)
+    {
+        transforms.setRotation(roots[i], quat::FromAngleAxis(0.1f, vec3(0.f, 1.f, 0.f)));
+    }
+    transforms.update();
+    LOGI("transform system: all dirty, %u updated in %.3f ms\n",
+        transforms.getStats().updatedCount, transforms.getStats().milliseconds);
+
+    // a tenth of the roots turn
+    for (uint32_t i = 0; i < ROOT_COUNT; i += 10)
+    {
+        transforms.setRotation(roots[i], quat::FromAngleAxis(0.2f, vec3(0.f, 1.f, 0.f)));
+    }
+    transforms.update();
+    LOGI("transform system: a tenth dirty, %u updated in %.3f ms\n",
+        transforms.getStats().updatedCount, transforms.getStats().milliseconds);
+
+    transforms.update();
+    LOGI("transform system: clean, %u updated in %.3f ms\n",
+        transforms.getStats().updatedCount, transforms.getStats().milliseconds);
+}
+#endif
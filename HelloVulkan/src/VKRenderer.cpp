@@ -1,13 +1,39 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
+#include "Asset.h"
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+#include "MaterialTable.h"
 #include "Logging.h"
 #include "VKFuncs.h"
 #include "VKRenderer.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "ModelPipeline.h"
 #include "ShadowMap.h"
+#include "SubmissionTracker.h"
+#include "TransformSystem.h"
+#include "ViewUniforms.h"
 #include "DebugCoord.h"
+#include "DrawBenchmark.h"
+#include "FramePacketBuffer.h"
+#include "DeletionQueue.h"
+#include "DepthPyramid.h"
+#include "DescriptorAllocator.h"
+#include "FrameGraph.h"
+#include "Frustum.h"
+#include "GeometryPool.h"
+#include "InstanceCuller.h"
+#include "ClusterCuller.h"
+#include "OcclusionRasterizer.h"
 
 #ifdef _ANDROID
 #include "engine.h"
@@ -19,6 +45,18 @@
 
 namespace VK_RENDERER
 {
+static const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+static const uint32_t MODEL_UPDATE_BATCH_SIZE = 16;
+// frames between two logs of the cull and recording stats
+static const uint32_t STATS_LOG_INTERVAL = 600;
+// frames the simulation may run ahead of the renderer
+static const uint32_t FRAME_PACKET_LATENCY = 1;
+// capacity of the geometry shared by all meshes, enough for the chalet and a few more. The
+// LODs add up to almost as many indices as the full meshes.
+static const uint32_t GEOMETRY_POOL_VERTEX_COUNT = 2 * 1024 * 1024;
+// also holds the indices the cluster cull pass writes, a full mesh per cluster slot
+static const uint32_t GEOMETRY_POOL_INDEX_COUNT = 8 * 1024 * 1024;
+
 class VKRendererImpl : public VKRenderer
 {
 #if _DEBUG
@@ -36,37 +74,74 @@ public:
 
     virtual ~VKRendererImpl()
     {
-        vkQueueWaitIdle(mQueue);
+        if (mRenderThread.joinable())
+        {
+            mFramePackets->close();
+            mRenderThread.join();
+            mJobSystem->attachCurrentThread();
+        }
+        delete mFramePackets;
 
-        for (auto &model : mModels)
+        delete mModelLoader;
+
+        mTransferTracker->waitIdle();
+        if (mComputeTracker)
         {
-            delete model;
+            mComputeTracker->waitIdle();
         }
-        mModels.clear();
+        mGraphicsTracker->waitIdle();
 
+        // drawn models and those still waiting for their uploads
+        for (auto &mesh : mMeshes)
+        {
+            delete mesh.second.model;
+        }
+        mMeshes.clear();
+        mModels.clear();
+        mLiveInstances.clear();
+        mInstanceMeshes.clear();
+
+        delete mClusterCuller;
+        delete mInstanceCuller;
+        delete mGeometryPool;
+        delete mModelPipeline;
+        delete mMaterialTable;
+        delete mViewUniforms;
+        delete mDepthPyramid;
         delete mShadowMap;
         delete mDebugCoord;
+        delete mFrameGraph;
+        delete mDescriptorAllocator;
 
-        vkDestroySwapchainKHR(mDevice, mSwapchain, nullptr);
-        vkDestroySemaphore(mDevice, mImageAvailableSemaphore, nullptr);
-        vkDestroySemaphore(mDevice, mRenderFinishedSemaphore, nullptr);
-        vkDestroySemaphore(mDevice, mShadowMapAvailableSemaphore, nullptr);
-        vkDestroyImageView(mDevice, mDepthImageView, nullptr);
-        vkDestroyImage(mDevice, mDepthImage, nullptr);
-        vkFreeMemory(mDevice, mDepthImageMemory, nullptr);
-        vkDestroyRenderPass(mDevice, mRenderPass, nullptr);
+        delete mCommandRecorder;
+        delete mOcclusionRasterizer;
+        delete mTransforms;
+        delete mJobSystem;
 
-        for (auto &framebuffer : mFramebuffers)
+        // everything has retired, release what the models deferred
+        delete mDeletionQueue;
+
+        vkDestroySwapchainKHR(mDevice, mSwapchain, nullptr);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            vkDestroyFramebuffer(mDevice, framebuffer, nullptr);
+            vkDestroySemaphore(mDevice, mImageAvailableSemaphore[i], nullptr);
+            vkDestroySemaphore(mDevice, mRenderFinishedSemaphore[i], nullptr);
+            vkDestroySemaphore(mDevice, mCullFinishedSemaphore[i], nullptr);
+            vkDestroySemaphore(mDevice, mComputeFinishedSemaphore[i], nullptr);
         }
 
+        delete mTransferTracker;
+        delete mComputeTracker;
+        delete mGraphicsTracker;
         for (auto &displayView : mDisplayViews)
         {
             vkDestroyImageView(mDevice, displayView, nullptr);
         }
 
         vkDestroyCommandPool(mDevice, mCmdPool, nullptr);
+        vkDestroyCommandPool(mDevice, mTransferCmdPool, nullptr);
+        vkDestroyCommandPool(mDevice, mUploadAcquireCmdPool, nullptr);
+        vkDestroyCommandPool(mDevice, mComputeCmdPool, nullptr);
         vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
         
 #if _DEBUG
@@ -91,6 +166,20 @@ public:
     {
         loadVKLibs();
 
+        // the thread calling init() updates and draws, it becomes job worker 0
+        mJobSystem = new JobSystem();
+#ifdef HV_JOBSYSTEM_BENCHMARK
+        mJobSystem->benchmark();
+#endif
+#ifdef HV_TRANSFORM_BENCHMARK
+        TransformSystem::benchmark(*mJobSystem);
+#endif
+#ifdef HV_SORT_BENCHMARK
+        RenderQueue::benchmark();
+#endif
+        mOcclusionRasterizer = new OcclusionRasterizer(*mJobSystem);
+        mTransforms = new TransformSystem(*mJobSystem);
+
         VkResult result = VK_ERROR_INITIALIZATION_FAILED;
 
         // Init instance
@@ -124,7 +213,7 @@ public:
             extNames.push_back(extension.extensionName);
         }
 
-        const char *instance_extensions[] = {
+        std::vector<const char*> instance_extensions = {
 #if _DEBUG
             "VK_EXT_debug_report",
 #endif          
@@ -143,8 +232,25 @@ public:
 #endif
         };
 
-        uint32_t instance_extension_request_count =
-            sizeof(instance_extensions) / sizeof(instance_extensions[0]);
+        // the timeline semaphore and descriptor indexing features are queried through it, a
+        // 1.0 instance has to enable it where the driver lists it
+        bool properties2Enabled = true;
+#if _ANDROID
+        properties2Enabled = false;
+        for (auto &extName : extNames)
+        {
+            if (strcmp(extName, "VK_KHR_get_physical_device_properties2") == 0)
+            {
+                properties2Enabled = true;
+            }
+        }
+        if (properties2Enabled)
+        {
+            instance_extensions.push_back("VK_KHR_get_physical_device_properties2");
+        }
+#endif
+
+        uint32_t instance_extension_request_count = static_cast<uint32_t>(instance_extensions.size());
         for (uint32_t i = 0; i < instance_extension_request_count; i++) {
             bool found = false;
             for (uint32_t j = 0; j < extensions.size(); j++) {
@@ -210,8 +316,8 @@ public:
         VkInstanceCreateInfo instanceCreateInfo = { };
         instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
         instanceCreateInfo.pApplicationInfo = &applicationInfo;
-        instanceCreateInfo.enabledExtensionCount = sizeof(instance_extensions) / sizeof(instance_extensions[0]);
-        instanceCreateInfo.ppEnabledExtensionNames = instance_extensions;
+        instanceCreateInfo.enabledExtensionCount = instance_extension_request_count;
+        instanceCreateInfo.ppEnabledExtensionNames = instance_extensions.data();
         instanceCreateInfo.enabledLayerCount = sizeof(instance_layers) / sizeof(instance_layers[0]);
         instanceCreateInfo.ppEnabledLayerNames = instance_layers;
 
@@ -322,56 +428,235 @@ public:
         assert(result == VK_SUCCESS);
 #endif
 
+        // find queue families
+        uint32_t queueFamilyCount = 0;
+
+        vkGetPhysicalDeviceQueueFamilyProperties(mPhysicalDevice, &queueFamilyCount, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(mPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        mGraphicsQueueFamilyIdx = UINT32_MAX;
+        mTransferQueueFamilyIdx = UINT32_MAX;
+        mComputeQueueFamilyIdx = UINT32_MAX;
+
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            const auto& queueFamily = queueFamilies[i];
+            if (queueFamily.queueCount == 0) {
+                continue;
+            }
+
+            VkBool32 presentSupport = false;
+            result = vkGetPhysicalDeviceSurfaceSupportKHR(mPhysicalDevice, i, mSurface, &presentSupport);
+            assert(result == VK_SUCCESS);
+
+            // we present from the graphics queue, so prefer a family that can do both
+            if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && presentSupport && mGraphicsQueueFamilyIdx == UINT32_MAX) {
+                mGraphicsQueueFamilyIdx = i;
+            }
+
+            // a transfer-only family maps to the DMA engines and runs alongside graphics work
+            if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+                mTransferQueueFamilyIdx == UINT32_MAX) {
+                mTransferQueueFamilyIdx = i;
+            }
+
+            // a compute family without graphics is the async compute queue
+            if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                mComputeQueueFamilyIdx == UINT32_MAX) {
+                mComputeQueueFamilyIdx = i;
+            }
+        }
+        assert(mGraphicsQueueFamilyIdx != UINT32_MAX);
+
+        // no dedicated transfer family, uploads go through the graphics queue
+        if (mTransferQueueFamilyIdx == UINT32_MAX) {
+            mTransferQueueFamilyIdx = mGraphicsQueueFamilyIdx;
+        }
+
+        // no dedicated compute family, compute passes are recorded on the graphics queue.
+        // Graphics families always support compute.
+        if (mComputeQueueFamilyIdx == UINT32_MAX) {
+            mComputeQueueFamilyIdx = mGraphicsQueueFamilyIdx;
+        }
+        mAsyncCompute = mComputeQueueFamilyIdx != mGraphicsQueueFamilyIdx;
+
+        // families whose queues access buffers from createSharedBuffer
+        mSharedQueueFamilies.push_back(mGraphicsQueueFamilyIdx);
+        if (mAsyncCompute) {
+            mSharedQueueFamilies.push_back(mComputeQueueFamilyIdx);
+        }
+        if (mTransferQueueFamilyIdx != mGraphicsQueueFamilyIdx) {
+            mSharedQueueFamilies.push_back(mTransferQueueFamilyIdx);
+        }
+
+        uint32_t queueFamilyIndices[] = { mGraphicsQueueFamilyIdx, mGraphicsQueueFamilyIdx };
+
+        float queuePriority = 1.0f;
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+
         VkDeviceQueueCreateInfo queueCreateInfo = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
-        queueCreateInfo.queueFamilyIndex = 0;
+        queueCreateInfo.queueFamilyIndex = mGraphicsQueueFamilyIdx;
         queueCreateInfo.queueCount = 1;
-        float queuePriority = 1.0f;
         queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfos.push_back(queueCreateInfo);
+
+        if (mTransferQueueFamilyIdx != mGraphicsQueueFamilyIdx) {
+            queueCreateInfo.queueFamilyIndex = mTransferQueueFamilyIdx;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        if (mAsyncCompute) {
+            queueCreateInfo.queueFamilyIndex = mComputeQueueFamilyIdx;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
 
         VkDeviceCreateInfo deviceCreateInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
-        deviceCreateInfo.queueCreateInfoCount = 1;
-        deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+        deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtNames.size());
         deviceCreateInfo.ppEnabledExtensionNames = deviceExtNames.data();
         deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(deviceLayerNames.size());
         deviceCreateInfo.ppEnabledLayerNames = deviceLayerNames.data();
 
+        // optional features are only visible through the extended query
+        PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR = nullptr;
+        if (properties2Enabled)
+        {
+            vkGetPhysicalDeviceFeatures2KHR = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(mInstance, "vkGetPhysicalDeviceFeatures2KHR");
+        }
+        if (!vkGetPhysicalDeviceFeatures2KHR)
+        {
+            LOGI("physical device properties2 not available, timeline semaphores and descriptor indexing stay off\n");
+        }
 
-        // find queue family
-        uint32_t graphicsFamilyIdx = 0;
-        uint32_t presentFamilyIdx = 0;
+        // timeline semaphores need the feature enabled on top of the extension
+        bool timelineSemaphoreSupported = false;
+#ifdef VK_KHR_timeline_semaphore
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures{};
+        timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        {
+            bool extensionFound = false;
+            for (auto &dextension : deviceExtNames)
+            {
+                if (strcmp(dextension, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0)
+                {
+                    extensionFound = true;
+                }
+            }
 
-        uint32_t queueFamilyCount = 0;
+            if (extensionFound && vkGetPhysicalDeviceFeatures2KHR)
+            {
+                VkPhysicalDeviceFeatures2KHR features2{};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+                features2.pNext = &timelineSemaphoreFeatures;
+                vkGetPhysicalDeviceFeatures2KHR(mPhysicalDevice, &features2);
 
-        vkGetPhysicalDeviceQueueFamilyProperties(mPhysicalDevice, &queueFamilyCount, nullptr);
+                timelineSemaphoreSupported = timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+            }
 
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(mPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+            if (timelineSemaphoreSupported)
+            {
+                timelineSemaphoreFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+                deviceCreateInfo.pNext = &timelineSemaphoreFeatures;
+            }
+        }
+#endif
+        LOGI("timeline semaphore %s\n", timelineSemaphoreSupported ? "enabled" : "not available, falling back to fences");
+
+        // the LOD draws of a model each read their own range of the visible instances
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
+        mEnabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        deviceCreateInfo.pEnabledFeatures = &mEnabledFeatures;
+        LOGI("draw indirect first instance %s\n", mEnabledFeatures.drawIndirectFirstInstance ? "enabled" : "not available, models only draw their full mesh");
+
+        // the material table writes textures into arrays bound by pending command buffers and
+        // indexes them with a push constant, which core dynamic indexing covers
+#ifdef VK_EXT_descriptor_indexing
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        {
+            bool extensionFound = false;
+            for (auto &dextension : deviceExtNames)
+            {
+                if (strcmp(dextension, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0)
+                {
+                    extensionFound = true;
+                }
+            }
 
-        uint32_t i = 0;
-        for (const auto& queueFamily : queueFamilies) {
-            if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                graphicsFamilyIdx = i;
+            if (extensionFound && vkGetPhysicalDeviceFeatures2KHR)
+            {
+                VkPhysicalDeviceFeatures2KHR features2{};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+                features2.pNext = &descriptorIndexingFeatures;
+                vkGetPhysicalDeviceFeatures2KHR(mPhysicalDevice, &features2);
+
+                mBindlessSupported = features2.features.shaderSampledImageArrayDynamicIndexing == VK_TRUE &&
+                    descriptorIndexingFeatures.descriptorBindingPartiallyBound == VK_TRUE &&
+                    descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+                    descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending == VK_TRUE;
             }
 
-            VkBool32 presentSupport = false;
-            result = vkGetPhysicalDeviceSurfaceSupportKHR(mPhysicalDevice, i, mSurface, &presentSupport);
-            assert(result == VK_SUCCESS);
+            if (mBindlessSupported)
+            {
+                descriptorIndexingFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+                deviceCreateInfo.pNext = &descriptorIndexingFeatures;
 
-            if (queueFamily.queueCount > 0 && presentSupport) {
-                presentFamilyIdx = i;
+                mEnabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
             }
+        }
+#endif
+        LOGI("descriptor indexing %s\n", mBindlessSupported ? "enabled, textures are bindless" : "not available, models bind their own textures");
 
-            i++;
+        // the GPU occlusion cull splits the main pass around a compute pass, which costs tile
+        // based GPUs a store and reload of the attachments. Those, and devices that can't
+        // write the pyramid format from compute shaders, cull against CPU occluders instead.
+        {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+
+            VkFormatProperties formatProperties;
+            vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, VK_FORMAT_R32_SFLOAT, &formatProperties);
+
+            mGpuOcclusion = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
+                (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
         }
+        LOGI("occlusion culling %s\n", mGpuOcclusion ? "on the GPU against the depth of the first main pass" : "on the CPU against the occluder meshes");
 
-        uint32_t queueFamilyIndices[] = { graphicsFamilyIdx, presentFamilyIdx };
+        // the descriptor allocator spells the writes out without update templates
+        bool updateTemplatesSupported = false;
+#ifdef VK_KHR_descriptor_update_template
+        for (auto &dextension : deviceExtNames)
+        {
+            if (strcmp(dextension, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME) == 0)
+            {
+                updateTemplatesSupported = true;
+            }
+        }
+#endif
 
         // create device
         result = vkCreateDevice(mPhysicalDevice, &deviceCreateInfo, nullptr, &mDevice);
         assert(result == VK_SUCCESS);
 
-        vkGetDeviceQueue(mDevice, 0, 0, &mQueue);
+        vkGetDeviceQueue(mDevice, mGraphicsQueueFamilyIdx, 0, &mQueue);
+        vkGetDeviceQueue(mDevice, mTransferQueueFamilyIdx, 0, &mTransferQueue);
+
+        mGraphicsTracker = new SubmissionTracker(mDevice, mQueue, mQueueMutex, timelineSemaphoreSupported);
+        mTransferTracker = new SubmissionTracker(mDevice, mTransferQueue, mQueueMutex, timelineSemaphoreSupported);
+
+        if (mAsyncCompute)
+        {
+            vkGetDeviceQueue(mDevice, mComputeQueueFamilyIdx, 0, &mComputeQueue);
+            mComputeTracker = new SubmissionTracker(mDevice, mComputeQueue, mQueueMutex, timelineSemaphoreSupported);
+        }
+        LOGI("async compute queue: %s\n", mAsyncCompute ? "yes" : "no, compute runs on the graphics queue");
+
+        mDeletionQueue = new DeletionQueue(mDevice);
+        mDescriptorAllocator = new DescriptorAllocator(mDevice, MAX_FRAMES_IN_FLIGHT, updateTemplatesSupported);
 
         // create swap chain
         VkSurfaceCapabilitiesKHR surfaceCapabilities;
@@ -434,90 +719,38 @@ public:
             &mSwapchainLength, nullptr);
         assert(result == VK_SUCCESS);
 
-        // create render pass
-        {
-            VkAttachmentDescription attachmentDescriptions{};
-            attachmentDescriptions.format = DisplayFormat;
-            attachmentDescriptions.samples = VK_SAMPLE_COUNT_1_BIT;
-            attachmentDescriptions.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            attachmentDescriptions.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-            attachmentDescriptions.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            attachmentDescriptions.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            attachmentDescriptions.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            attachmentDescriptions.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-            VkAttachmentReference colorReference{};
-            colorReference.attachment = 0;
-            colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-            VkAttachmentDescription depthAttachment = {};
-            depthAttachment.format = findDepthFormat();
-            depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-            depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-            depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-            VkAttachmentReference depthAttachmentRef = {};
-            depthAttachmentRef.attachment = 1;
-            depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-            VkSubpassDescription subpassDescription = {};
-            subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-            subpassDescription.colorAttachmentCount = 1;
-            subpassDescription.pColorAttachments = &colorReference;
-            subpassDescription.pDepthStencilAttachment = &depthAttachmentRef;
-
-            VkSubpassDependency dependency = {};
-            dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-            dependency.dstSubpass = 0;
-            dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            dependency.srcAccessMask = 0;
-            dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-            std::array<VkAttachmentDescription, 2> attachments = { attachmentDescriptions, depthAttachment };
-
-            VkRenderPassCreateInfo renderPassCreateInfo{};
-            renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-            renderPassCreateInfo.pNext = nullptr;
-            renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            renderPassCreateInfo.pAttachments = attachments.data();
-            renderPassCreateInfo.subpassCount = 1;
-            renderPassCreateInfo.pSubpasses = &subpassDescription;
-            renderPassCreateInfo.dependencyCount = 1;
-            renderPassCreateInfo.pDependencies = &dependency;
-
-            result = vkCreateRenderPass(mDevice, &renderPassCreateInfo,
-                nullptr, &mRenderPass);
-            assert(result == VK_SUCCESS);
-        }
-
         // create command pool
         VkCommandPoolCreateInfo cmdPoolCreateInfo;
         cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         cmdPoolCreateInfo.pNext = nullptr;
         cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        cmdPoolCreateInfo.queueFamilyIndex = 0;
+        cmdPoolCreateInfo.queueFamilyIndex = mGraphicsQueueFamilyIdx;
 
         result = vkCreateCommandPool(mDevice, &cmdPoolCreateInfo, nullptr, &mCmdPool);
         assert(result == VK_SUCCESS);
 
-        // create depth resource
-        {
-            VkFormat depthFormat = findDepthFormat();
+        cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        cmdPoolCreateInfo.queueFamilyIndex = mTransferQueueFamilyIdx;
+
+        result = vkCreateCommandPool(mDevice, &cmdPoolCreateInfo, nullptr, &mTransferCmdPool);
+        assert(result == VK_SUCCESS);
+
+        // ownership acquires are recorded by whichever thread uploads, keep them off mCmdPool
+        cmdPoolCreateInfo.queueFamilyIndex = mGraphicsQueueFamilyIdx;
 
-            createImage(mDisplaySize.width, mDisplaySize.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mDepthImage, mDepthImageMemory);
-            createImageView(mDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, mDepthImageView);
+        result = vkCreateCommandPool(mDevice, &cmdPoolCreateInfo, nullptr, &mUploadAcquireCmdPool);
+        assert(result == VK_SUCCESS);
 
-            transitionImageLayout(mDepthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        if (mAsyncCompute)
+        {
+            cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            cmdPoolCreateInfo.queueFamilyIndex = mComputeQueueFamilyIdx;
 
+            result = vkCreateCommandPool(mDevice, &cmdPoolCreateInfo, nullptr, &mComputeCmdPool);
+            assert(result == VK_SUCCESS);
         }
 
-        // create framebuffer
+        // create display views
         uint32_t SwapchainImagesCount = 0;
         result = vkGetSwapchainImagesKHR(mDevice, mSwapchain, &SwapchainImagesCount, nullptr);
         assert(result == VK_SUCCESS);
@@ -532,45 +765,34 @@ public:
             createImageView(displayImages[i], DisplayFormat, VK_IMAGE_ASPECT_COLOR_BIT, mDisplayViews[i]);
         }
 
-        mFramebuffers.resize(mSwapchainLength);
-        for (uint32_t i = 0; i < mSwapchainLength; i++)
-        {
-            std::array<VkImageView, 2> attachments =
-            {
-                mDisplayViews[i],
-                mDepthImageView
-            };
-
-            VkFramebufferCreateInfo fbCreateInfo = {};
-            fbCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            fbCreateInfo.renderPass = mRenderPass;
-            fbCreateInfo.layers = 1;
-            fbCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            fbCreateInfo.pAttachments = attachments.data();
-            fbCreateInfo.width = static_cast<uint32_t>(mDisplaySize.width);
-            fbCreateInfo.height = static_cast<uint32_t>(mDisplaySize.height);
-
-            result = vkCreateFramebuffer(mDevice, &fbCreateInfo, nullptr,
-                &mFramebuffers[i]);
-            assert(result == VK_SUCCESS);
-        }
-
         VkSemaphoreCreateInfo semaphoreCreateInfo;
         semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
         semaphoreCreateInfo.pNext = nullptr;
         semaphoreCreateInfo.flags = 0;
 
-        result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mImageAvailableSemaphore);
-        assert(result == VK_SUCCESS);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mImageAvailableSemaphore[i]);
+            assert(result == VK_SUCCESS);
 
-        result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mShadowMapAvailableSemaphore);
-        assert(result == VK_SUCCESS);
+            result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mRenderFinishedSemaphore[i]);
+            assert(result == VK_SUCCESS);
 
-        result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mRenderFinishedSemaphore);
-        assert(result == VK_SUCCESS);
+            // the instance cull hands over to the compute queue, which hands the cluster cull
+            // back to the main pass
+            if (mAsyncCompute)
+            {
+                result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mCullFinishedSemaphore[i]);
+                assert(result == VK_SUCCESS);
+
+                result = vkCreateSemaphore(VKRenderer::getInstance().getDevice(), &semaphoreCreateInfo, nullptr, &mComputeFinishedSemaphore[i]);
+                assert(result == VK_SUCCESS);
+            }
+        }
+
+        mImageSubmitValues.resize(mSwapchainLength, 0);
 
         mPrimaryCmdBuffer.resize(mSwapchainLength);
-        mPrimaryShadowCmdBuffer.resize(mSwapchainLength);
         for (uint32_t bufferIndex = 0; bufferIndex < mSwapchainLength; bufferIndex++)
         {
             VkCommandBufferAllocateInfo cmdBufferAllocationInfo{};
@@ -582,16 +804,140 @@ public:
 
             result = vkAllocateCommandBuffers(mDevice, &cmdBufferAllocationInfo, &mPrimaryCmdBuffer[bufferIndex]);
             assert(result == VK_SUCCESS);
+        }
+        mPrimaryVersions.resize(mSwapchainLength, 0);
+
+        // with async compute the shadow pass goes in its own submission, which doesn't wait for
+        // the compute work the main pass needs
+        if (mAsyncCompute)
+        {
+            mShadowCmdBuffer.resize(mSwapchainLength);
+
+            VkCommandBufferAllocateInfo cmdBufferAllocationInfo{};
+            cmdBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cmdBufferAllocationInfo.pNext = nullptr;
+            cmdBufferAllocationInfo.commandPool = mCmdPool;
+            cmdBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cmdBufferAllocationInfo.commandBufferCount = mSwapchainLength;
+
+            result = vkAllocateCommandBuffers(mDevice, &cmdBufferAllocationInfo, mShadowCmdBuffer.data());
+            assert(result == VK_SUCCESS);
+
+            cmdBufferAllocationInfo.commandPool = mComputeCmdPool;
+            cmdBufferAllocationInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+            result = vkAllocateCommandBuffers(mDevice, &cmdBufferAllocationInfo, mComputeCmdBuffer.data());
+            assert(result == VK_SUCCESS);
+        }
+
+        {
+            VkCommandBufferAllocateInfo cmdBufferAllocationInfo{};
+            cmdBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cmdBufferAllocationInfo.pNext = nullptr;
+            cmdBufferAllocationInfo.commandPool = mCmdPool;
+            cmdBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cmdBufferAllocationInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
 
-            result = vkAllocateCommandBuffers(mDevice, &cmdBufferAllocationInfo, &mPrimaryShadowCmdBuffer[bufferIndex]);
+            result = vkAllocateCommandBuffers(mDevice, &cmdBufferAllocationInfo, mUniformCopyCmdBuffer.data());
             assert(result == VK_SUCCESS);
         }
 
-        mShadowMap = new ShadowMap();
+        // create frame graph, shadow pass first, then the main pass sampling its depth. Culling
+        // occlusion on the GPU the main pass is split around the occlusion pass, the first draws
+        // what was visible last frame, the second what the occlusion pass found visible behind
+        // its depth.
+        {
+            mFrameGraph = new FrameGraph(mDevice, mPhysicalDevice);
+
+            mShadowMap = new ShadowMap(*mFrameGraph, [this](VkCommandBuffer cmdBuffer, uint32_t) {
+                if (!mShadowSecondaries.empty())
+                {
+                    vkCmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(mShadowSecondaries.size()), mShadowSecondaries.data());
+                }
+            });
+
+            uint32_t width = static_cast<uint32_t>(mDisplaySize.width);
+            uint32_t height = static_cast<uint32_t>(mDisplaySize.height);
+
+            // the acquire semaphore is waited on at color attachment output
+            FrameGraph::Resource backbuffer = mFrameGraph->importImages("backbuffer", DisplayFormat, width, height,
+                displayImages, mDisplayViews, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            FrameGraph::Resource depth = mFrameGraph->createImage("depth", findDepthFormat(), width, height);
+
+            mMainPass = mFrameGraph->addPass("main", VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, [this](VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
+                if (!mSecondaries.empty())
+                {
+                    vkCmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(mSecondaries.size()), mSecondaries.data());
+                }
+                mDebugCoord->executeCommandBuffer(cmdBuffer, imageIndex);
+            });
+
+            VkClearColorValue clearColor = { { 0.3f, 0.3f, 0.3f, 1.0f } };
+            VkClearDepthStencilValue clearDepth = { 1.0f, 0 };
+            mFrameGraph->addColorOutput(mMainPass, backbuffer, clearColor);
+            mFrameGraph->setDepthOutput(mMainPass, depth, clearDepth);
+            mFrameGraph->addSampledInput(mMainPass, mShadowMap->getDepthResource(), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+            if (mGpuOcclusion)
+            {
+                // only writes the indirect draws of the late pass, which the graph doesn't see
+                mOcclusionPass = mFrameGraph->addPass("occlusion", VK_SUBPASS_CONTENTS_INLINE, [this](VkCommandBuffer cmdBuffer, uint32_t) {
+                    recordOcclusionCulling(cmdBuffer);
+                });
+                mFrameGraph->addSampledInput(mOcclusionPass, depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+                mFrameGraph->setSideEffects(mOcclusionPass);
+
+                // the same secondaries, render passes differing only in load operations are compatible
+                mLateMainPass = mFrameGraph->addPass("main late", VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, [this](VkCommandBuffer cmdBuffer, uint32_t) {
+                    if (!mSecondaries.empty())
+                    {
+                        vkCmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(mSecondaries.size()), mSecondaries.data());
+                    }
+                });
+                mFrameGraph->addColorOutput(mLateMainPass, backbuffer, clearColor);
+                mFrameGraph->setDepthOutput(mLateMainPass, depth, clearDepth);
+                mFrameGraph->addSampledInput(mLateMainPass, mShadowMap->getDepthResource(), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            }
+
+            mFrameGraph->compile();
+
+            if (mGpuOcclusion)
+            {
+                mDepthPyramid = new DepthPyramid(mFrameGraph->getImageView(depth), width, height);
+            }
+            else
+            {
+                mDepthPyramid = new DepthPyramid(VK_NULL_HANDLE, 1, 1);
+            }
+        }
+
         mDebugCoord = new DebugCoord();
+        mViewUniforms = new ViewUniforms();
+        if (mBindlessSupported)
+        {
+            mMaterialTable = new MaterialTable();
+        }
+        mInstanceCuller = new InstanceCuller();
+        mClusterCuller = new ClusterCuller();
+        mGeometryPool = new GeometryPool(Model::getVertexStride(), GEOMETRY_POOL_VERTEX_COUNT, GEOMETRY_POOL_INDEX_COUNT);
+        mModelPipeline = new ModelPipeline();
+
+#ifdef HV_DRAW_BENCHMARK
+        {
+            DrawBenchmark drawBenchmark;
+            drawBenchmark.run();
+        }
+#endif
+
+        mCommandRecorder = new CommandRecorder(mDevice, mGraphicsQueueFamilyIdx, *mJobSystem);
+
+        mModelLoader = new ModelLoader();
 
-        mModels.push_back(new Model("chalet", 0.f));
-        mModels.push_back(new Model("cube", 2.f));
+        mFramePackets = new FramePacketBuffer(FRAME_PACKET_LATENCY);
+        mStartTime = std::chrono::high_resolution_clock::now();
+
+        spawnModel("chalet", 0.f);
+        spawnModel("cube", 2.f);
     }
 
     void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiliting, VkImageUsageFlags usage,
@@ -643,7 +989,7 @@ public:
         ASSERT_VK_SUCCESS(result);
     }
 
-    VkCommandBuffer beginSingleTimeCommands()
+    VkCommandBuffer beginSingleTimeCommands() final
     {
         VkCommandBufferAllocateInfo allocInfo = {};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -663,7 +1009,7 @@ public:
         return commandBuffer;
     }
 
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer)
+    void endSingleTimeCommands(VkCommandBuffer commandBuffer) final
     {
         vkEndCommandBuffer(commandBuffer);
 
@@ -672,88 +1018,613 @@ public:
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
 
-        vkQueueSubmit(mQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(mQueue);
+        mGraphicsTracker->wait(mGraphicsTracker->submit(submitInfo));
 
         vkFreeCommandBuffers(mDevice, mCmdPool, 1, &commandBuffer);
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) final
+    // copies the uniforms staged in the slot of this frame, submitted ahead of the passes
+    void recordUniformCopies(VkCommandBuffer cmdBuffer)
     {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        // the previous frame may still be reading the uniform, instance and indirect buffers,
+        // and the indices the cluster cull pass writes
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
 
-        VkBufferCopy copyRegion = {};
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+        mViewUniforms->recordUniformCopies(cmdBuffer, mFrameIndex);
+        for (auto &model : mModels)
+        {
+            model->recordUniformCopies(cmdBuffer, mFrameIndex);
+        }
+        mDebugCoord->recordUniformCopies(cmdBuffer, mFrameIndex);
+
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
 
-        endSingleTimeCommands(commandBuffer);
+    // of the culls recorded ahead of the passes
+    InstanceCuller::Phase getFirstCullPhase() const
+    {
+        return mGpuOcclusion ? InstanceCuller::PHASE_EARLY : InstanceCuller::PHASE_SINGLE;
     }
 
-    void copyImage(VkImage srcImage, VkImage dstImage, uint32_t width, uint32_t height) final
+    // fills the indirect draws of every model for the shadow and the first main pass, after
+    // the uniform copies
+    void recordInstanceCulling(VkCommandBuffer cmdBuffer)
     {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        InstanceCuller::Phase phase = getFirstCullPhase();
+        for (auto &model : mModels)
+        {
+            model->recordCull(cmdBuffer, phase);
+        }
 
-        VkImageSubresourceLayers subResource = {};
-        subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        subResource.baseArrayLayer = 0;
-        subResource.mipLevel = 0;
-        subResource.layerCount = 1;
+        // with async compute the clusters are culled on the compute queue during the shadow pass
+        if (!mAsyncCompute)
+        {
+            recordClusterCulling(cmdBuffer, phase);
+        }
 
-        VkImageCopy region = {};
-        region.srcSubresource = subResource;
-        region.dstSubresource = subResource;
-        region.srcOffset = { 0, 0, 0 };
-        region.dstOffset = { 0, 0, 0 };
-        region.extent.width = width;
-        region.extent.height = height;
-        region.extent.depth = 1;
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
 
-        vkCmdCopyImage(commandBuffer, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    // culls the meshlets of the instances the instance cull of the phase handed over, once
+    // its writes are visible
+    void recordClusterCulling(VkCommandBuffer cmdBuffer, InstanceCuller::Phase phase)
+    {
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-        endSingleTimeCommands(commandBuffer);
+        for (auto &model : mModels)
+        {
+            model->recordClusterCull(cmdBuffer, phase);
+        }
     }
 
-    bool hasStencilComponent(VkFormat format)
+    // refills the main indirect draws with the instances the depth of the first main pass
+    // doesn't hide and that weren't drawn by it, between the two main passes
+    void recordOcclusionCulling(VkCommandBuffer cmdBuffer)
     {
-        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+        mDepthPyramid->recordBuild(cmdBuffer);
+
+        // the first main pass is done reading the indirect draws, visible instances and the
+        // indices of the cluster slots
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+        for (auto &model : mModels)
+        {
+            model->recordMainDrawReset(cmdBuffer);
+        }
+
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        for (auto &model : mModels)
+        {
+            model->recordCull(cmdBuffer, InstanceCuller::PHASE_LATE);
+        }
+
+        recordClusterCulling(cmdBuffer, InstanceCuller::PHASE_LATE);
+
+        // the history is read by the early cull of the next frame
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
     }
 
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) final
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) final
     {
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
-        VkImageMemoryBarrier barrier = {};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;
-        barrier.newLayout = newLayout;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = image;
+        // frames still in flight may be reading the destination
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 0, nullptr);
 
-        if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        VkBufferCopy copyRegion = {};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-            if (hasStencilComponent(format))
-            {
-                barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-            }
-        }
-        else {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        }
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
+        endSingleTimeCommands(commandBuffer);
+    }
 
-        if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
-        {
-            barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        }
-        else if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+    VkCommandBuffer beginTransferCommands(VkCommandPool commandPool)
+    {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        auto result = vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer);
+        ASSERT_VK_SUCCESS(result);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        return commandBuffer;
+    }
+
+    // submits the copy recorded on the transfer queue and, when the transfer queue belongs to
+    // another family, the matching ownership acquire on the graphics queue. Nothing is waited
+    // on, the staging memory and command buffers are released once the returned graphics
+    // tracker value has been reached. Called with mUploadMutex held.
+    uint64_t endTransferCommands(VkCommandBuffer transferCmdBuffer, VkCommandBuffer acquireCmdBuffer, VkBuffer stagingBuffer, VkDeviceMemory stagingBufferMemory)
+    {
+        vkEndCommandBuffer(transferCmdBuffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &transferCmdBuffer;
+
+        uint64_t value;
+        if (acquireCmdBuffer == VK_NULL_HANDLE)
+        {
+            // same family, the transfer queue is the graphics queue
+            value = mGraphicsTracker->submit(submitInfo);
+        }
+        else
+        {
+            vkEndCommandBuffer(acquireCmdBuffer);
+
+            // one semaphore per upload, a binary semaphore can't be signaled again
+            // before its previous wait has executed
+            VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+            semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+            VkSemaphore uploadSemaphore;
+            auto result = vkCreateSemaphore(mDevice, &semaphoreCreateInfo, nullptr, &uploadSemaphore);
+            ASSERT_VK_SUCCESS(result);
+
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &uploadSemaphore;
+
+            mTransferTracker->submit(submitInfo);
+
+            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+
+            VkSubmitInfo acquireSubmitInfo = {};
+            acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            acquireSubmitInfo.waitSemaphoreCount = 1;
+            acquireSubmitInfo.pWaitSemaphores = &uploadSemaphore;
+            acquireSubmitInfo.pWaitDstStageMask = waitStages;
+            acquireSubmitInfo.commandBufferCount = 1;
+            acquireSubmitInfo.pCommandBuffers = &acquireCmdBuffer;
+
+            // the acquire waits for the transfer, so its value covers both submissions
+            value = mGraphicsTracker->submit(acquireSubmitInfo);
+
+            mDeletionQueue->pushSemaphore(value, uploadSemaphore);
+        }
+
+        mDeletionQueue->pushBuffer(value, stagingBuffer);
+        mDeletionQueue->pushMemory(value, stagingBufferMemory);
+
+        mPendingUploads.push_back({ value, transferCmdBuffer, acquireCmdBuffer });
+
+        return value;
+    }
+
+    // frees the command buffers of finished uploads, the pools belong to the uploading
+    // thread so this can't go through the deletion queue. Called with mUploadMutex held.
+    void retireUploads()
+    {
+        auto it = mPendingUploads.begin();
+        while (it != mPendingUploads.end())
+        {
+            if (mGraphicsTracker->isComplete(it->value))
+            {
+                vkFreeCommandBuffers(mDevice, mTransferCmdPool, 1, &it->transferCmdBuffer);
+                if (it->acquireCmdBuffer != VK_NULL_HANDLE)
+                {
+                    vkFreeCommandBuffers(mDevice, mUploadAcquireCmdPool, 1, &it->acquireCmdBuffer);
+                }
+                it = mPendingUploads.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    uint64_t uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) final
+    {
+        return uploadBuffer(data, size, dstBuffer, dstOffset, dstAccessMask, dstStageMask, false);
+    }
+
+    uint64_t uploadSharedBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) final
+    {
+        return uploadBuffer(data, size, dstBuffer, dstOffset, dstAccessMask, dstStageMask, true);
+    }
+
+    uint64_t uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask, bool shared)
+    {
+        std::lock_guard<std::mutex> lock(mUploadMutex);
+        retireUploads();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* mapped;
+        auto result = vkMapMemory(mDevice, stagingBufferMemory, 0, size, 0, &mapped);
+        ASSERT_VK_SUCCESS(result);
+        memcpy(mapped, data, (size_t)size);
+        vkUnmapMemory(mDevice, stagingBufferMemory);
+
+        VkCommandBuffer transferCmdBuffer = beginTransferCommands(mTransferCmdPool);
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(transferCmdBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+
+        // only the written range, other parts of the buffer may be in use by the graphics queue
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = dstBuffer;
+        barrier.offset = dstOffset;
+        barrier.size = size;
+
+        VkCommandBuffer acquireCmdBuffer = VK_NULL_HANDLE;
+        if (mTransferQueueFamilyIdx == mGraphicsQueueFamilyIdx)
+        {
+            vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask,
+                0, 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+        else
+        {
+            // release on the transfer queue, shared buffers belong to every queue already and
+            // only need the semaphore the acquire submission waits on
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = shared ? VK_QUEUE_FAMILY_IGNORED : mTransferQueueFamilyIdx;
+            barrier.dstQueueFamilyIndex = shared ? VK_QUEUE_FAMILY_IGNORED : mGraphicsQueueFamilyIdx;
+            vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+            // acquire on the graphics queue
+            acquireCmdBuffer = beginTransferCommands(mUploadAcquireCmdPool);
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = dstAccessMask;
+            vkCmdPipelineBarrier(acquireCmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, dstStageMask,
+                0, 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+
+        return endTransferCommands(transferCmdBuffer, acquireCmdBuffer, stagingBuffer, stagingBufferMemory);
+    }
+
+    uint64_t uploadImage(const void* pixels, VkDeviceSize size, uint32_t width, uint32_t height, VkImage dstImage) final
+    {
+        std::lock_guard<std::mutex> lock(mUploadMutex);
+        retireUploads();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* mapped;
+        auto result = vkMapMemory(mDevice, stagingBufferMemory, 0, size, 0, &mapped);
+        ASSERT_VK_SUCCESS(result);
+        memcpy(mapped, pixels, (size_t)size);
+        vkUnmapMemory(mDevice, stagingBufferMemory);
+
+        VkCommandBuffer transferCmdBuffer = beginTransferCommands(mTransferCmdPool);
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = dstImage;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { width, height, 1 };
+
+        vkCmdCopyBufferToImage(transferCmdBuffer, stagingBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        VkCommandBuffer acquireCmdBuffer = VK_NULL_HANDLE;
+        if (mTransferQueueFamilyIdx == mGraphicsQueueFamilyIdx)
+        {
+            vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        else
+        {
+            // release on the transfer queue, the layout transition happens once between release and acquire
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = mTransferQueueFamilyIdx;
+            barrier.dstQueueFamilyIndex = mGraphicsQueueFamilyIdx;
+            vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+            // acquire on the graphics queue
+            acquireCmdBuffer = beginTransferCommands(mUploadAcquireCmdPool);
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(acquireCmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+
+        return endTransferCommands(transferCmdBuffer, acquireCmdBuffer, stagingBuffer, stagingBufferMemory);
+    }
+
+    uint32_t spawnModel(const std::string &name, float offsetZ) final
+    {
+        uint32_t id = mNextModelId++;
+        TransformSystem::Handle transform = mTransforms->create();
+        mTransforms->setTranslation(transform, mathfu::vec3(0.f, 0.f, offsetZ));
+        mSceneObjects.push_back({ id, transform });
+
+        // the renderer shares the mesh between all instances of the same name
+        std::lock_guard<std::mutex> lock(mSceneMutex);
+        mSceneChanges.push_back({ id, name, true });
+        return id;
+    }
+
+    void despawnModel(uint32_t id) final
+    {
+        assert(id < mNextModelId);
+
+        auto object = std::find_if(mSceneObjects.begin(), mSceneObjects.end(),
+            [id](const SceneObject &object) { return object.id == id; });
+        if (object != mSceneObjects.end())
+        {
+            mTransforms->destroy(object->transform);
+            mSceneObjects.erase(object);
+        }
+
+        // the renderer may be drawing it right now, it lets go on its own thread
+        std::lock_guard<std::mutex> lock(mSceneMutex);
+        mSceneChanges.push_back({ id, std::string(), false });
+    }
+
+    void addModelInstance(uint32_t id, const std::string &name)
+    {
+        mInstanceMeshes[id] = name;
+
+        auto &mesh = mMeshes[name];
+        if (mesh.resident)
+        {
+            mesh.model->addInstance(id, mathfu::mat4::Identity());
+            mLiveInstances[id] = mesh.model;
+            return;
+        }
+
+        if (!mesh.model && !mesh.loading)
+        {
+            mModelLoader->request(name);
+            mesh.loading = true;
+        }
+        mesh.pendingInstances.push_back(id);
+    }
+
+    void removeModelInstance(uint32_t id)
+    {
+        auto instance = mInstanceMeshes.find(id);
+        assert(instance != mInstanceMeshes.end());
+
+        auto it = mMeshes.find(instance->second);
+        mInstanceMeshes.erase(instance);
+
+        auto &mesh = it->second;
+        if (mesh.resident)
+        {
+            mesh.model->removeInstance(id);
+            mLiveInstances.erase(id);
+
+            if (mesh.model->getInstanceCount() == 0)
+            {
+                mModels.erase(std::remove(mModels.begin(), mModels.end(), mesh.model), mModels.end());
+                delete mesh.model;
+                mMeshes.erase(it);
+            }
+            return;
+        }
+
+        mesh.pendingInstances.erase(std::remove(mesh.pendingInstances.begin(), mesh.pendingInstances.end(), id), mesh.pendingInstances.end());
+
+        // a mesh still on the loader thread is dropped when it comes back
+        if (mesh.pendingInstances.empty() && !mesh.loading)
+        {
+            delete mesh.model;
+            mMeshes.erase(it);
+        }
+    }
+
+    // picks up models from the loader and lets them join the frame once their uploads completed
+    void streamModels()
+    {
+        std::vector<SceneChange> changes;
+        {
+            std::lock_guard<std::mutex> lock(mSceneMutex);
+            changes.swap(mSceneChanges);
+        }
+
+        for (auto &change : changes)
+        {
+            if (change.spawn)
+            {
+                addModelInstance(change.id, change.name);
+            }
+            else
+            {
+                removeModelInstance(change.id);
+            }
+        }
+
+        std::vector<ModelLoader::Result> loaded;
+        mModelLoader->poll(loaded);
+
+        for (auto &result : loaded)
+        {
+            auto it = mMeshes.find(result.name);
+            assert(it != mMeshes.end() && it->second.loading);
+
+            it->second.loading = false;
+            if (it->second.pendingInstances.empty())
+            {
+                delete result.model;
+                mMeshes.erase(it);
+            }
+            else
+            {
+                it->second.model = result.model;
+
+                // ranges may have been freed while it was loading
+                if (!result.model->hasGeometry())
+                {
+                    mGeometryPoolChanged = true;
+                }
+            }
+        }
+
+        // models that found no room in the geometry pool retry once it is compacted or
+        // ranges were freed, the models drawn so far record again with their moved ranges
+        bool compacted = false;
+        for (auto &entry : mMeshes)
+        {
+            auto &mesh = entry.second;
+            if (mesh.model && !mesh.model->hasGeometry())
+            {
+                if (!compacted && mGeometryPool->compact(mGraphicsTracker->getCompletedValue()))
+                {
+                    for (auto &model : mModels)
+                    {
+                        model->onGeometryMoved();
+                    }
+                    mGeometryPoolChanged = true;
+                }
+                compacted = true;
+
+                if (mGeometryPoolChanged)
+                {
+                    mesh.model->allocateGeometry();
+                }
+            }
+        }
+        if (compacted)
+        {
+            mGeometryPoolChanged = false;
+        }
+
+        for (auto &entry : mMeshes)
+        {
+            auto &mesh = entry.second;
+            if (mesh.model && !mesh.resident && mesh.model->hasGeometry() && mGraphicsTracker->isComplete(mesh.model->getUploadValue()))
+            {
+                mesh.resident = true;
+                mModels.push_back(mesh.model);
+
+                for (auto &id : mesh.pendingInstances)
+                {
+                    mesh.model->addInstance(id, mathfu::mat4::Identity());
+                    mLiveInstances[id] = mesh.model;
+                }
+                mesh.pendingInstances.clear();
+            }
+        }
+    }
+
+    bool hasStencilComponent(VkFormat format)
+    {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    }
+
+    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) final
+    {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+
+        if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+            if (hasStencilComponent(format))
+            {
+                barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+            }
+        }
+        else {
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+        {
+            barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        }
+        else if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
         {
             barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
             barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
@@ -827,12 +1698,28 @@ public:
 
     // create buffer lambda
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) final
+    {
+        createBuffer(size, usage, properties, VK_SHARING_MODE_EXCLUSIVE, buffer, bufferMemory);
+    }
+
+    void createSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) final
+    {
+        VkSharingMode sharingMode = mSharedQueueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+        createBuffer(size, usage, properties, sharingMode, buffer, bufferMemory);
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkSharingMode sharingMode, VkBuffer &buffer, VkDeviceMemory &bufferMemory)
     {
         VkBufferCreateInfo bufferInfo = {};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        bufferInfo.sharingMode = sharingMode;
+        if (sharingMode == VK_SHARING_MODE_CONCURRENT)
+        {
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(mSharedQueueFamilies.size());
+            bufferInfo.pQueueFamilyIndices = mSharedQueueFamilies.data();
+        }
 
         auto result = vkCreateBuffer(mDevice, &bufferInfo, nullptr, &buffer);
         assert(result == VK_SUCCESS);
@@ -863,126 +1750,332 @@ public:
         vkBindBufferMemory(mDevice, buffer, bufferMemory, 0);
     };
 
-    void draw() final
+    void createComputePipeline(const std::string &shaderName, VkPipelineLayout layout, VkPipeline &pipeline) final
     {
-        vkQueueWaitIdle(mQueue);
+        Asset cs(shaderName, 0);
+        auto size = cs.getLength();
+        std::vector<uint8_t> csData(size);
+        cs.read(csData.data(), size);
+        cs.close();
+
+        VkShaderModule computeShader;
+
+        VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCreateInfo.pNext = nullptr;
+        shaderModuleCreateInfo.codeSize = csData.size();
+        shaderModuleCreateInfo.pCode = (const uint32_t*)(csData.data());
+        shaderModuleCreateInfo.flags = 0;
+
+        auto result = vkCreateShaderModule(mDevice, &shaderModuleCreateInfo, nullptr, &computeShader);
+        assert(result == VK_SUCCESS);
 
-        uint32_t nextIndex;
-        VkResult result = vkAcquireNextImageKHR(mDevice, mSwapchain, 0xFFFFFFFFFFFFFFFFull, mImageAvailableSemaphore, VK_NULL_HANDLE, &nextIndex);
+        VkComputePipelineCreateInfo pipelineCreateInfo{};
+        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineCreateInfo.pNext = nullptr;
+        pipelineCreateInfo.flags = 0;
+        pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineCreateInfo.stage.module = computeShader;
+        pipelineCreateInfo.stage.pName = "main";
+        pipelineCreateInfo.layout = layout;
+        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineCreateInfo.basePipelineIndex = -1;
+
+        result = vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
         assert(result == VK_SUCCESS);
 
-        // draw shadowmap
+        vkDestroyShaderModule(mDevice, computeShader, nullptr);
+    }
+
+    void startRenderThread() final
+    {
+        assert(!mRenderThread.joinable());
+
+        // recording needs worker 0 of the job system, it moves along with the drawing
+        mJobSystem->detachCurrentThread();
+        mRenderThread = std::thread(&VKRendererImpl::renderThreadMain, this);
+    }
+
+    void renderThreadMain()
+    {
+        mJobSystem->attachCurrentThread();
+
+        while (mFramePackets->acquire(true))
         {
-            VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-            cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            cmdBufferBeginInfo.pNext = nullptr;
-            cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-            cmdBufferBeginInfo.pInheritanceInfo = nullptr;
+            renderFrame(mFramePackets->getReadPacket());
+        }
 
-            result = vkBeginCommandBuffer(mPrimaryShadowCmdBuffer[nextIndex], &cmdBufferBeginInfo);
-            assert(result == VK_SUCCESS);
+        mJobSystem->detachCurrentThread();
+    }
+
+    void draw() final
+    {
+        assert(!mRenderThread.joinable());
+
+        if (mFramePackets->acquire(false))
+        {
+            renderFrame(mFramePackets->getReadPacket());
+        }
+    }
+
+    void renderFrame(const FramePacket &packet)
+    {
+        // the semaphores of this slot are free again once the frame that used them has retired
+        mGraphicsTracker->wait(mFrameSubmitValues[mFrameIndex]);
+
+        mDeletionQueue->collect(mGraphicsTracker->getCompletedValue());
+        if (mGeometryPool->collect(mGraphicsTracker->getCompletedValue()))
+        {
+            mGeometryPoolChanged = true;
+        }
+        mDescriptorAllocator->collect(mGraphicsTracker->getCompletedValue());
+        mDescriptorAllocator->resetTransient(mFrameIndex);
+
+        streamModels();
+
+        for (auto &instance : packet.models)
+        {
+            auto live = mLiveInstances.find(instance.id);
+            if (live != mLiveInstances.end())
+            {
+                live->second->setInstanceTransform(instance.id, instance.transform);
+            }
+        }
+
+        std::array<Frustum, RenderQueue::PASS_COUNT> frusta = { {
+            Frustum(packet.lightProj * packet.lightView),
+            Frustum(packet.proj * packet.view),
+        } };
+
+        // the camera and the light once for all models
+        mViewUniforms->update(packet, frusta, mFrameIndex);
+
+        mJobSystem->parallelFor(static_cast<uint32_t>(mModels.size()), MODEL_UPDATE_BATCH_SIZE, [this, &frusta](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                mModels[i]->update(frusta, mFrameIndex);
+            }
+        });
+
+        mCullStats = CullStats();
+
+        // rasterize the small meshes as occluders and flag the instances they hide, the cull
+        // pass leaves those out of the main pass without changing what is recorded
+        if (!mGpuOcclusion)
+        {
+            auto rasterizeStart = std::chrono::high_resolution_clock::now();
+
+            mOcclusionRasterizer->begin(packet.proj * packet.view);
+            for (auto &model : mModels)
             {
-                std::array<VkClearValue, 1> clearValues = {};
-                clearValues[0].depthStencil = { 1.0f, 0 };
-
-                // Clear color and depth
-                VkRenderPassBeginInfo renderPassBeginInfo{};
-                renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-                renderPassBeginInfo.pNext = nullptr;
-                renderPassBeginInfo.renderPass = mShadowMap->getRenderPass();
-                renderPassBeginInfo.framebuffer = mShadowMap->getFramebuffer();
-                renderPassBeginInfo.renderArea.offset.x = 0;
-                renderPassBeginInfo.renderArea.offset.y = 0;
-                renderPassBeginInfo.renderArea.extent.width = ShadowMap::SHADOWMAP_DIM;
-                renderPassBeginInfo.renderArea.extent.height = ShadowMap::SHADOWMAP_DIM;
-                renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-                renderPassBeginInfo.pClearValues = clearValues.data();
-
-                vkCmdBeginRenderPass(mPrimaryShadowCmdBuffer[nextIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                if (model->isOccluder())
                 {
-                    for (auto &model : mModels)
-                    {
-                        model->executeShadowCommandBuffer(mPrimaryShadowCmdBuffer[nextIndex], nextIndex);
-                    }
+                    model->addOccluders(*mOcclusionRasterizer);
                 }
+            }
+            mOcclusionRasterizer->rasterize();
 
-                vkCmdEndRenderPass(mPrimaryShadowCmdBuffer[nextIndex]);
+            auto testStart = std::chrono::high_resolution_clock::now();
+
+            std::vector<uint32_t> occludedInstances(mModels.size());
+            mJobSystem->parallelFor(static_cast<uint32_t>(mModels.size()), MODEL_UPDATE_BATCH_SIZE, [this, &occludedInstances](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++)
+                {
+                    occludedInstances[i] = mModels[i]->cullOccluded(*mOcclusionRasterizer, mFrameIndex);
+                }
+            });
+
+            auto testEnd = std::chrono::high_resolution_clock::now();
+
+            for (size_t i = 0; i < mModels.size(); i++)
+            {
+                uint32_t visibleInstances = mModels[i]->getVisibleInstanceCount(RenderQueue::PASS_MAIN);
+                mCullStats.occludedModels += visibleInstances > 0 && occludedInstances[i] == visibleInstances ? 1 : 0;
+                mCullStats.occludedInstances += occludedInstances[i];
             }
-            result = vkEndCommandBuffer(mPrimaryShadowCmdBuffer[nextIndex]);
-            assert(result == VK_SUCCESS);
+            mCullStats.occluderTriangles = mOcclusionRasterizer->getTriangleCount();
+            mCullStats.rasterizeMilliseconds = std::chrono::duration<float, std::milli>(testStart - rasterizeStart).count();
+            mCullStats.testMilliseconds = std::chrono::duration<float, std::milli>(testEnd - testStart).count();
+        }
 
-            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        for (auto &model : mModels)
+        {
+            uint32_t visibleShadowInstances = model->getVisibleInstanceCount(RenderQueue::PASS_SHADOW);
+            uint32_t visibleInstances = model->getVisibleInstanceCount(RenderQueue::PASS_MAIN);
+
+            mCullStats.modelCount++;
+            mCullStats.instanceCount += model->getInstanceCount();
+            mCullStats.visibleShadowModels += visibleShadowInstances > 0 ? 1 : 0;
+            mCullStats.visibleShadowInstances += visibleShadowInstances;
+            mCullStats.visibleModels += visibleInstances > 0 ? 1 : 0;
+            mCullStats.visibleInstances += visibleInstances;
+        }
+        mDebugCoord->update(packet, mFrameIndex);
 
-            VkSubmitInfo submitInfo{};
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.pNext = nullptr;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &mImageAvailableSemaphore;
-            submitInfo.pWaitDstStageMask = waitStages;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &mPrimaryShadowCmdBuffer[nextIndex];
-            submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = &mShadowMapAvailableSemaphore;
+        // re-record the draws of models that changed, across all worker threads
+        if (mCommandRecorder->recordModels(mModels, mShadowMap->getRenderPass(), getRenderPass(),
+            mGraphicsTracker->getLastSubmittedValue(), mGraphicsTracker->getCompletedValue(), mShadowSecondaries, mSecondaries))
+        {
+            mSceneVersion++;
+        }
 
-            result = vkQueueSubmit(mQueue, 1, &submitInfo, VK_NULL_HANDLE);
-            assert(result == VK_SUCCESS);
+        if (++mStatsFrameCount == STATS_LOG_INTERVAL)
+        {
+            mStatsFrameCount = 0;
+
+            LOGI("visible models: shadow %u, main %u of %u\n",
+                mCullStats.visibleShadowModels, mCullStats.visibleModels, mCullStats.modelCount);
+            if (!mGpuOcclusion)
+            {
+                LOGI("occluded models %u, instances %u, %u occluder triangles, rasterized in %.3f ms, tested in %.3f ms\n",
+                    mCullStats.occludedModels, mCullStats.occludedInstances, mCullStats.occluderTriangles,
+                    mCullStats.rasterizeMilliseconds, mCullStats.testMilliseconds);
+            }
+
+            auto &stats = mCommandRecorder->getStats();
+            LOGI("sorted %u draws in %.3f ms, binds: pipeline %u (%u skipped), descriptor set %u (%u skipped), geometry %u (%u skipped)\n",
+                stats.packetCount, stats.sortMilliseconds,
+                stats.binds.pipelineBinds, stats.binds.pipelineBindsSkipped,
+                stats.binds.descriptorSetBinds, stats.binds.descriptorSetBindsSkipped,
+                stats.binds.geometryBinds, stats.binds.geometryBindsSkipped);
         }
 
-        // draw objects
+        uint32_t nextIndex;
+        VkResult result = vkAcquireNextImageKHR(mDevice, mSwapchain, 0xFFFFFFFFFFFFFFFFull, mImageAvailableSemaphore[mFrameIndex], VK_NULL_HANDLE, &nextIndex);
+        assert(result == VK_SUCCESS);
+
+        // the primary command buffers of this image may still be pending from an older slot
+        mGraphicsTracker->wait(mImageSubmitValues[nextIndex]);
+
+        // draw frame, the command buffers are kept for as long as the scene doesn't change
         {
             VkCommandBufferBeginInfo cmdBufferBeginInfo{};
             cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
             cmdBufferBeginInfo.pNext = nullptr;
-            cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+            cmdBufferBeginInfo.flags = 0;
             cmdBufferBeginInfo.pInheritanceInfo = nullptr;
 
+            // the copies read the staging slot of this frame, so they are kept per slot
+            if (mUniformCopyVersions[mFrameIndex] != mSceneVersion)
+            {
+                result = vkBeginCommandBuffer(mUniformCopyCmdBuffer[mFrameIndex], &cmdBufferBeginInfo);
+                assert(result == VK_SUCCESS);
+                {
+                    recordUniformCopies(mUniformCopyCmdBuffer[mFrameIndex]);
+                    recordInstanceCulling(mUniformCopyCmdBuffer[mFrameIndex]);
+                }
+                result = vkEndCommandBuffer(mUniformCopyCmdBuffer[mFrameIndex]);
+                assert(result == VK_SUCCESS);
 
-            result = vkBeginCommandBuffer(mPrimaryCmdBuffer[nextIndex], &cmdBufferBeginInfo);
-            assert(result == VK_SUCCESS);
+                // the cluster cull reads the instance cull of the same slot
+                if (mAsyncCompute)
+                {
+                    result = vkBeginCommandBuffer(mComputeCmdBuffer[mFrameIndex], &cmdBufferBeginInfo);
+                    assert(result == VK_SUCCESS);
+                    {
+                        recordClusterCulling(mComputeCmdBuffer[mFrameIndex], getFirstCullPhase());
+                    }
+                    result = vkEndCommandBuffer(mComputeCmdBuffer[mFrameIndex]);
+                    assert(result == VK_SUCCESS);
+                }
+
+                mUniformCopyVersions[mFrameIndex] = mSceneVersion;
+            }
+
+            // the pass graph and the swapchain image are fixed, so they are kept per image
+            if (mPrimaryVersions[nextIndex] != mSceneVersion)
             {
-                std::array<VkClearValue, 2> clearValues = {};
-                clearValues[0].color = { 0.3f, 0.3f, 0.3f, 1.0f };
-                clearValues[1].depthStencil = { 1.0f, 0 };
-
-                VkRenderPassBeginInfo renderPassBeginInfo{};
-                renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-                renderPassBeginInfo.pNext = nullptr;
-                renderPassBeginInfo.renderPass = mRenderPass;
-                renderPassBeginInfo.framebuffer = mFramebuffers[nextIndex];
-                renderPassBeginInfo.renderArea.offset.x = 0;
-                renderPassBeginInfo.renderArea.offset.y = 0;
-                renderPassBeginInfo.renderArea.extent = mDisplaySize;
-                renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-                renderPassBeginInfo.pClearValues = clearValues.data();
-
-                vkCmdBeginRenderPass(mPrimaryCmdBuffer[nextIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                if (mAsyncCompute)
                 {
-                    for (auto &model : mModels)
+                    result = vkBeginCommandBuffer(mShadowCmdBuffer[nextIndex], &cmdBufferBeginInfo);
+                    assert(result == VK_SUCCESS);
                     {
-                        model->executeCommandBuffer(mPrimaryCmdBuffer[nextIndex], nextIndex);
+                        // the shadow pass comes first in the graph
+                        mFrameGraph->execute(mShadowCmdBuffer[nextIndex], nextIndex, 0, mMainPass);
                     }
+                    result = vkEndCommandBuffer(mShadowCmdBuffer[nextIndex]);
+                    assert(result == VK_SUCCESS);
+                }
+
+                result = vkBeginCommandBuffer(mPrimaryCmdBuffer[nextIndex], &cmdBufferBeginInfo);
+                assert(result == VK_SUCCESS);
+                {
+                    // shadow and main pass, the graph orders them with barriers. The shadow pass
+                    // has its own command buffer with async compute.
+                    FrameGraph::Pass firstPass = mAsyncCompute ? mMainPass : 0;
+                    mFrameGraph->execute(mPrimaryCmdBuffer[nextIndex], nextIndex, firstPass, mFrameGraph->getPassCount());
                 }
-                mDebugCoord->executeCommandBuffer(mPrimaryCmdBuffer[nextIndex], nextIndex);
-                vkCmdEndRenderPass(mPrimaryCmdBuffer[nextIndex]);
+                result = vkEndCommandBuffer(mPrimaryCmdBuffer[nextIndex]);
+                assert(result == VK_SUCCESS);
+
+                mPrimaryVersions[nextIndex] = mSceneVersion;
             }
-            result = vkEndCommandBuffer(mPrimaryCmdBuffer[nextIndex]);
-            assert(result == VK_SUCCESS);
 
-            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+            VkCommandBuffer cmdBuffers[] = { mUniformCopyCmdBuffer[mFrameIndex], mPrimaryCmdBuffer[nextIndex] };
+
+            VkSemaphore waitSemaphores[] = { mImageAvailableSemaphore[mFrameIndex], mComputeFinishedSemaphore[mFrameIndex] };
+            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
 
             VkSubmitInfo submitInfo{};
             submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
             submitInfo.pNext = nullptr;
             submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &mShadowMapAvailableSemaphore;
+            submitInfo.pWaitSemaphores = waitSemaphores;
             submitInfo.pWaitDstStageMask = waitStages;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &mPrimaryCmdBuffer[nextIndex];
+            submitInfo.commandBufferCount = 2;
+            submitInfo.pCommandBuffers = cmdBuffers;
             submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = &mRenderFinishedSemaphore;
+            submitInfo.pSignalSemaphores = &mRenderFinishedSemaphore[mFrameIndex];
 
-            result = vkQueueSubmit(mQueue, 1, &submitInfo, VK_NULL_HANDLE);
-            assert(result == VK_SUCCESS);
+            // the instance cull is submitted on its own so the compute queue can start on the
+            // clusters, then the shadow pass runs alongside them. A semaphore wait holds back
+            // every later command of its submission at the given stages, so only the main
+            // passes wait for the cluster cull, for its indirect draws and indices.
+            if (mAsyncCompute)
+            {
+                VkSubmitInfo cullSubmitInfo{};
+                cullSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                cullSubmitInfo.commandBufferCount = 1;
+                cullSubmitInfo.pCommandBuffers = &mUniformCopyCmdBuffer[mFrameIndex];
+                cullSubmitInfo.signalSemaphoreCount = 1;
+                cullSubmitInfo.pSignalSemaphores = &mCullFinishedSemaphore[mFrameIndex];
+                mGraphicsTracker->submit(cullSubmitInfo);
+
+                VkPipelineStageFlags computeWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+                VkSubmitInfo computeSubmitInfo{};
+                computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                computeSubmitInfo.waitSemaphoreCount = 1;
+                computeSubmitInfo.pWaitSemaphores = &mCullFinishedSemaphore[mFrameIndex];
+                computeSubmitInfo.pWaitDstStageMask = &computeWaitStage;
+                computeSubmitInfo.commandBufferCount = 1;
+                computeSubmitInfo.pCommandBuffers = &mComputeCmdBuffer[mFrameIndex];
+                computeSubmitInfo.signalSemaphoreCount = 1;
+                computeSubmitInfo.pSignalSemaphores = &mComputeFinishedSemaphore[mFrameIndex];
+                mComputeTracker->submit(computeSubmitInfo);
+
+                VkSubmitInfo shadowSubmitInfo{};
+                shadowSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                shadowSubmitInfo.commandBufferCount = 1;
+                shadowSubmitInfo.pCommandBuffers = &mShadowCmdBuffer[nextIndex];
+                mGraphicsTracker->submit(shadowSubmitInfo);
+
+                submitInfo.waitSemaphoreCount = 2;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &mPrimaryCmdBuffer[nextIndex];
+            }
+
+            // retiring the last submission retires the ones before it, and the compute work
+            // it waited on
+            uint64_t frameValue = mGraphicsTracker->submit(submitInfo);
+            mFrameSubmitValues[mFrameIndex] = frameValue;
+            mImageSubmitValues[nextIndex] = frameValue;
+
+            for (auto &model : mModels)
+            {
+                model->setLastUsedValue(frameValue);
+            }
         }
 
         {
@@ -993,20 +2086,54 @@ public:
             presentInfo.pSwapchains = &mSwapchain;
             presentInfo.pImageIndices = &nextIndex;
             presentInfo.waitSemaphoreCount = 1;
-            presentInfo.pWaitSemaphores = &mRenderFinishedSemaphore;
+            presentInfo.pWaitSemaphores = &mRenderFinishedSemaphore[mFrameIndex];
             presentInfo.pResults = nullptr;
 
+            std::lock_guard<std::mutex> lock(mQueueMutex);
             vkQueuePresentKHR(mQueue, &presentInfo);
         }
+
+        mFrameIndex = (mFrameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
     void update() final
     {
-        for (auto &model : mModels)
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - mStartTime).count() / 1000.0f;
+
+        FramePacket &packet = mFramePackets->getWritePacket();
+
+        auto rotation = mathfu::quat::FromAngleAxis(time * 90.f / 180.f * 3.1415926f, mathfu::vec3(0.f, 1.f, 0.f));
+        for (auto &object : mSceneObjects)
         {
-            model->update();
+            mTransforms->setRotation(object.transform, rotation);
         }
-        mDebugCoord->update();
+        mTransforms->update();
+
+        packet.models.clear();
+        for (auto &object : mSceneObjects)
+        {
+            packet.models.push_back({ object.id, mTransforms->getWorld(object.transform) });
+        }
+
+        // camera
+        packet.view = mathfu::mat4::LookAt(mathfu::vec3(0.0f, 0.0f, 0.0f), mathfu::vec3(4.0f, 4.0f, 4.0f), mathfu::vec3(0.0f, 1.0f, 0.0f), 1.0f);
+        packet.proj = mathfu::mat4::Perspective((45.0f) / 180.f * 3.1415926f, (float)mDisplaySize.width / (float)mDisplaySize.height, 0.1f, 10.0f);
+        packet.proj(1, 1) *= -1;
+
+        // directional light, the shadow map covers a 20 unit cube around the origin
+        packet.lightView = mathfu::mat4::LookAt(mathfu::vec3(0.0f, 0.0f, 0.0f), mathfu::vec3(2.f, 2.f, -2.f), mathfu::vec3(0.0f, 1.0f, 0.0f), 1.0f);
+        mathfu::vec3 sphereCenterRS = packet.lightView * mathfu::vec3(0, 0, 0);
+        float l = sphereCenterRS.x() - 10;
+        float b = sphereCenterRS.y() - 10;
+        float n = sphereCenterRS.z() - 10;
+        float r = sphereCenterRS.x() + 10;
+        float t = sphereCenterRS.y() + 10;
+        float f = sphereCenterRS.z() + 10;
+        packet.lightProj = mathfu::mat4::Ortho(l, r, b, t, n, f, 1.f);
+        packet.lightProj(1, 1) *= -1;
+
+        mFramePackets->publish();
     }
 
     ShadowMap* getShadowMap() final
@@ -1014,6 +2141,46 @@ public:
         return mShadowMap;
     }
 
+    InstanceCuller* getInstanceCuller() final
+    {
+        return mInstanceCuller;
+    }
+
+    ClusterCuller* getClusterCuller() final
+    {
+        return mClusterCuller;
+    }
+
+    DepthPyramid* getDepthPyramid() final
+    {
+        return mDepthPyramid;
+    }
+
+    GeometryPool* getGeometryPool() final
+    {
+        return mGeometryPool;
+    }
+
+    ModelPipeline* getModelPipeline() final
+    {
+        return mModelPipeline;
+    }
+
+    ViewUniforms* getViewUniforms() final
+    {
+        return mViewUniforms;
+    }
+
+    MaterialTable* getMaterialTable() final
+    {
+        return mMaterialTable;
+    }
+
+    const CullStats &getCullStats() final
+    {
+        return mCullStats;
+    }
+
     VkDevice &getDevice() final
     {
         return mDevice;
@@ -1024,25 +2191,59 @@ public:
         return mPhysicalDevice;
     }
 
+    const VkPhysicalDeviceFeatures &getEnabledFeatures() final
+    {
+        return mEnabledFeatures;
+    }
+
     VkExtent2D &getDisplaySize() final
     {
         return mDisplaySize;
     }
 
+    SubmissionTracker &getGraphicsTracker() final
+    {
+        return *mGraphicsTracker;
+    }
+
+    JobSystem &getJobSystem() final
+    {
+        return *mJobSystem;
+    }
+
+    DeletionQueue &getDeletionQueue() final
+    {
+        return *mDeletionQueue;
+    }
+
+    DescriptorAllocator &getDescriptorAllocator() final
+    {
+        return *mDescriptorAllocator;
+    }
+
+    uint32_t getGraphicsQueueFamilyIndex() final
+    {
+        return mGraphicsQueueFamilyIdx;
+    }
+
     uint32_t getSwapChainLength() final
     {
         return mSwapchainLength;
     }
 
-    VkFramebuffer &getFramebuffer(uint32_t index) final
+    uint32_t getFramesInFlight() final
+    {
+        return MAX_FRAMES_IN_FLIGHT;
+    }
+
+    VkFramebuffer getFramebuffer(uint32_t index) final
     {
-        assert(index < mFramebuffers.size());
-        return mFramebuffers[index];
+        return mFrameGraph->getFramebuffer(mMainPass, index);
     }
 
-    VkRenderPass &getRenderPass()
+    VkRenderPass getRenderPass() final
     {
-        return mRenderPass;
+        return mFrameGraph->getRenderPass(mMainPass);
     }
 
     VkCommandPool &getCommandPool()
@@ -1060,8 +2261,17 @@ public:
     VkInstance          mInstance;
     VkSurfaceKHR        mSurface;
     VkPhysicalDevice    mPhysicalDevice;
+    VkPhysicalDeviceFeatures mEnabledFeatures{};
     VkDevice            mDevice;
     VkQueue             mQueue;
+    VkQueue             mTransferQueue;
+    uint32_t            mGraphicsQueueFamilyIdx{ 0 };
+    uint32_t            mTransferQueueFamilyIdx{ 0 };
+    VkQueue             mComputeQueue{ VK_NULL_HANDLE };
+    uint32_t            mComputeQueueFamilyIdx{ 0 };
+    // the compute family differs from the graphics one
+    bool                mAsyncCompute{ false };
+    std::vector<uint32_t> mSharedQueueFamilies;
 
     VkSwapchainKHR      mSwapchain;
     uint32_t            mSwapchainLength;
@@ -1070,26 +2280,116 @@ public:
     VkFormat            DisplayFormat;
 
     // array of frame buffers and views
-    std::vector<VkFramebuffer>      mFramebuffers;
     std::vector<VkImageView>        mDisplayViews;
 
-    VkRenderPass        mRenderPass;
+    FrameGraph*         mFrameGraph{ nullptr };
+    FrameGraph::Pass    mMainPass;
+    FrameGraph::Pass    mOcclusionPass;
+    FrameGraph::Pass    mLateMainPass;
+    DepthPyramid*       mDepthPyramid{ nullptr };
+    // secondaries executed by the graph passes, from the command recorder
+    std::vector<VkCommandBuffer>    mShadowSecondaries;
+    std::vector<VkCommandBuffer>    mSecondaries;
+
     VkCommandPool       mCmdPool;
+    VkCommandPool       mTransferCmdPool;
+    VkCommandPool       mComputeCmdPool{ VK_NULL_HANDLE };
     std::vector<VkCommandBuffer>    mPrimaryCmdBuffer;
-    std::vector<VkCommandBuffer>    mPrimaryShadowCmdBuffer;
-    VkImage             mDepthImage;
-    VkDeviceMemory      mDepthImageMemory;
-    VkImageView         mDepthImageView;
+    std::vector<VkCommandBuffer>    mShadowCmdBuffer;
+    std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT>   mComputeCmdBuffer{};
+    std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT>   mUniformCopyCmdBuffer;
+
+    // bumped whenever the recorded secondaries change, command buffers recorded
+    // at an older version are recorded again before they are submitted
+    uint64_t                                        mSceneVersion{ 1 };
+    uint32_t                                        mStatsFrameCount{ 0 };
+    std::vector<uint64_t>                           mPrimaryVersions;
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT>      mUniformCopyVersions{};
+
+    std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT>   mImageAvailableSemaphore;
+    std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT>   mRenderFinishedSemaphore;
+    std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT>   mCullFinishedSemaphore{};
+    std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT>   mComputeFinishedSemaphore{};
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT>      mFrameSubmitValues{};
+    std::vector<uint64_t>                           mImageSubmitValues;
+    uint32_t            mFrameIndex{ 0 };
+
+    struct PendingUpload
+    {
+        uint64_t value;
+        VkCommandBuffer transferCmdBuffer;
+        VkCommandBuffer acquireCmdBuffer;
+    };
+
+    std::mutex          mQueueMutex;
+    std::mutex          mUploadMutex;
+    VkCommandPool       mUploadAcquireCmdPool;
+    std::vector<PendingUpload>  mPendingUploads;
 
-    VkSemaphore         mImageAvailableSemaphore;
-    VkSemaphore         mShadowMapAvailableSemaphore;
-    VkSemaphore         mRenderFinishedSemaphore;
+    SubmissionTracker*  mGraphicsTracker{ nullptr };
+    SubmissionTracker*  mTransferTracker{ nullptr };
+    SubmissionTracker*  mComputeTracker{ nullptr };
+    DeletionQueue*      mDeletionQueue{ nullptr };
+    DescriptorAllocator* mDescriptorAllocator{ nullptr };
 
     VkDebugReportCallbackEXT mDebugReportCallback;
 
+    // one model per mesh, drawn once for all its instances
+    struct MeshEntry
+    {
+        Model* model{ nullptr };
+        bool loading{ false };
+        bool resident{ false };
+        // spawned before the mesh became resident
+        std::vector<uint32_t> pendingInstances;
+    };
+
     std::vector<Model*> mModels;
+    std::unordered_map<std::string, MeshEntry>  mMeshes;
+    std::unordered_map<uint32_t, Model*>        mLiveInstances;
+    std::unordered_map<uint32_t, std::string>   mInstanceMeshes;
+    ModelLoader*        mModelLoader{ nullptr };
+
+    // simulation side of the scene, owned by the thread calling update()
+    struct SceneObject
+    {
+        uint32_t id;
+        TransformSystem::Handle transform;
+    };
+
+    struct SceneChange
+    {
+        uint32_t id;
+        std::string name;
+        bool spawn;
+    };
+
+    std::vector<SceneObject>    mSceneObjects;
+    TransformSystem*            mTransforms{ nullptr };
+    std::mutex                  mSceneMutex;
+    std::vector<SceneChange>    mSceneChanges;
+    std::chrono::high_resolution_clock::time_point mStartTime;
+
+    FramePacketBuffer*  mFramePackets{ nullptr };
+    std::thread         mRenderThread;
+    JobSystem*          mJobSystem{ nullptr };
+    CommandRecorder*    mCommandRecorder{ nullptr };
+    uint32_t            mNextModelId{ 0 };
     ShadowMap*          mShadowMap{ nullptr };
     DebugCoord*         mDebugCoord{ nullptr };
+    InstanceCuller*     mInstanceCuller{ nullptr };
+    ClusterCuller*      mClusterCuller{ nullptr };
+    GeometryPool*       mGeometryPool{ nullptr };
+    // ranges were freed or moved since the models waiting for room last tried
+    bool                mGeometryPoolChanged{ false };
+    ModelPipeline*      mModelPipeline{ nullptr };
+    ViewUniforms*       mViewUniforms{ nullptr };
+    MaterialTable*      mMaterialTable{ nullptr };
+    bool                mBindlessSupported{ false };
+    // otherwise the CPU rasterizes occluders and the main pass is drawn once
+    bool                mGpuOcclusion{ false };
+    OcclusionRasterizer* mOcclusionRasterizer{ nullptr };
+    CullStats           mCullStats;
 };
 
 }
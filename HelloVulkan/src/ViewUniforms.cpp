@@ -0,0 +1,145 @@
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "VKRenderer.h"
+#include "ViewUniforms.h"
+
+using namespace mathfu;
+
+// a LOD is drawn while its error covers at most this many pixels
+static const float LOD_PIXEL_ERROR = 1.0f;
+// going to a coarser LOD than last frame needs the error below this share of it
+static const float LOD_HYSTERESIS = 0.75f;
+
+ViewUniforms::ViewUniforms()
+{
+    // create uniform buffer, one staging slot per frame in flight
+    {
+        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+        VkDeviceSize stagingSize = bufferSize * VKRenderer::getInstance().getFramesInFlight();
+
+        VKRenderer::getInstance().createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformStagingBuffer, mUniformStagingBufferMemory);
+        // read by the cluster cull on the async compute queue too
+        VKRenderer::getInstance().createSharedBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mUniformBuffer, mUniformBufferMemory);
+
+        void* data = nullptr;
+        auto result = vkMapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, 0, stagingSize, 0, &data);
+        ASSERT_VK_SUCCESS(result);
+        mUniformStagingData = static_cast<uint8_t*>(data);
+    }
+
+    // create descriptor set layout
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+        uboLayoutBinding.binding = 0;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+        uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+        std::array<VkDescriptorSetLayoutBinding, 1> bindings = { uboLayoutBinding };
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        auto result = vkCreateDescriptorSetLayout(VKRenderer::getInstance().getDevice(), &layoutInfo, nullptr, &mDescriptorSetLayout);
+        assert(result == VK_SUCCESS);
+    }
+
+    // create descriptor pool
+    {
+        std::array<VkDescriptorPoolSize, 1> poolSizes = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        poolSizes[0].descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+
+        auto result = vkCreateDescriptorPool(VKRenderer::getInstance().getDevice(), &poolInfo, nullptr, &mDescriptorPool);
+        assert(result == VK_SUCCESS);
+
+        // create descriptor set
+        VkDescriptorSetLayout uboLayouts[] = { mDescriptorSetLayout };
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = mDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = uboLayouts;
+
+        result = vkAllocateDescriptorSets(VKRenderer::getInstance().getDevice(), &allocInfo, &mDescriptorSet);
+        assert(result == VK_SUCCESS);
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = mUniformBuffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(UniformBufferObject);
+
+        std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = mDescriptorSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(VKRenderer::getInstance().getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+ViewUniforms::~ViewUniforms()
+{
+    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mUniformBuffer, nullptr);
+    vkDestroyBuffer(VKRenderer::getInstance().getDevice(), mUniformStagingBuffer, nullptr);
+    vkFreeMemory(VKRenderer::getInstance().getDevice(), mUniformBufferMemory, nullptr);
+    vkUnmapMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory);
+    vkFreeMemory(VKRenderer::getInstance().getDevice(), mUniformStagingBufferMemory, nullptr);
+    vkDestroyDescriptorSetLayout(VKRenderer::getInstance().getDevice(), mDescriptorSetLayout, nullptr);
+    vkFreeDescriptorSets(VKRenderer::getInstance().getDevice(), mDescriptorPool, 1, &mDescriptorSet);
+    vkDestroyDescriptorPool(VKRenderer::getInstance().getDevice(), mDescriptorPool, nullptr);
+}
+
+void ViewUniforms::update(const FramePacket &packet, const std::array<Frustum, RenderQueue::PASS_COUNT> &frusta, uint32_t frameIndex)
+{
+    // clip space to texture coordinates, depth stays as it is
+    mat4 T(
+        0.5f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.5f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.5f, 0.5f, 0.0f, 1.0f);
+
+    UniformBufferObject ubo = {};
+    ubo.view = packet.view;
+    ubo.proj = packet.proj;
+    ubo.viewProj = packet.proj * packet.view;
+    ubo.lightViewProj = packet.lightProj * packet.lightView;
+    ubo.shadowTransform = T * ubo.lightViewProj;
+
+    for (uint32_t i = 0; i < Frustum::PLANE_COUNT; i++)
+    {
+        ubo.frustumPlanes[i] = frusta[RenderQueue::PASS_MAIN].getPlane(i);
+        ubo.shadowFrustumPlanes[i] = frusta[RenderQueue::PASS_SHADOW].getPlane(i);
+    }
+
+    // the projection is flipped for Vulkan's clip space
+    float pixelsPerUnit = std::abs(packet.proj(1, 1)) * 0.5f * static_cast<float>(VKRenderer::getInstance().getDisplaySize().height);
+    ubo.lodParams = vec4(pixelsPerUnit, LOD_PIXEL_ERROR, LOD_HYSTERESIS, 0.f);
+
+    memcpy(mUniformStagingData + frameIndex * sizeof(ubo), &ubo, sizeof(ubo));
+}
+
+void ViewUniforms::recordUniformCopies(VkCommandBuffer cmdBuffer, uint32_t frameIndex) const
+{
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = frameIndex * sizeof(UniformBufferObject);
+    copyRegion.size = sizeof(UniformBufferObject);
+    vkCmdCopyBuffer(cmdBuffer, mUniformStagingBuffer, mUniformBuffer, 1, &copyRegion);
+}
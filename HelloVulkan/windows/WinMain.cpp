@@ -1,9 +1,20 @@
+#include <cstring>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include "VKRenderer.h"
 
-int main()
+int main(int argc, char** argv)
 {
+    // -renderthread draws on a separate thread while the main thread simulates
+    bool useRenderThread = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-renderthread") == 0)
+        {
+            useRenderThread = true;
+        }
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     GLFWwindow* window = glfwCreateWindow(1280, 720, "Hello Vulkan", nullptr, nullptr);
@@ -11,11 +22,19 @@ int main()
     VKRenderer::create();
     VKRenderer::getInstance().init(window);    
 
+    if (useRenderThread)
+    {
+        VKRenderer::getInstance().startRenderThread();
+    }
+
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
         VKRenderer::getInstance().update();
-        VKRenderer::getInstance().draw();
+        if (!useRenderThread)
+        {
+            VKRenderer::getInstance().draw();
+        }
     }
 
     VKRenderer::getInstance().release();